@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <semaphore.h>
+#include "capture.h"
+#include "trace.h"
+
+/**
+ * A non-zero value means the semaphore is shared between processes
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+#define NS_PER_US 1000
+#define CAPTURE_HEADER_SIZE 40 // tag and three varints
+#define CAPTURE_FILE_BUFFER 65536
+
+// capture file, NULL when not capturing
+static FILE* captureFile = NULL;
+
+// guards captureFile and lastTime
+static sem_t* captureLock = NULL;
+
+// trace_now() when the capture started, and of the last record written
+static uint64_t startTime;
+static uint64_t lastTime;
+
+// id of the last connection captured
+static unsigned long lastId = 0;
+
+/**
+ * @brief  starts capturing every connection served by this process
+ * @param  path: file to write, replaced if it exists
+ * @retval true if it could be created, otherwise false
+ */
+bool capture_start(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, CAPTURE_FILE_BUFFER);
+    fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_SIZE, file);
+    fflush(file);
+    captureLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(captureLock, SEMA_SHARE_THREAD, 1);
+    startTime = lastTime = trace_now();
+    captureFile = file;
+    return true;
+}
+
+/**
+ * @brief  appends an unsigned LEB128 number
+ * @param  output: place to write, 10 bytes is always enough
+ * @param  value: the number
+ * @retval one past the last byte written
+ */
+static unsigned char* capture_put_varint(unsigned char* output,
+        uint64_t value) {
+    while (value >= 0x80) {
+        *output++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *output++ = (unsigned char)value;
+    return output;
+}
+
+/**
+ * @brief  writes one record, its time taken under the lock so the times
+ * in the file never go backwards
+ * @param  tag: what happened
+ * @param  capture: the connection
+ * @param  length: bytes in or out, unused for CAPTURE_OPEN
+ * @param  data: CAPTURE_INPUT bytes, otherwise NULL
+ * @retval None
+ */
+static void capture_record(CaptureTag tag, Capture* capture, uint64_t length,
+        const char* data) {
+    unsigned char header[CAPTURE_HEADER_SIZE];
+    unsigned char* end = header;
+    *end++ = tag;
+    end = capture_put_varint(end, capture->id);
+    sem_wait(captureLock);
+    uint64_t now = trace_now();
+    end = capture_put_varint(end, (now - lastTime) / NS_PER_US);
+    lastTime += (now - lastTime) / NS_PER_US * NS_PER_US; // keep the rest
+    if (tag != CAPTURE_OPEN) {
+        end = capture_put_varint(end, length);
+    }
+    fwrite(header, 1, end - header, captureFile);
+    if (tag == CAPTURE_INPUT) {
+        fwrite(data, 1, length, captureFile);
+    } else if (tag == CAPTURE_CLOSE) {
+        for (int i = 0; i < 8; i++) { // hash little endian
+            fputc((int)(capture->outHash >> (i * 8)) & 0xff, captureFile);
+        }
+        fflush(captureFile); // a finished connection survives a kill
+    }
+    sem_post(captureLock);
+}
+
+/**
+ * @brief  starts capturing a newly accepted connection
+ * @retval the capture to pass to the other calls, NULL when not capturing
+ */
+Capture* capture_open() {
+    if (captureFile == NULL) {
+        return NULL;
+    }
+    Capture* capture = (Capture*)malloc(sizeof(Capture));
+    capture->id = __atomic_add_fetch(&lastId, 1, __ATOMIC_RELAXED);
+    capture->outLength = 0;
+    capture->outHash = CAPTURE_HASH_INIT;
+    capture_record(CAPTURE_OPEN, capture, 0, NULL);
+    return capture;
+}
+
+/**
+ * @brief  records bytes received on a connection
+ * @param  capture: the connection, NULL does nothing
+ * @param  data: the bytes
+ * @param  length: number of bytes
+ * @retval None
+ */
+void capture_input(Capture* capture, const char* data, size_t length) {
+    if (capture != NULL && length > 0) {
+        capture_record(CAPTURE_INPUT, capture, length, data);
+    }
+}
+
+/**
+ * @brief  records bytes sent on a connection, only their count and hash
+ * @param  capture: the connection, NULL does nothing
+ * @param  data: the bytes
+ * @param  length: number of bytes
+ * @retval None
+ */
+void capture_output(Capture* capture, const char* data, size_t length) {
+    if (capture != NULL && length > 0) {
+        capture->outLength += length;
+        capture->outHash = capture_hash(capture->outHash, data, length);
+        capture_record(CAPTURE_REPLY, capture, length, NULL);
+    }
+}
+
+/**
+ * @brief  records the end of a connection and frees its capture
+ * @param  capture: the connection, NULL does nothing
+ * @retval None
+ */
+void capture_close(Capture* capture) {
+    if (capture != NULL) {
+        capture_record(CAPTURE_CLOSE, capture, capture->outLength, NULL);
+        free(capture);
+    }
+}
+
+/**
+ * @brief  hashes bytes (FNV-1a 64), a stream can be hashed in pieces
+ * @param  hash: CAPTURE_HASH_INIT, or the hash of the bytes before
+ * @param  data: the bytes
+ * @param  length: number of bytes
+ * @retval the hash of everything so far
+ */
+uint64_t capture_hash(uint64_t hash, const char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief  loads a capture file to read its records
+ * @param  path: the file
+ * @retval newly created reader, NULL if it can not be read or is not a
+ * capture
+ */
+CaptureReader* capture_reader_open(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    CaptureReader* reader = (CaptureReader*)malloc(sizeof(CaptureReader));
+    size_t capacity = CAPTURE_FILE_BUFFER;
+    reader->data = (char*)malloc(capacity);
+    reader->length = 0;
+    size_t readSize;
+    while (readSize = fread(reader->data + reader->length, 1,
+            capacity - reader->length, file), readSize > 0) {
+        reader->length += readSize;
+        if (reader->length == capacity) {
+            capacity *= 2;
+            reader->data = (char*)realloc(reader->data, capacity);
+        }
+    }
+    fclose(file);
+    if (reader->length < CAPTURE_MAGIC_SIZE
+            || memcmp(reader->data, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE)) {
+        capture_reader_free(reader);
+        return NULL;
+    }
+    reader->offset = CAPTURE_MAGIC_SIZE;
+    reader->time = 0;
+    return reader;
+}
+
+/**
+ * @brief  reads an unsigned LEB128 number
+ * @param  reader: the reader, moved past the number
+ * @param  value: set to the number
+ * @retval true if the whole number was there, otherwise false
+ */
+static bool capture_get_varint(CaptureReader* reader, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && reader->offset < reader->length;
+            shift += 7) {
+        unsigned char byte = reader->data[reader->offset++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief  reads the next record
+ * @param  reader: the reader
+ * @param  record: filled with the record
+ * @retval true if there was a whole record, false at the end of the file
+ * (a capture cut short by a kill ends with part of a record)
+ */
+bool capture_reader_next(CaptureReader* reader, CaptureRecord* record) {
+    uint64_t id, delta;
+    if (reader->offset >= reader->length) {
+        return false;
+    }
+    record->tag = (CaptureTag)reader->data[reader->offset++];
+    if (!capture_get_varint(reader, &id)
+            || !capture_get_varint(reader, &delta)) {
+        return false;
+    }
+    record->id = id;
+    reader->time += delta;
+    record->time = reader->time;
+    record->data = NULL;
+    record->length = 0;
+    record->hash = 0;
+    switch (record->tag) {
+        case CAPTURE_OPEN:
+            return true;
+        case CAPTURE_INPUT:
+            if (!capture_get_varint(reader, &record->length)
+                    || record->length > reader->length - reader->offset) {
+                return false;
+            }
+            record->data = reader->data + reader->offset;
+            reader->offset += record->length;
+            return true;
+        case CAPTURE_REPLY:
+            return capture_get_varint(reader, &record->length);
+        case CAPTURE_CLOSE:
+            if (!capture_get_varint(reader, &record->length)
+                    || reader->length - reader->offset < 8) {
+                return false;
+            }
+            for (int i = 0; i < 8; i++) {
+                record->hash |= (uint64_t)(unsigned char)
+                        reader->data[reader->offset++] << (i * 8);
+            }
+            return true;
+        default:
+            return false; // not a capture record
+    }
+}
+
+/**
+ * @brief  frees the reader and the file held in memory
+ * @param  reader: the reader to free
+ * @retval None
+ */
+void capture_reader_free(CaptureReader* reader) {
+    free(reader->data);
+    free(reader);
+}
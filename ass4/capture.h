@@ -0,0 +1,62 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAPTURE_MAGIC "CAP2310\n" // first bytes of a capture file
+#define CAPTURE_MAGIC_SIZE 8
+#define CAPTURE_HASH_INIT 14695981039346656037ULL // FNV-1a 64 offset
+
+/* what a capture record says happened, its tag in the file */
+typedef enum {
+    CAPTURE_OPEN = 'O', // connection accepted
+    CAPTURE_INPUT = 'I', // bytes received
+    CAPTURE_REPLY = 'R', // bytes sent (only their count is kept)
+    CAPTURE_CLOSE = 'C' // connection done, size and hash of all it sent
+} CaptureTag;
+
+/* one connection being captured */
+typedef struct Capture {
+    unsigned long id; // numbered from 1 in the order accepted
+    uint64_t outLength; // bytes sent so far
+    uint64_t outHash; // capture_hash of them
+} Capture;
+
+/* one record read back from a capture file */
+typedef struct {
+    CaptureTag tag;
+    unsigned long id;
+    uint64_t time; // microseconds since the capture started
+    const char* data; // CAPTURE_INPUT bytes, valid while the file is read
+    uint64_t length; // bytes in or out, everything sent for CAPTURE_CLOSE
+    uint64_t hash; // CAPTURE_CLOSE only
+} CaptureRecord;
+
+/* a capture file in memory being read record by record */
+typedef struct {
+    char* data;
+    size_t length;
+    size_t offset;
+    uint64_t time;
+} CaptureReader;
+
+bool capture_start(const char* path);
+
+Capture* capture_open();
+
+void capture_input(Capture* capture, const char* data, size_t length);
+
+void capture_output(Capture* capture, const char* data, size_t length);
+
+void capture_close(Capture* capture);
+
+uint64_t capture_hash(uint64_t hash, const char* data, size_t length);
+
+CaptureReader* capture_reader_open(const char* path);
+
+bool capture_reader_next(CaptureReader* reader, CaptureRecord* record);
+
+void capture_reader_free(CaptureReader* reader);
+
+#endif
@@ -1,13 +1,24 @@
 #include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include "shared.h"
+#include "connectionHandler.h"
+#include "trace.h"
+#include "green.h"
+#include "uring.h"
+#include "scan.h"
+#include "fleet.h"
+#include "latency.h"
 
-#define BUFFER_SIZE 150 // longest string
 
 // Used to pass arguments to process_thread()
 // contain a mapping or airport reference or planeId and connectionFD
@@ -18,8 +29,59 @@ typedef struct {
     Airport* airport; // for control2310
     bool decide; // true run mapper, false run control
     const char* planeId;
+    uint64_t acceptTime; // for the request trace
 } ProcessThreadArgs;
 
+// connections currently being served, lets a mapper drain before exiting
+static int activeConnections = 0;
+
+// of those, ~ subscribers, which never finish on their own
+static int activeSubscribers = 0;
+
+// dumps (@ and log) currently being sent
+static int activeExpensive = 0;
+
+// admission limits, see connection_set_limits()
+static int maxConnections = DEFAULT_MAX_CONNECTIONS;
+static int maxExpensive = DEFAULT_MAX_EXPENSIVE;
+
+// what a connection to a control has selected so far
+typedef struct {
+    Airport* airport; // served airport, the port's first until =ID
+    bool started; // a request was read, =ID can no longer select
+} AirportSession;
+
+// what a completion of serve_airport_uring() is for, kept in the low 
+// bits of its user_data (the rest is the UringConnection)
+typedef enum {
+    URING_ACCEPT = 0,
+    URING_RECV = 1,
+    URING_SEND = 2,
+    URING_CLOSE = 3,
+    URING_CANCEL = 4
+} UringOperation;
+#define URING_OPERATION_MASK 7
+
+// one connection served by serve_airport_uring()
+typedef struct {
+    int connectionFD;
+    uint64_t acceptTime; // for the request trace
+    AirportSession session;
+    char* input; // received bytes not yet ended by '\n'
+    size_t inputLength;
+    size_t inputCapacity;
+    bool dropping; // skipping the rest of a too long line
+    LineWriter* output; // memory writer holding replies not yet sent
+    Capture* capture; // NULL if not captured
+    char* sending; // reply being sent, NULL if none
+    size_t sendingLength;
+    size_t sendingOffset;
+    bool receiving; // multishot recv still armed
+    bool finishing; // no more requests, close once the replies are sent
+    bool closeSubmitted;
+    bool closed;
+} UringConnection;
+
 // Used to return arguments from a parsed message
 // contain valid to decide either print or not
 // id name and port number in the message 
@@ -27,6 +89,7 @@ typedef struct {
     bool valid; 
     char* idName;
     unsigned long portNumber;
+    long ttl; // lease seconds from ID:PORT:TTL, 0 if not given
 } MessageInfo;
 
 /**
@@ -36,17 +99,18 @@ typedef struct {
  * @param  streamWrite: place to print
  * @retval None
  */
-void parse_ask_message(Mapper* mapping, char* message, FILE* streamWrite) {
+void parse_ask_message(Mapper* mapping, char* message, 
+        LineWriter* streamWrite) {
     MessageInfo info;
     info.valid = true;
 
-    // cut message to parse portion without invalid chars
-    message[strcspn(message, "\r")] = '\0';
-    message[strcspn(message, "\n")] = '\0';
+    // cut message at '\r' and check the name in the same scan
+    ScanResult scan;
+    scan_message(message, &scan);
 
     // get id(name) and validate
     info.idName = message;
-    if (!is_valid_name(info.idName)) {
+    if (!scan_is_name(&scan, scan.length)) {
         info.valid = false;
     }
 
@@ -55,82 +119,517 @@ void parse_ask_message(Mapper* mapping, char* message, FILE* streamWrite) {
     }
     int portNumber = mapping_get_port_number(mapping, info.idName);
     if (portNumber != 0) {
-        fprintf(streamWrite, "%d\n", portNumber);
-        fflush(streamWrite);
+        line_writer_printf(streamWrite, "%d\n", portNumber);
     } else {
-        fprintf(streamWrite, ";\n");
-        fflush(streamWrite);
+        line_writer_write(streamWrite, ";\n", 2);
     }
+    line_writer_flush(streamWrite);
 }
 
 /**
- * @brief  (MAPPER) parses and actions a add message: !ID:PORT
+ * @brief  (MAPPER) parses and actions a reverse lookup message $PORT, the 
+ * airports registered with PORT one per line, ended by "."
  * @param  mapping: the local map 
  * @param  message: pointer to first character of deliver message arguments
+ * @param  streamWrite: place to print
  * @retval None
  */
-void parse_add_message(Mapper* mapping, char* message) {
-    MessageInfo info;
-    info.valid = true;
+void parse_port_message(Mapper* mapping, char* message, 
+        LineWriter* streamWrite) {
+    scan_trim(message);
+    char* portErr;
+    long portNumber = strtol(message, &portErr, 10);
+    if (!isdigit(message[0]) || *portErr != '\0') {
+        return;
+    }
+    mapping_print_port_airports(mapping, portNumber, streamWrite);
+    line_writer_write(streamWrite, ".\n", 2);
+    line_writer_flush(streamWrite);
+}
 
-    // replace the invalid char with terminate char
-    message[strcspn(message, "\r")] = '\0';
-    message[strcspn(message, "\n")] = '\0';
+/**
+ * @brief  (MAPPER) parses an ID:PORT pair, shared by ! ^ and & messages, 
+ * optionally followed by :TTL
+ * @param  message: pointer to first character of the pair (changed in place)
+ * @param  info: filled with the id name and port number
+ * @retval true if the pair is valid, otherwise false
+ */
+bool parse_pair(char* message, MessageInfo* info) {
+    info->valid = true;
+
+    // cut at '\r' and find the colon in one scan
+    ScanResult scan;
+    scan_message(message, &scan);
 
     // get id(name) and validate
-    info.idName = message;
-    int firstColon = strcspn(message, ":");  // use for separate two input
-    info.idName[firstColon] = '\0';
+    info->idName = message;
+    size_t firstColon = scan.colon;  // use for separate two input
+    if (firstColon >= scan.length) {
+        return false; // no port given
+    }
+    info->idName[firstColon] = '\0';
     // get port and validate
-    char* res = &info.idName[firstColon + 1];
+    char* res = &info->idName[firstColon + 1];
     char* portErr;
-    info.portNumber = strtoul(res, &portErr, 10);
-    if (info.portNumber < 0 || isspace(res[0])) {
-        info.valid = false;
+    info->portNumber = strtoul(res, &portErr, 10);
+    if (info->portNumber < 0 || isspace(res[0])) {
+        info->valid = false;
+    }
+    info->ttl = 0;
+    if (portErr[0] == ':') {
+        info->ttl = parse_positive_number(portErr + 1);
+        if (info->ttl < 0) {
+            info->valid = false;
+        }
     }
 
     // validate field1Str
-    if (!is_valid_name(info.idName)) {
-        info.valid = false;
+    if (!scan_is_name(&scan, firstColon)) {
+        info->valid = false;
     }
+    return info->valid;
+}
 
-    if (!info.valid) {
+/**
+ * @brief  (MAPPER) parses and actions a add message: !ID:PORT, or 
+ * !ID:PORT:TTL for a registration which lapses unless renewed
+ * @param  mapping: the local map 
+ * @param  message: pointer to first character of deliver message arguments
+ * @retval None
+ */
+void parse_add_message(Mapper* mapping, char* message) {
+    MessageInfo info;
+    if (!parse_pair(message, &info)) {
         return;
     }
 
-    mapping_set_port_number(mapping, info.idName, info.portNumber);
+    mapping_set_port_number(mapping, info.idName, info.portNumber, 
+            info.ttl);
 }
 
 /**
- * @brief  (MAPPER) parses and actions a all message @
+ * @brief  (MAPPER) parses and actions a renew message: ^ID:PORT:TTL
+ * keeps the registration for TTL more seconds (registering it again if 
+ * it already lapsed), no reply is sent
  * @param  mapping: the local map 
- * @param  message: pointer to first char of deliver message arguments
+ * @param  message: pointer to first character of deliver message arguments
+ * @retval None
+ */
+void parse_renew_message(Mapper* mapping, char* message) {
+    MessageInfo info;
+    if (!parse_pair(message, &info) || info.ttl == 0 
+            || info.portNumber == 0) {
+        return;
+    }
+
+    mapping_renew_port_number(mapping, info.idName, info.portNumber, 
+            info.ttl);
+}
+
+/**
+ * @brief  (MAPPER) parses and actions a bulk add message: &COUNT followed 
+ * by COUNT lines of ID:PORT, replies &APPLIED once all are stored
+ * @note   all pairs are stored under one lock, invalid pairs are skipped
+ * @param  mapping: the local map 
+ * @param  message: pointer to the count after the &
+ * @param  streamRead: source for the pair lines
+ * @param  streamWrite: place to print
+ * @retval None
+ */
+void parse_bulk_message(Mapper* mapping, char* message, 
+        LineReader* streamRead, LineWriter* streamWrite) {
+    scan_trim(message);
+    char* countErr;
+    long count = strtol(message, &countErr, 10);
+    if (*countErr != '\0' || count <= 0 || count > MAX_BULK_SIZE 
+            || isspace(message[0])) {
+        line_writer_write(streamWrite, ";\n", 2);
+        line_writer_flush(streamWrite);
+        return;
+    }
+
+    // views are reused by the reader so keep a copy of each name
+    char** names = (char**)malloc(sizeof(char*) * count);
+    long* ports = (long*)malloc(sizeof(long) * count);
+    int applied = 0;
+    StringView line;
+    for (long i = 0; i < count; i++) {
+        LineStatus status = line_reader_next(streamRead, &line);
+        if (status == LINE_EOF || status == LINE_ERROR) {
+            break;
+        }
+        MessageInfo info;
+        if (status == LINE_OK && parse_pair(line.data, &info)) {
+            names[applied] = strdup(info.idName);
+            ports[applied] = info.portNumber;
+            applied++;
+        }
+    }
+
+    int stored = mapping_set_port_numbers(mapping, names, ports, applied);
+    line_writer_printf(streamWrite, "&%d\n", stored);
+    line_writer_flush(streamWrite);
+
+    for (int i = 0; i < applied; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(ports);
+}
+
+/**
+ * @brief  (MAPPER) parses and actions a completion message %K:PREFIX
+ * replies with up to K lines of ID:PORT for airports starting with 
+ * PREFIX in lexicographic order, followed by a line holding only .
+ * @param  mapping: the local map 
+ * @param  message: pointer to the K after the %
+ * @param  streamWrite: place to print
+ * @retval None
+ */
+void parse_complete_message(Mapper* mapping, char* message, 
+        LineWriter* streamWrite) {
+    scan_trim(message);
+    char* limitErr;
+    long limit = strtol(message, &limitErr, 10);
+    if (*limitErr != ':' || !isdigit(message[0])) {
+        return;
+    }
+    if (limit > MAX_COMPLETIONS) {
+        limit = MAX_COMPLETIONS;
+    }
+
+    mapping_print_completions(mapping, limitErr + 1, limit, streamWrite);
+    line_writer_write(streamWrite, ".\n", 2);
+    line_writer_flush(streamWrite);
+}
+
+/**
+ * @brief  check whether the other end has closed the connection
+ * @param  connectionFD: the connection to check
+ * @retval true if closed, otherwise false
+ */
+bool is_peer_closed(int connectionFD) {
+    char peek;
+    return recv(connectionFD, &peek, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+/**
+ * @brief  (MAPPER) parses and actions a subscribe message ~PREFIX
+ * replies ~ then pushes ID:PORT for every later registration starting 
+ * with PREFIX until the connection closes
+ * @note   the connection is used for nothing else afterwards. A subscriber 
+ * which falls SUBSCRIBER_QUEUE_SIZE deltas behind is disconnected.
+ * @param  mapping: the local map 
+ * @param  message: pointer to the prefix after the ~
+ * @param  streamWrite: place to print
+ * @retval None
+ */
+void parse_subscribe_message(Mapper* mapping, char* message, 
+        LineWriter* streamWrite) {
+    scan_trim(message);
+    Subscriber* subscriber = mapping_subscribe(mapping, message);
+    __atomic_add_fetch(&activeSubscribers, 1, __ATOMIC_SEQ_CST);
+    line_writer_write(streamWrite, "~\n", 2);
+
+    Delta delta;
+    SubscriberStatus status;
+    while (line_writer_flush(streamWrite)) {
+        status = subscriber_next(subscriber, &delta);
+        if (status == SUBSCRIBER_DROPPED) {
+            break;
+        } else if (status == SUBSCRIBER_IDLE) {
+            if (is_peer_closed(streamWrite->fileDescriptor)) {
+                break;
+            }
+            continue;
+        }
+        line_writer_printf(streamWrite, "%s:%ld\n", delta.airportName, 
+                delta.portNumber);
+        free(delta.airportName);
+    }
+    __atomic_sub_fetch(&activeSubscribers, 1, __ATOMIC_SEQ_CST);
+    mapping_unsubscribe(mapping, subscriber);
+}
+
+/**
+ * @brief  takes a slot for an expensive request (@ or log), or sends the 
+ * busy reply if all maxExpensive slots are taken
+ * @note   a taken slot must be given back with expensive_release()
+ * @param  streamWrite: place to print the busy reply
+ * @retval true if a slot was taken, otherwise false
+ */
+bool expensive_acquire(LineWriter* streamWrite) {
+    if (__atomic_add_fetch(&activeExpensive, 1, __ATOMIC_SEQ_CST) 
+            > maxExpensive) {
+        __atomic_sub_fetch(&activeExpensive, 1, __ATOMIC_SEQ_CST);
+        line_writer_write(streamWrite, BUSY_REPLY, strlen(BUSY_REPLY));
+        line_writer_flush(streamWrite);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief  gives back a slot taken by expensive_acquire()
+ * @retval None
+ */
+void expensive_release() {
+    __atomic_sub_fetch(&activeExpensive, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief  check if the line is only the command itself ended by '\n'
+ * @param  line: the whole received line
+ * @param  commandLength: length of the command e.g. 3 for log
+ * @retval true if nothing follows the command, otherwise false
+ */
+bool is_bare_command(StringView* line, size_t commandLength) {
+    return line->complete && line->length == commandLength;
+}
+
+/**
+ * @brief  parses the encoding asked for after a dump command, e.g. the 
+ * "front+lz" of "log front+lz"
+ * @param  message: the arguments after the command and its space
+ * @param  encoding: set to the encoding
+ * @retval true if it is a known encoding, otherwise false
+ */
+bool parse_encoding(char* message, Encoding* encoding) {
+    scan_trim(message);
+    return encoding_parse(message, encoding);
+}
+
+/**
+ * @brief  starts an encoded dump with "+ENCODING", so a client knows it 
+ * was understood
+ * @param  encoding: the encoding asked for
  * @param  streamWrite: place to print
  * @retval None
  */
-void parse_all_message(Mapper* mapping, char* message, FILE* streamWrite) {
-    if (message[0] != '\n') {
+void send_encoding_header(Encoding encoding, LineWriter* streamWrite) {
+    char name[ENCODING_NAME_SIZE];
+    encoding_name(encoding, name);
+    line_writer_printf(streamWrite, "+%s\n", name);
+}
+
+/**
+ * @brief  (MAPPER) parses and actions a all message @, or "@ ENCODING" 
+ * which is headed by "+ENCODING" and ended by "."
+ * @param  mapping: the local map 
+ * @param  line: the whole received line
+ * @param  streamWrite: place to print
+ * @retval None
+ */
+void parse_all_message(Mapper* mapping, StringView* line, 
+        LineWriter* streamWrite) {
+    Encoding encoding = {ENCODING_PLAIN, false};
+    bool encoded = !is_bare_command(line, 1);
+    if (encoded && (!line->complete || line->data[1] != ' ' 
+            || !parse_encoding(line->data + 2, &encoding))) {
+        return;
+    }
+    if (!expensive_acquire(streamWrite)) {
         return;
     }
     
-    mapping_print_airport_port_numbers(mapping, streamWrite);
+    if (encoded) {
+        send_encoding_header(encoding, streamWrite);
+    }
+    mapping_print_airport_port_numbers(mapping, encoding, streamWrite);
+    if (encoded) {
+        line_writer_write(streamWrite, ".\n", 2);
+    }
+    line_writer_flush(streamWrite);
+    expensive_release();
 }
 
 /**
- * @brief  (AIRPORT) parses and actions a all message log 
- * (plane visited the airport)
- * @param  airport: the local airport 
- * @param  message: pointer to first char of deliver message arguments
+ * @brief  (MAPPER) parses and actions a latency message #, percentiles 
+ * of every timed command and of semaphore waits, ended by "."
+ * @param  line: the whole received line
+ * @param  streamWrite: place to print
+ * @retval None
+ */
+void parse_latency_message(StringView* line, LineWriter* streamWrite) {
+    if (!is_bare_command(line, 1)) {
+        return;
+    }
+    latency_print(streamWrite);
+    line_writer_write(streamWrite, ".\n", 2);
+    line_writer_flush(streamWrite);
+}
+
+/**
+ * @brief  (MAPPER) parses and actions a fleet log message *, the merged 
+ * log of every registered airport
+ * @param  mapping: the local map 
+ * @param  line: the whole received line
  * @param  streamWrite: place to print
+ * @retval None
  */
-void parse_log_message(Airport* airport, char* message, FILE* streamWrite) {
-    if (message[0] != '\n') {
+void parse_fleet_message(Mapper* mapping, StringView* line, 
+        LineWriter* streamWrite) {
+    if (!is_bare_command(line, 1) || !expensive_acquire(streamWrite)) {
         return;
     }
+    fleet_print_log(mapping, streamWrite);
+    expensive_release();
+}
+
+/**
+ * @brief  (AIRPORT) parses the arguments of a ranged log message
+ * "SINCE t" is the last t seconds, "t1 t2" is from second t1 to t2 
+ * since the control started
+ * @param  airport: the local airport 
+ * @param  message: the arguments after "log "
+ * @param  from: set to the first second of the range
+ * @param  to: set to the last second of the range
+ * @retval true if the range is valid, otherwise false
+ */
+bool parse_log_range(Airport* airport, char* message, long* from, 
+        long* to) {
+    char* rangeErr;
+    scan_trim(message);
+    if (!strncmp("SINCE ", message, 6)) {
+        long seconds = strtol(message + 6, &rangeErr, 10);
+        if (*rangeErr != '\0' || seconds < 0 || !isdigit(message[6])) {
+            return false;
+        }
+        *to = airport_now(airport);
+        *from = *to - seconds;
+        return true;
+    }
+    if (!isdigit(message[0])) {
+        return false;
+    }
+    *from = strtol(message, &rangeErr, 10);
+    if (rangeErr[0] != ' ' || !isdigit(rangeErr[1])) {
+        return false;
+    }
+    *to = strtol(rangeErr + 1, &rangeErr, 10);
+    return *rangeErr == '\0' && *from <= *to;
+}
 
-    airport_print_plane(airport, streamWrite);
-    fprintf(streamWrite, ".\n");
-    fflush(streamWrite);
+/**
+ * @brief  (AIRPORT) parses the cursor of a "log AFTER EPOCH:N" message, 
+ * or of "log AFTER N" without an epoch
+ * @param  message: the arguments after "log "
+ * @param  epoch: set to the epoch, 0 if none is given
+ * @param  after: set to the cursor
+ * @retval true if message is AFTER and a cursor, otherwise false
+ */
+bool parse_log_cursor(char* message, unsigned long* epoch, 
+        unsigned long* after) {
+    scan_trim(message);
+    if (strncmp("AFTER ", message, 6) || !isdigit(message[6])) {
+        return false;
+    }
+    char* cursorErr;
+    *epoch = 0;
+    *after = strtoul(message + 6, &cursorErr, 10);
+    if (*cursorErr == ':' && isdigit(cursorErr[1])) {
+        *epoch = *after;
+        *after = strtoul(cursorErr + 1, &cursorErr, 10);
+    }
+    return *cursorErr == '\0';
+}
+
+/**
+ * @brief  (AIRPORT) parses and actions a "log STATS" message, the visit 
+ * statistics from the sketch if the airport keeps one, otherwise exact. 
+ * "log STATS EXACT" and "log STATS SKETCH" pick the source.
+ * @note   exact statistics walk the whole log, so they are expensive
+ * @param  airport: the local airport 
+ * @param  message: the arguments after "log STATS"
+ * @param  streamWrite: place to print
+ * @retval true if the statistics (ended by ".") or the busy reply were 
+ * sent, false if the message is invalid
+ */
+bool parse_stats_message(Airport* airport, char* message, 
+        LineWriter* streamWrite) {
+    bool exact;
+    if (*message == '\0') {
+        exact = airport->sketch == NULL;
+    } else if (!strcmp(message, " EXACT") || !strcmp(message, " SKETCH")) {
+        exact = message[1] == 'E';
+    } else {
+        return false;
+    }
+    if ((exact && !airport->exact) || (!exact && airport->sketch == NULL)) {
+        return false; // not kept here
+    }
+    if (exact && !expensive_acquire(streamWrite)) {
+        return true; // busy reply sent
+    }
+    airport_print_stats(airport, exact, streamWrite);
+    if (exact) {
+        expensive_release();
+    }
+    line_writer_write(streamWrite, ".\n", 2);
+    line_writer_flush(streamWrite);
+    return true;
+}
+
+/**
+ * @brief  (AIRPORT) parses and actions a all message log 
+ * (plane visited the airport), or a ranged "log SINCE t" / "log t1 t2", 
+ * or the visits after a cursor "log AFTER EPOCH:N", or a full log in an 
+ * encoding "log ENCODING" headed by "+ENCODING", or the latency 
+ * percentiles "log LATENCY", or the visit statistics "log STATS"
+ * @note   full, ranged and cursor logs are expensive and may get the 
+ * busy reply instead
+ * @param  airport: the local airport 
+ * @param  line: the whole received line
+ * @param  streamWrite: place to print
+ * @retval true if a log was sent, otherwise false
+ */
+bool parse_log_message(Airport* airport, StringView* line, 
+        LineWriter* streamWrite) {
+    Encoding encoding = {ENCODING_PLAIN, false};
+    bool encoded = !is_bare_command(line, 3) && line->complete 
+            && line->data[3] == ' ' 
+            && parse_encoding(line->data + 4, &encoding);
+    if (is_bare_command(line, 3) || encoded) {
+        if (!expensive_acquire(streamWrite)) {
+            return true; // busy reply sent, close like a log
+        }
+        if (encoded) {
+            send_encoding_header(encoding, streamWrite);
+        }
+        airport_print_plane(airport, encoding, streamWrite);
+        expensive_release();
+    } else {
+        long from, to;
+        unsigned long epoch, after;
+        if (!line->complete || line->data[3] != ' ') {
+            return false;
+        }
+        bool cursor = parse_log_cursor(line->data + 4, &epoch, &after);
+        bool range = !cursor 
+                && parse_log_range(airport, line->data + 4, &from, &to);
+        if (cursor || range) {
+            if (!expensive_acquire(streamWrite)) {
+                return true; // busy reply sent, close like a log
+            }
+            if (cursor) {
+                airport_print_plane_after(airport, epoch, after, 
+                        streamWrite);
+            } else {
+                airport_print_plane_range(airport, from, to, streamWrite);
+            }
+            expensive_release();
+        } else if (!strcmp(line->data + 4, "LATENCY")) {
+            latency_print(streamWrite);
+        } else if (!strncmp(line->data + 4, "STATS", 5)) {
+            return parse_stats_message(airport, line->data + 9, 
+                    streamWrite);
+        } else {
+            return false;
+        }
+    }
+    line_writer_write(streamWrite, ".\n", 2);
+    line_writer_flush(streamWrite);
+    return true;
 }
 
 /**
@@ -139,17 +638,18 @@ void parse_log_message(Airport* airport, char* message, FILE* streamWrite) {
  * @param  message: pointer to first char of deliver message arguments
  * @param  streamWrite: place to print
  */
-void parse_res_message(Airport* airport, char* message, FILE* streamWrite) {
+void parse_res_message(Airport* airport, char* message, 
+        LineWriter* streamWrite) {
     MessageInfo info;
     info.valid = true;
 
-    // cut message to parse portion without invalid chars
-    message[strcspn(message, "\r")] = '\0';
-    message[strcspn(message, "\n")] = '\0';
+    // cut message at '\r' and check the name in the same scan
+    ScanResult scan;
+    scan_message(message, &scan);
 
     // get id(name) and validate
     info.idName = message;
-    if (!is_valid_name(info.idName)) {
+    if (!scan_is_name(&scan, scan.length)) {
         info.valid = false;
     }
 
@@ -160,53 +660,114 @@ void parse_res_message(Airport* airport, char* message, FILE* streamWrite) {
     airport_set_plane_id(airport, info.idName);
     const char* airportInfo = airport->airportInfo;
     if (airportInfo != NULL) {
-        fprintf(streamWrite, "%s\n", airportInfo);
-        fflush(streamWrite);
+        line_writer_printf(streamWrite, "%s\n", airportInfo);
+        line_writer_flush(streamWrite);
     } else {
         return;
     }
 }
 
 /**
- * @brief  check if there is unexpected eof on message
- * @param  message: message body
- * @retval true on no, false if yes
+ * @brief  (MAPPER) Parses all received messages
+ * @param  mapping: the local map 
+ * @param  streamRead: source for incoming messages
+ * @param  streamWrite: place to write
+ * @retval None
  */
-bool check_string_eof(char* message) {
-    if (message[0] == '\0') {
-        return false; // unexpected EOF
+void parse_messages(Mapper* mapping, LineReader* streamRead, 
+        LineWriter* streamWrite) {
+    StringView line;
+    LineStatus status;
+
+    while (status = line_reader_next(streamRead, &line), 
+            status != LINE_EOF && status != LINE_ERROR) {
+        if (status == LINE_TOO_LONG) {
+            continue; // never split a long line into two commands
+        }
+        size_t sentBefore = streamWrite->sent + streamWrite->length;
+        trace_begin(line.data[0], line.length + 1);
+        if (line.data[0] == '?') {
+            parse_ask_message(mapping, line.data + 1, streamWrite);
+        } else if (line.data[0] == '$') {
+            parse_port_message(mapping, line.data + 1, streamWrite);
+        } else if (line.data[0] == '!') {
+            parse_add_message(mapping, line.data + 1);
+        } else if (line.data[0] == '^') {
+            parse_renew_message(mapping, line.data + 1);
+        } else if (line.data[0] == '&') {
+            parse_bulk_message(mapping, line.data + 1, streamRead, 
+                    streamWrite);
+        } else if (line.data[0] == '@') {
+            parse_all_message(mapping, &line, streamWrite);
+        } else if (line.data[0] == '*') {
+            parse_fleet_message(mapping, &line, streamWrite);
+        } else if (line.data[0] == '%') {
+            parse_complete_message(mapping, line.data + 1, streamWrite);
+        } else if (line.data[0] == '#') {
+            parse_latency_message(&line, streamWrite);
+        } else if (line.data[0] == '~') {
+            parse_subscribe_message(mapping, line.data + 1, streamWrite);
+            trace_end(streamWrite->sent - sentBefore);
+            break; // connection belongs to the subscription
+        }
+        trace_end(streamWrite->sent + streamWrite->length - sentBefore);
     }
-    if (message[0] != '\n') {
+}
+
+/**
+ * @brief  (AIRPORT) parses and actions a select message =ID, which picks 
+ * the hosted airport the rest of the connection is served by
+ * @note   nothing is replied
+ * @param  session: the connection's session
+ * @param  message: pointer to first char of deliver message arguments
+ * @retval true if ID is hosted here, otherwise false (nothing changed)
+ */
+bool parse_select_message(AirportSession* session, char* message) {
+    ScanResult scan;
+    scan_message(message, &scan);
+    Airport* airport = scan_is_name(&scan, scan.length) 
+            ? airport_select(session->airport, message) : NULL;
+    if (airport == NULL) {
         return false;
     }
+    session->airport = airport;
     return true;
 }
 
 /**
- * @brief  (MAPPER) Parses all received messages
- * @param  mapping: the local map 
- * @param  streamRead: source for incoming messages
+ * @brief  (AIRPORT) Parses and actions one received message
+ * @note   only the first message may be =ID. An =ID this port does not 
+ * host is a plane named "=ID" if the control hosts one airport, but is 
+ * refused with ";" if it hosts several, as it is then a selection the 
+ * port can not serve (e.g. the port was taken over by another control).
+ * @param  session: the connection's session
+ * @param  line: the whole received line
  * @param  streamWrite: place to write
- * @retval None
+ * @retval true if the connection is done (a log was sent or a selection 
+ * refused), otherwise false
  */
-void parse_messages(Mapper* mapping, FILE* streamRead, FILE* streamWrite) {
-    char buffer[BUFFER_SIZE];
-
-    while (fgets(buffer, BUFFER_SIZE, streamRead) != NULL) {
-        if (!strncmp("?", buffer, 1)) {
-            parse_ask_message(mapping, buffer + 1, streamWrite);
-            if (check_string_eof(buffer + 1)) {
-                break;
-            }
-        } else if (!strncmp("!", buffer, 1)) {
-            parse_add_message(mapping, buffer + 1);
-            if (check_string_eof(buffer + 1)) {
-                break;
-            }
-        } else if (!strncmp("@", buffer, 1)) {
-            parse_all_message(mapping, buffer + 1, streamWrite);
-        }
+bool parse_message_airport(AirportSession* session, StringView* line, 
+        LineWriter* streamWrite) {
+    size_t sentBefore = streamWrite->sent + streamWrite->length;
+    bool done = false;
+    bool selection = !session->started && line->data[0] == '=';
+    if (selection && parse_select_message(session, line->data + 1)) {
+        trace_begin('=', line->length + 1);
+    } else if (selection && session->airport->group != NULL) {
+        trace_begin('=', line->length + 1);
+        line_writer_write(streamWrite, ";\n", 2); // not hosted here
+        line_writer_flush(streamWrite);
+        done = true;
+    } else if (!strncmp("log", line->data, 3)) {
+        trace_begin('l', line->length + 1);
+        done = parse_log_message(session->airport, line, streamWrite);
+    } else {
+        trace_begin('v', line->length + 1);
+        parse_res_message(session->airport, line->data, streamWrite);
     }
+    session->started = true;
+    trace_end(streamWrite->sent + streamWrite->length - sentBefore);
+    return done;
 }
 
 /**
@@ -216,30 +777,38 @@ void parse_messages(Mapper* mapping, FILE* streamRead, FILE* streamWrite) {
  * @param  streamWrite: place to write
  * @retval None
  */
-void parse_messages_airport(Airport* airport, FILE* streamRead, 
-        FILE* streamWrite) {
-    char buffer[BUFFER_SIZE];
-    while (fgets(buffer, BUFFER_SIZE, streamRead) != NULL) {
-        if (!strncmp("log", buffer, 3)) {
-            parse_log_message(airport, buffer + 3, streamWrite); 
-            if (check_string_eof(buffer + 3)) {
-                break;
-            }
-        } else {
-            parse_res_message(airport, buffer, streamWrite);
+void parse_messages_airport(Airport* airport, LineReader* streamRead, 
+        LineWriter* streamWrite) {
+    StringView line;
+    LineStatus status;
+    AirportSession session = {airport, false};
+
+    while (status = line_reader_next(streamRead, &line), 
+            status != LINE_EOF && status != LINE_ERROR) {
+        if (status == LINE_TOO_LONG) {
+            session.started = true;
+            continue;
+        }
+        if (parse_message_airport(&session, &line, streamWrite)) {
+            break;
         }
     }
 }
 
 /**
  * @brief  (ROC) send the plane name to airport for record
+ * @param  airportId: airport to select first with =ID, or NULL
  * @param  planeId: plane name
  * @param  streamWrite: place to write
  * @retval None
  */
-void send_message_plane(const char* planeId, FILE* streamWrite) {
-    fprintf(streamWrite, "%s\n", planeId);
-    fflush(streamWrite);
+void send_message_plane(const char* airportId, const char* planeId, 
+        LineWriter* streamWrite) {
+    if (airportId != NULL) {
+        line_writer_printf(streamWrite, "=%s\n", airportId);
+    }
+    line_writer_printf(streamWrite, "%s\n", planeId);
+    line_writer_flush(streamWrite);
 }
 
 /**
@@ -253,36 +822,82 @@ void* process_thread(void* passArgs) {
     ProcessThreadArgs* args = (ProcessThreadArgs*)passArgs;
     int connectionFD = args->connectionFD;
     bool decide = args->decide;
+    trace_connection(connectionFD, args->acceptTime);
+
+    // reader and writer share the socket, no dup or stdio needed
+    LineReader* streamRead = line_reader_create(connectionFD, 
+            MAX_LINE_SIZE);
+    LineWriter* streamWrite = line_writer_create(connectionFD);
+    Capture* capture = capture_open();
+    streamRead->capture = capture;
+    streamWrite->capture = capture;
     if (decide) { // true for mapper
         Mapper* mapping = args->mapping;
         free(args);        
-
-        // create comm streams 
-        int connectionFD2 = dup(connectionFD);
-        FILE* streamWrite = fdopen(connectionFD, "w");
-        FILE* streamRead = fdopen(connectionFD2, "r");
-
         parse_messages(mapping, streamRead, streamWrite);
-
-        // connection terminated
-        fclose(streamRead);
-        fclose(streamWrite);
     } else {      // false for control
         Airport* airport = args->airport;
         free(args);
+        parse_messages_airport(airport, streamRead, streamWrite);
+    }
 
-        // create comm streams 
-        int connectionFD2 = dup(connectionFD);
-        FILE* streamWrite = fdopen(connectionFD, "w");
-        FILE* streamRead = fdopen(connectionFD2, "r");
+    // connection terminated
+    line_reader_free(streamRead);
+    line_writer_free(streamWrite);
+    capture_close(capture);
+    close(connectionFD);
+    __atomic_sub_fetch(&activeConnections, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
 
-        parse_messages_airport(airport, streamRead, streamWrite);
+/**
+ * @brief  (AIRPORT) runs process_thread on a green thread
+ * @param  passArgs: pointer to ProcessThreadArgs
+ * @retval None
+ */
+void process_green(void* passArgs) {
+    process_thread(passArgs);
+}
 
-        // connection terminated
-        fclose(streamRead);
-        fclose(streamWrite);
+/**
+ * @brief  (MAPPER or AIRPORT) number of connections still being served
+ * @note   ~ subscribers are left out, they only end when their peer goes
+ * @retval count of running connection threads
+ */
+int connection_active_count() {
+    return __atomic_load_n(&activeConnections, __ATOMIC_SEQ_CST) 
+            - __atomic_load_n(&activeSubscribers, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief  (MAPPER or AIRPORT) sets the admission limits
+ * @param  connections: most connections served at once, more get busy
+ * @param  expensive: most @ or log dumps sent at once, more get busy
+ * @retval None
+ */
+void connection_set_limits(int connections, int expensive) {
+    maxConnections = connections;
+    maxExpensive = expensive;
+}
+
+/**
+ * @brief  (MAPPER or AIRPORT) counts a new connection, or turns it away 
+ * with the busy reply if maxConnections are already being served
+ * @note   runs on the accepting thread so it never blocks: the reply is 
+ * sent without waiting and the connection closed
+ * @param  connectionFD: file descriptor for established connection
+ * @retval true if the connection should be served, otherwise false
+ */
+bool connection_admit(int connectionFD) {
+    if (__atomic_add_fetch(&activeConnections, 1, __ATOMIC_SEQ_CST) 
+            > maxConnections) {
+        __atomic_sub_fetch(&activeConnections, 1, __ATOMIC_SEQ_CST);
+        send(connectionFD, BUSY_REPLY, strlen(BUSY_REPLY), 
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+        close(connectionFD);
+        return false;
     }
-    return NULL;
+    return true;
 }
 
 /**
@@ -293,6 +908,9 @@ void* process_thread(void* passArgs) {
  * @retval None
  */
 void handle_connection(Mapper* mapping, int connectionFD) {
+    if (!connection_admit(connectionFD)) {
+        return;
+    }
     // create thread to handle connection
     pthread_t tid;
     ProcessThreadArgs* args = (ProcessThreadArgs*)
@@ -300,6 +918,7 @@ void handle_connection(Mapper* mapping, int connectionFD) {
     args->connectionFD = connectionFD;
     args->mapping = mapping;
     args->decide = true;
+    args->acceptTime = trace_now();
     pthread_create(&tid, NULL, process_thread, args);
 
     // its resources are auto released back to the system without the need 
@@ -315,6 +934,9 @@ void handle_connection(Mapper* mapping, int connectionFD) {
  * @retval None
  */
 void handle_connection_airport(Airport* airport, int connectionFD) {
+    if (!connection_admit(connectionFD)) {
+        return;
+    }
     // create thread to handle connection
     pthread_t tid;
     ProcessThreadArgs* args = (ProcessThreadArgs*)
@@ -322,35 +944,385 @@ void handle_connection_airport(Airport* airport, int connectionFD) {
     args->connectionFD = connectionFD;
     args->airport = airport;
     args->decide = false;
+    args->acceptTime = trace_now();
+    if (green_enabled()) {
+        // the worker sleeps the green thread instead of blocking on it
+        fcntl(connectionFD, F_SETFL, 
+                fcntl(connectionFD, F_GETFL) | O_NONBLOCK);
+        if (!green_spawn(process_green, args)) {
+            free(args);
+            close(connectionFD);
+            __atomic_sub_fetch(&activeConnections, 1, __ATOMIC_SEQ_CST);
+        }
+        return;
+    }
     pthread_create(&tid, NULL, process_thread, args);
 
     pthread_detach(tid);
 }
 
+/**
+ * @brief  (AIRPORT) tags a uring submission with its connection
+ * @param  connection: the connection, NULL for the listening socket
+ * @param  operation: what the submission does
+ * @retval the user_data
+ */
+static uint64_t uring_tag(UringConnection* connection, 
+        UringOperation operation) {
+    return (uint64_t)(uintptr_t)connection | operation;
+}
+
+/**
+ * @brief  (AIRPORT) accepts connections until the accept is cancelled
+ * @param  ring: the ring
+ * @param  listenSocket: the command port socket
+ * @retval None
+ */
+static void uring_arm_accept(Uring* ring, int listenSocket) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = uring_tag(NULL, URING_ACCEPT);
+}
+
+/**
+ * @brief  (AIRPORT) receives into provided buffers until the peer closes
+ * @param  ring: the ring
+ * @param  connection: the connection to receive on
+ * @retval None
+ */
+static void uring_arm_recv(Uring* ring, UringConnection* connection) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->connectionFD;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = uring_tag(connection, URING_RECV);
+    connection->receiving = true;
+}
+
+/**
+ * @brief  (AIRPORT) submits a close of the connection
+ * @param  ring: the ring
+ * @param  connection: the connection to close
+ * @retval None
+ */
+static void uring_submit_close(Uring* ring, UringConnection* connection) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = connection->connectionFD;
+    sqe->user_data = uring_tag(connection, URING_CLOSE);
+    connection->closeSubmitted = true;
+}
+
+/**
+ * @brief  (AIRPORT) sends the replies written so far if no send is in 
+ * flight. A finishing connection gets its last send linked to the close.
+ * @param  ring: the ring
+ * @param  connection: the connection to send on
+ * @retval None
+ */
+static void uring_flush(Uring* ring, UringConnection* connection) {
+    if (connection->sending != NULL || connection->closeSubmitted) {
+        return; // the send completion flushes again
+    }
+    connection->sending = line_writer_take(connection->output, 
+            &connection->sendingLength);
+    connection->sendingOffset = 0;
+    if (connection->sending != NULL) {
+        struct io_uring_sqe* sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = connection->connectionFD;
+        sqe->addr = (uintptr_t)connection->sending;
+        sqe->len = connection->sendingLength;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = uring_tag(connection, URING_SEND);
+        if (connection->finishing) {
+            // one shot: the kernel sends it all, then closes
+            sqe->msg_flags |= MSG_WAITALL;
+            sqe->flags = IOSQE_IO_LINK;
+            uring_submit_close(ring, connection);
+        }
+    } else if (connection->finishing) {
+        uring_submit_close(ring, connection);
+    }
+}
+
+/**
+ * @brief  (AIRPORT) stops taking requests on the connection and closes it 
+ * once the replies are sent
+ * @param  ring: the ring
+ * @param  connection: the connection to finish
+ * @retval None
+ */
+static void uring_finish(Uring* ring, UringConnection* connection) {
+    if (connection->finishing) {
+        return;
+    }
+    connection->finishing = true;
+    if (connection->receiving) {
+        // the armed recv holds the socket open, close would not end it
+        struct io_uring_sqe* sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = uring_tag(connection, URING_RECV);
+        sqe->user_data = uring_tag(NULL, URING_CANCEL);
+    }
+    uring_flush(ring, connection);
+}
+
+/**
+ * @brief  (AIRPORT) actions every complete line received so far
+ * @param  ring: the ring
+ * @param  connection: the connection the bytes came from
+ * @param  data: the received bytes
+ * @param  length: number of bytes
+ * @retval None
+ */
+static void uring_take_input(Uring* ring, UringConnection* connection, 
+        const char* data, size_t length) {
+    if (connection->inputLength + length + 1 > connection->inputCapacity) {
+        connection->inputCapacity = connection->inputLength + length + 1;
+        connection->input = (char*)realloc(connection->input, 
+                connection->inputCapacity);
+    }
+    memcpy(connection->input + connection->inputLength, data, length);
+    connection->inputLength += length;
+    capture_input(connection->capture, data, length);
+
+    size_t start = 0;
+    char* newline;
+    trace_connection(connection->connectionFD, connection->acceptTime);
+    while (!connection->finishing && (newline = memchr(connection->input 
+            + start, '\n', connection->inputLength - start)) != NULL) {
+        StringView line = {connection->input + start, 
+                newline - (connection->input + start), true};
+        newline[0] = '\0';
+        start += line.length + 1;
+        if (connection->dropping) {
+            connection->dropping = false; // end of the too long line
+            connection->session.started = true;
+        } else if (parse_message_airport(&connection->session, &line, 
+                connection->output)) {
+            uring_finish(ring, connection);
+        }
+    }
+    connection->inputLength -= start;
+    memmove(connection->input, connection->input + start, 
+            connection->inputLength);
+    if (connection->inputLength > MAX_LINE_SIZE) {
+        connection->dropping = true; // never split it into two commands
+        connection->inputLength = 0;
+    }
+}
+
+/**
+ * @brief  (AIRPORT) handles the end of the peer's requests: actions a 
+ * last line without '\n' and finishes the connection
+ * @param  ring: the ring
+ * @param  connection: the connection which reached EOF
+ * @retval None
+ */
+static void uring_take_eof(Uring* ring, UringConnection* connection) {
+    if (!connection->finishing && !connection->dropping 
+            && connection->inputLength > 0) {
+        connection->input[connection->inputLength] = '\0';
+        StringView line = {connection->input, connection->inputLength, 
+                false};
+        trace_connection(connection->connectionFD, connection->acceptTime);
+        parse_message_airport(&connection->session, &line, 
+                connection->output);
+    }
+    uring_finish(ring, connection);
+}
+
+/**
+ * @brief  (AIRPORT) frees the connection once nothing is in flight on it
+ * @param  connection: the connection
+ * @retval None
+ */
+static void uring_release(UringConnection* connection) {
+    if (!connection->closed || connection->receiving 
+            || connection->sending != NULL) {
+        return;
+    }
+    line_writer_free(connection->output);
+    capture_close(connection->capture);
+    free(connection->input);
+    free(connection);
+    __atomic_sub_fetch(&activeConnections, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief  (AIRPORT) handles one completion of serve_airport_uring()
+ * @param  airport: the local airport
+ * @param  ring: the ring
+ * @param  listenSocket: the command port socket
+ * @param  cqe: a copy of the completion
+ * @retval None
+ */
+static void uring_complete(Airport* airport, Uring* ring, int listenSocket, 
+        struct io_uring_cqe* cqe) {
+    UringConnection* connection = (UringConnection*)(uintptr_t)
+            (cqe->user_data & ~(uint64_t)URING_OPERATION_MASK);
+    switch (cqe->user_data & URING_OPERATION_MASK) {
+        case URING_ACCEPT:
+            if (cqe->res >= 0 && connection_admit(cqe->res)) {
+                connection = (UringConnection*)
+                        calloc(1, sizeof(UringConnection));
+                connection->connectionFD = cqe->res;
+                connection->acceptTime = trace_now();
+                connection->session.airport = airport;
+                connection->output = line_writer_create_memory();
+                connection->capture = capture_open();
+                connection->output->capture = connection->capture;
+                uring_arm_recv(ring, connection);
+            }
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                uring_arm_accept(ring, listenSocket);
+            }
+            break;
+        case URING_RECV:
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                unsigned short bufferId = cqe->flags 
+                        >> IORING_CQE_BUFFER_SHIFT;
+                uring_take_input(ring, connection, 
+                        uring_buffer(ring, bufferId), cqe->res);
+                uring_buffer_return(ring, bufferId);
+            }
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                connection->receiving = false;
+                if (cqe->res > 0 || cqe->res == -ENOBUFS) {
+                    if (!connection->finishing) {
+                        uring_arm_recv(ring, connection); // buffers back
+                    }
+                } else {
+                    uring_take_eof(ring, connection);
+                }
+            }
+            uring_flush(ring, connection);
+            break;
+        case URING_SEND:
+            if (cqe->res >= 0 && !connection->closeSubmitted 
+                    && connection->sendingOffset + cqe->res 
+                    < connection->sendingLength) {
+                connection->sendingOffset += cqe->res; // send the rest
+                struct io_uring_sqe* sqe = uring_get_sqe(ring);
+                sqe->opcode = IORING_OP_SEND;
+                sqe->fd = connection->connectionFD;
+                sqe->addr = (uintptr_t)(connection->sending 
+                        + connection->sendingOffset);
+                sqe->len = connection->sendingLength 
+                        - connection->sendingOffset;
+                sqe->msg_flags = MSG_NOSIGNAL;
+                sqe->user_data = uring_tag(connection, URING_SEND);
+                break;
+            }
+            free(connection->sending);
+            connection->sending = NULL;
+            if (cqe->res < 0) {
+                uring_finish(ring, connection); // peer gone
+            }
+            uring_flush(ring, connection);
+            break;
+        case URING_CLOSE:
+            if (cqe->res == -ECANCELED) {
+                uring_submit_close(ring, connection); // linked send failed
+                break;
+            }
+            connection->closed = true;
+            break;
+        default:
+            return; // URING_CANCEL, the recv completion follows
+    }
+    if (connection != NULL) {
+        uring_release(connection);
+    }
+}
+
+/**
+ * @brief  (AIRPORT) serves every connection on this thread with io_uring: 
+ * multishot accept, multishot recv into provided buffers and sends 
+ * linked to the close for connections ending with a log
+ * @note   replies are built in memory by the usual parse functions, so a 
+ * whole log is held until sent
+ * @param  airport: local airport
+ * @param  listenSocket: the listening command port socket
+ * @retval false if io_uring is not available (nothing was accepted), 
+ * otherwise only returns if the ring fails
+ */
+bool serve_airport_uring(Airport* airport, int listenSocket) {
+    Uring* ring = uring_create();
+    if (ring == NULL) {
+        return false;
+    }
+    uring_arm_accept(ring, listenSocket);
+    bool accepted = false;
+    while (uring_submit_and_wait(ring, 1)) {
+        struct io_uring_cqe* next;
+        while ((next = uring_peek_cqe(ring)) != NULL) {
+            struct io_uring_cqe cqe = *next;
+            uring_cqe_seen(ring);
+            if ((cqe.user_data & URING_OPERATION_MASK) == URING_ACCEPT) {
+                if (cqe.res == -EINVAL && !accepted) {
+                    uring_free(ring); // no multishot accept, old kernel
+                    return false;
+                }
+                accepted = true;
+            }
+            uring_complete(airport, ring, listenSocket, &cqe);
+        }
+    }
+    uring_free(ring);
+    return accepted;
+}
+
+/**
+ * @brief  (ROC) checks whether a control refused the airport selected 
+ * with =ID, which a control hosting several airports does with ";" for 
+ * an id it does not host (e.g. its port was reused)
+ * @param  airportId: airport selected, NULL if none was
+ * @param  reply: the first reply line
+ * @param  length: length of the reply line
+ * @retval true if refused, otherwise false
+ */
+bool is_selection_refused(const char* airportId, const char* reply, 
+        size_t length) {
+    return airportId != NULL && length == 1 && reply[0] == ';';
+}
+
 /**
  * @brief  (ROC) creates a new thread to handle all communication to a 
  * established inbound connection on the command port
+ * @param  airportId: airport to select (the port may host many), or NULL 
+ * for the one the port serves by default
  * @param  planeId: plane name
  * @param  connectionFD: file descriptor for established connection
- * @retval None
+ * @retval false if the control does not host airportId, otherwise true
  */
-void handle_connection_plane(const char* planeId, int connectionFD) {
-    int connectionFD2 = dup(connectionFD);
-    FILE* streamWrite = fdopen(connectionFD, "w");
-    FILE* streamRead = fdopen(connectionFD2, "r");
+bool handle_connection_plane(const char* airportId, const char* planeId, 
+        int connectionFD) {
+    LineReader* streamRead = line_reader_create(connectionFD, 
+            MAX_LINE_SIZE);
+    LineWriter* streamWrite = line_writer_create(connectionFD);
 
-    send_message_plane(planeId, streamWrite);
-    char buffer[BUFFER_SIZE];
-    if (fgets(buffer, BUFFER_SIZE, streamRead) != NULL) {
-        printf("%s", buffer);
-        fflush(stdout);
+    send_message_plane(airportId, planeId, streamWrite);
+    StringView line;
+    bool hosted = true;
+    if (line_reader_next(streamRead, &line) == LINE_OK) {
+        hosted = !is_selection_refused(airportId, line.data, line.length);
+        if (hosted) {
+            printf(line.complete ? "%s\n" : "%s", line.data);
+            fflush(stdout);
+        }
     }
-    
 
     // connection terminated
-    fclose(streamRead);
-    fclose(streamWrite);
-    return;
+    line_reader_free(streamRead);
+    line_writer_free(streamWrite);
+    close(connectionFD);
+    return hosted;
 }
 
 /**
@@ -374,9 +1346,26 @@ int connect_to_port(const char* port) {
 
     // connect local port
     int fileDescriptor = socket(AF_INET, SOCK_STREAM, 0);
-    if (connect(fileDescriptor, (struct sockaddr*)addressInfo->ai_addr,
-            sizeof(struct sockaddr))) {
+    int connectError = connect(fileDescriptor, 
+            (struct sockaddr*)addressInfo->ai_addr, sizeof(struct sockaddr));
+    freeaddrinfo(addressInfo);
+    if (connectError) {
+        close(fileDescriptor); // retried by heartbeats, do not leak it
         return -1;
     }
     return fileDescriptor;
-}
\ No newline at end of file
+}
+/**
+ * @brief  bounds how long a read of a blocking socket waits, a read that 
+ * times out fails with EAGAIN
+ * @param  fileDescriptor: the socket
+ * @param  milliseconds: the bound, 0 to wait forever again
+ * @retval None
+ */
+void set_read_timeout(int fileDescriptor, long milliseconds) {
+    struct timeval timeout;
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = milliseconds % 1000 * 1000;
+    setsockopt(fileDescriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, 
+            sizeof(struct timeval));
+}
@@ -2,13 +2,38 @@
 #define CONNECTION_HANDLER_H_
 #include <stdbool.h>
 #include "shared.h"
+#include "lineStream.h"
+
+#define MAX_LINE_SIZE 65536 // longer lines are dropped, never split
+#define MAX_BULK_SIZE 65536 // most ID:PORT pairs in one & message
+#define MAX_COMPLETIONS 1000 // most airports in one % reply
+#define DEFAULT_MAX_CONNECTIONS 1024 // connections served at once
+#define DEFAULT_MAX_EXPENSIVE 4 // @ or log dumps sent at once
+#define MAX_CONNECTION_LIMIT 1048576 // largest -c or -e accepted
+#define BUSY_REPLY "BUSY\n" // sent instead of serving when over a limit
+#define PORT_QUESTION_TIMEOUT_MS 1000 // a mapper without $PORT never replies
 
 void handle_connection(Mapper* mapping, int connectionFD);
 
 void handle_connection_airport(Airport* airport, int connectionFD);
 
-void handle_connection_plane(const char* planeId, int connectionFD);
+bool serve_airport_uring(Airport* airport, int listenSocket);
+
+void send_message_plane(const char* airportId, const char* planeId, 
+        LineWriter* streamWrite);
+
+bool is_selection_refused(const char* airportId, const char* reply, 
+        size_t length);
+
+bool handle_connection_plane(const char* airportId, const char* planeId, 
+        int connectionFD);
 
 int connect_to_port(const char* port);
 
+void set_read_timeout(int fileDescriptor, long milliseconds);
+
+int connection_active_count();
+
+void connection_set_limits(int connections, int expensive);
+
 #endif
\ No newline at end of file
@@ -8,6 +8,10 @@
 #include <string.h>
 #include "shared.h"
 #include "connectionHandler.h"
+#include "trace.h"
+#include "latency.h"
+#include "journal.h"
+#include "green.h"
 
 #define BUFFER_SIZE 79
 #define LISTEN 15
@@ -22,9 +26,35 @@ typedef enum {
     WRONG_ARG_NUMBER = 1,
     INVALID_CHAR = 2,
     INVALID_PORT = 3,
-    UNABLE_TO_CONNECT = 4
+    UNABLE_TO_CONNECT = 4,
+    UNABLE_TO_LISTEN = 5,
+    INVALID_JOURNAL = 6,
+    DUPLICATE_AIRPORT = 7,
+    INVALID_CAPTURE = 8
 } Status;
 
+/* optional settings given as -x value before the positional arguments */
+typedef struct {
+    const char* journalPath; // -j: visit journal, NULL if none
+    long maxConnections; // -c: connections served at once
+    long maxExpensive; // -e: log dumps sent at once
+    const char* tracePath; // -t: SIGUSR1 trace dump file, or NULL
+    const char* capturePath; // -r: traffic capture file, or NULL
+    long leaseSeconds; // -l: mapper registration ttl, 0 for none
+    long greenWorkers; // -g: serve planes on green threads, 0 for off
+    bool useUring; // -b uring: serve planes with io_uring if available
+    bool exact; // -s exact|sketch|both: planes kept in the trie
+    bool sketch; // visits also counted in a sketch
+    const char** hosted; // -a ID:INFO, more airports behind the same port
+    int hostedCount;
+} ControlOptions;
+
+// Used to pass arguments to bind_and_listen()
+typedef struct {
+    Airport* airport;
+    bool useUring;
+} ListenArgs;
+
 /** 
  * Output error message for status and return status
  *	- Returns nothing
@@ -36,34 +66,180 @@ Status exit_message(Status status) {
             "Usage: control2310 id info [mapper]\n", //1
             "Invalid char in parameter\n", //2
             "Invalid port\n", //3
-            "Can not connect to map\n"}; //4
+            "Can not connect to map\n", //4
+            "", //5 (listen failed, silent)
+            "Can not open journal\n", //6
+            "Duplicate airport\n", //7
+            "Can not open capture\n"}; //8
     fputs(messages[status], stderr);
     return status;
 }
 
+/**
+ * @brief  consumes the leading -x value options
+ * @param  argc: argument count
+ * @param  argv: run arguments
+ * @param  options: filled with the given options (others left default)
+ * @retval number of arguments consumed, -1 if an option is unknown
+ */
+int parse_options(int argc, char const* argv[], ControlOptions* options) {
+    int consumed = 0;
+    options->journalPath = NULL;
+    options->tracePath = NULL;
+    options->capturePath = NULL;
+    options->maxConnections = DEFAULT_MAX_CONNECTIONS;
+    options->maxExpensive = DEFAULT_MAX_EXPENSIVE;
+    options->leaseSeconds = 0;
+    options->greenWorkers = 0;
+    options->useUring = false;
+    options->exact = true;
+    options->sketch = false;
+    options->hosted = (const char**)malloc(sizeof(const char*) * argc);
+    options->hostedCount = 0;
+    while (consumed + 2 < argc && argv[consumed + 1][0] == '-') {
+        const char* option = argv[consumed + 1];
+        const char* value = argv[consumed + 2];
+        if (!strcmp(option, "-j")) {
+            options->journalPath = value;
+        } else if (!strcmp(option, "-t")) {
+            options->tracePath = value;
+        } else if (!strcmp(option, "-r")) {
+            options->capturePath = value;
+        } else if (!strcmp(option, "-c")) {
+            options->maxConnections = parse_positive_number(value);
+        } else if (!strcmp(option, "-e")) {
+            options->maxExpensive = parse_positive_number(value);
+        } else if (!strcmp(option, "-l")) {
+            options->leaseSeconds = parse_positive_number(value);
+        } else if (!strcmp(option, "-g")) {
+            options->greenWorkers = parse_positive_number(value);
+        } else if (!strcmp(option, "-b") && (!strcmp(value, "uring") 
+                || !strcmp(value, "threads"))) {
+            options->useUring = !strcmp(value, "uring");
+        } else if (!strcmp(option, "-s") && (!strcmp(value, "exact") 
+                || !strcmp(value, "sketch") || !strcmp(value, "both"))) {
+            options->exact = strcmp(value, "sketch");
+            options->sketch = strcmp(value, "exact");
+        } else if (!strcmp(option, "-a")) {
+            options->hosted[options->hostedCount++] = value;
+        } else {
+            return -1;
+        }
+        consumed += 2;
+    }
+    if (options->maxConnections < 0 || options->maxExpensive < 0 
+            || options->leaseSeconds < 0 || options->greenWorkers < 0) {
+        return -1; // not a positive limit
+    }
+    if (options->maxConnections > MAX_CONNECTION_LIMIT 
+            || options->maxExpensive > MAX_CONNECTION_LIMIT) {
+        return -1; // would not fit the connection counters
+    }
+    if (!options->exact && options->journalPath != NULL) {
+        return -1; // a sketch keeps no visits to journal
+    }
+    return consumed;
+}
+
+/**
+ * @brief  hosts another airport, given as ID:INFO, behind the port of the 
+ * first one
+ * @param  first: the airport named by the positional arguments
+ * @param  pair: the -a value
+ * @retval NORMAL_OPERATION, or the status to exit with
+ */
+Status host_airport(Airport* first, const char* pair) {
+    char* airportId = strdup(pair);
+    char* airportInfo = strchr(airportId, ':');
+    if (airportInfo == NULL) {
+        return WRONG_ARG_NUMBER;
+    }
+    *airportInfo++ = '\0';
+    if (!is_valid_name(airportId) || !is_valid_name(airportInfo)) {
+        return INVALID_CHAR;
+    }
+    Airport* airport = airport_create();
+    airport->airportId = airportId;
+    airport->airportInfo = airportInfo;
+    airport->fileDescriptor = 0;
+    if (!airport_host(first, airport)) {
+        return DUPLICATE_AIRPORT;
+    }
+    return NORMAL_OPERATION;
+}
+
 /**
  * @brief  a pop up function use specially to send mapper message 
- * @note   only run if has mapper: !..:..
+ * @note   only run if has mapper: !..:.. (or !..:..:ttl with a lease) for 
+ * each hosted airport
  * @param  airport: a reference to the airport  
  */
 void load_mapper_infor(Airport* airport) {
-    FILE* streamWrite = fdopen(airport->fileDescriptor, "w");
-    fprintf(streamWrite, "!%s:%d\n", airport->airportId, airport->port);
-    fflush(streamWrite);
+    LineWriter* streamWrite = line_writer_create(airport->fileDescriptor);
+    Airport* hosted;
+    for (int i = 0; (hosted = airport_hosted(airport, i)) != NULL; i++) {
+        if (hosted->leaseSeconds > 0) {
+            line_writer_printf(streamWrite, "!%s:%d:%ld\n", 
+                    hosted->airportId, hosted->port, hosted->leaseSeconds);
+        } else {
+            line_writer_printf(streamWrite, "!%s:%d\n", hosted->airportId, 
+                    hosted->port);
+        }
+    }
     // connection terminated
-    fclose(streamWrite);
+    line_writer_free(streamWrite);
+    close(airport->fileDescriptor);
+}
+
+/**
+ * @brief  renews the mapper registrations LEASE_RENEWALS times per lease 
+ * so the mapper drops it soon after this control dies
+ * @note   each renewal is a short connection, a mapper which is down or 
+ * restarting is simply tried again next time (and re-registers the 
+ * airport if the lease ran out meanwhile)
+ * @param  passArg: a reference to the airport
+ * @retval never returns
+ */
+void* heartbeat_thread(void* passArg) {
+    Airport* airport = (Airport*)passArg;
+    long interval = airport->leaseSeconds / LEASE_RENEWALS;
+    if (interval < 1) {
+        interval = 1;
+    }
+    while (true) {
+        sleep(interval);
+        uint16_t port = __atomic_load_n(&airport->port, __ATOMIC_ACQUIRE);
+        if (port == 0) {
+            continue; // not listening yet
+        }
+        int mapperFD = connect_to_port(airport->mapperPort);
+        if (mapperFD < 0) {
+            continue;
+        }
+        LineWriter* streamWrite = line_writer_create(mapperFD);
+        Airport* hosted;
+        for (int i = 0; (hosted = airport_hosted(airport, i)) != NULL; i++) {
+            line_writer_printf(streamWrite, "^%s:%d:%ld\n", 
+                    hosted->airportId, port, hosted->leaseSeconds);
+        }
+        line_writer_free(streamWrite);
+        close(mapperFD);
+    }
+    return NULL;
 }
 
 /**
  * @brief  Binds to an unspecified port 
  * prints the port number 
- * and spawns new threads to deal every incomming connection
+ * and spawns new threads to deal every incomming connection (or serves 
+ * them all with io_uring)
  * @note   if any error occurs (listen or bind), code exits with 5.
  * must return a void* and take a void* argument
- * @param  passArg: a reference to the local map  
+ * @param  passArg: a reference to ListenArgs
  */
 void* bind_and_listen(void* passArg) {
-    Airport* airport = (Airport*)passArg;
+    ListenArgs* args = (ListenArgs*)passArg;
+    Airport* airport = args->airport;
     struct addrinfo* addressInfo = NULL; // get local address info
     struct addrinfo hints;
     memset(&hints, 0, sizeof(struct addrinfo));
@@ -95,7 +271,10 @@ void* bind_and_listen(void* passArg) {
     uint16_t port = ntohs(serverAddr.sin_port);
     printf("%u\n", port);
     fflush(stdout);
-    airport->port = port;
+    Airport* hosted;
+    for (int i = 0; (hosted = airport_hosted(airport, i)) != NULL; i++) {
+        __atomic_store_n(&hosted->port, port, __ATOMIC_RELEASE);
+    }
     if (airport->fileDescriptor != 0) {
         load_mapper_infor(airport);
     }
@@ -105,6 +284,9 @@ void* bind_and_listen(void* passArg) {
     if (listen(localSocket, LISTEN)) {    
         exit(5);
     }
+    if (args->useUring && serve_airport_uring(airport, localSocket)) {
+        return NULL;
+    } // otherwise io_uring is not available, use a thread per connection
 
     // spawn a thread to handle each incomming connection
     while (connectionFD = accept(localSocket, 0, 0), 
@@ -115,6 +297,13 @@ void* bind_and_listen(void* passArg) {
 }
 
 int main(int argc, char const* argv[]) {
+    ControlOptions options;
+    int consumed = parse_options(argc, argv, &options);
+    if (consumed < 0) {
+        return exit_message(WRONG_ARG_NUMBER);
+    }
+    argc -= consumed;
+    argv += consumed; // argv[0] is now the last option value, never used
     if (argc < MINIM_ARGS || argc > MAXIM_ARGS) {  // mapper is optional
         return exit_message(WRONG_ARG_NUMBER);
     }
@@ -130,6 +319,25 @@ int main(int argc, char const* argv[]) {
             || !is_valid_name(airport->airportInfo)) {
         return exit_message(INVALID_CHAR);
     }
+    for (int i = 0; i < options.hostedCount; i++) {
+        Status status = host_airport(airport, options.hosted[i]);
+        if (status != NORMAL_OPERATION) {
+            return exit_message(status);
+        }
+    }
+    Airport* hosted;
+    // a port hosting several airports refuses a selection with ";", so no 
+    // airport behind it may have that as its info
+    for (int i = 0; options.hostedCount > 0 
+            && (hosted = airport_hosted(airport, i)) != NULL; i++) {
+        if (!strcmp(hosted->airportInfo, ";")) {
+            return exit_message(INVALID_CHAR);
+        }
+    }
+    for (int i = 0; (hosted = airport_hosted(airport, i)) != NULL; i++) {
+        hosted->exact = options.exact;
+        hosted->sketch = options.sketch ? sketch_create() : NULL;
+    }
 
     // load Mapper (optional)
     if (argc == MAXIM_ARGS) {   
@@ -140,6 +348,11 @@ int main(int argc, char const* argv[]) {
             return exit_message(INVALID_PORT);
         }
         airport->fileDescriptor = connect_to_port(argv[3]); 
+        for (int i = 0; (hosted = airport_hosted(airport, i)) != NULL; 
+                i++) {
+            hosted->mapperPort = argv[3];
+            hosted->leaseSeconds = options.leaseSeconds;
+        }
         if (airport->fileDescriptor == -1) {
             return exit_message(UNABLE_TO_CONNECT);
         }
@@ -150,11 +363,49 @@ int main(int argc, char const* argv[]) {
     sigemptyset(&set);
     sigaddset(&set, SIGHUP);
     sigaddset(&set, SIGPIPE);
+    sigaddset(&set, SIGUSR1); // only the trace thread takes it
+    sigaddset(&set, SIGINT); // only the latency thread takes these
+    sigaddset(&set, SIGTERM);
     pthread_sigmask(SIG_BLOCK, &set, NULL);    
+    trace_start(options.tracePath, "control2310");
+    latency_start();
+    if (options.capturePath != NULL && !capture_start(options.capturePath)) {
+        return exit_message(INVALID_CAPTURE);
+    }
+
+    // rebuild the visit logs before any plane can connect, each hosted 
+    // airport keeps its own journal next to the first one's
+    for (int i = 0; options.journalPath != NULL 
+            && (hosted = airport_hosted(airport, i)) != NULL; i++) {
+        char path[strlen(options.journalPath) 
+                + strlen(hosted->airportId) + 2];
+        snprintf(path, sizeof(path), i == 0 ? "%s" : "%s.%s", 
+                options.journalPath, hosted->airportId);
+        if (journal_open(hosted, path) == NULL) {
+            return exit_message(INVALID_JOURNAL);
+        }
+    }
+    
+    connection_set_limits(options.maxConnections, options.maxExpensive);
+    if (options.greenWorkers > 0 && !green_start(options.greenWorkers)) {
+        return exit_message(UNABLE_TO_LISTEN);
+    }
+    for (int i = 0; (hosted = airport_hosted(airport, i)) != NULL; i++) {
+        trie_start_compactor(hosted->planeRootTrieNode, hosted->semaphore, 
+                &hosted->trieChanges);
+    }
 
     // create connection handling thread
+    ListenArgs* args = (ListenArgs*)malloc(sizeof(ListenArgs));
+    args->airport = airport;
+    args->useUring = options.useUring;
     pthread_t tid;
-    pthread_create(&tid, NULL, bind_and_listen, airport); 
+    pthread_create(&tid, NULL, bind_and_listen, args); 
+    if (airport->leaseSeconds > 0) {
+        pthread_t heartbeatTid;
+        pthread_create(&heartbeatTid, NULL, heartbeat_thread, airport);
+        pthread_detach(heartbeatTid);
+    }
 
     // wait till EOF
     char buffer[BUFFER_SIZE];
@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "encoding.h"
+
+#define LZ_HASH_BITS 12 // positions remembered by the match finder
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // a block ends with at least this many literals
+#define LZ_MATCH_LIMIT 12 // no match starts this close to the end
+#define LZ_MAX_OFFSET 65535
+
+static const char* kindNames[] = {"plain", "rle", "front"};
+
+/**
+ * @brief  parses an encoding a client asked for: plain, rle or front,
+ * optionally followed by +lz (or just lz)
+ * @param  text: the encoding
+ * @param  encoding: set to the encoding
+ * @retval true if known, otherwise false
+ */
+bool encoding_parse(const char* text, Encoding* encoding) {
+    encoding->kind = ENCODING_PLAIN;
+    encoding->compress = false;
+    size_t length = strcspn(text, "+");
+    bool known = false;
+    for (int kind = ENCODING_PLAIN; kind <= ENCODING_FRONT; kind++) {
+        if (strlen(kindNames[kind]) == length
+                && !strncmp(text, kindNames[kind], length)) {
+            encoding->kind = (EncodingKind)kind;
+            known = true;
+        }
+    }
+    if (!known || text[length] == '+') {
+        const char* rest = known ? text + length + 1 : text;
+        if (strcmp(rest, "lz")) {
+            return false;
+        }
+        encoding->compress = true;
+    }
+    return true;
+}
+
+/**
+ * @brief  gets the name a reply is headed with, e.g. "front+lz"
+ * @param  encoding: the encoding
+ * @param  name: filled with the name
+ * @retval None
+ */
+void encoding_name(Encoding encoding, char name[ENCODING_NAME_SIZE]) {
+    snprintf(name, ENCODING_NAME_SIZE, "%s%s", kindNames[encoding.kind],
+            encoding.compress ? "+lz" : "");
+}
+
+/**
+ * @brief  starts a dump
+ * @param  encoding: how to write it
+ * @param  streamWrite: place to write
+ * @retval newly created encoder
+ */
+Encoder* encoder_create(Encoding encoding, LineWriter* streamWrite) {
+    Encoder* encoder = (Encoder*)malloc(sizeof(Encoder));
+    encoder->streamWrite = streamWrite;
+    encoder->encoding = encoding;
+    encoder->previous = NULL;
+    encoder->previousLength = 0;
+    encoder->previousCapacity = 0;
+    encoder->block = encoding.compress
+            ? (char*)malloc(ENCODING_BLOCK_SIZE) : NULL;
+    encoder->blockLength = 0;
+    return encoder;
+}
+
+/**
+ * @brief  compresses and sends the lines waiting in the block
+ * @param  encoder: the encoder
+ * @retval None
+ */
+static void encoder_flush_block(Encoder* encoder) {
+    if (encoder->blockLength == 0) {
+        return;
+    }
+    char* compressed = (char*)malloc(lz_bound(encoder->blockLength));
+    size_t length = lz_compress(encoder->block, encoder->blockLength,
+            compressed);
+    line_writer_printf(encoder->streamWrite, "*%zu %zu\n", length,
+            encoder->blockLength);
+    line_writer_write(encoder->streamWrite, compressed, length);
+    free(compressed);
+    encoder->blockLength = 0;
+}
+
+/**
+ * @brief  writes encoded bytes, through the block with lz
+ * @param  encoder: the encoder
+ * @param  data: the bytes
+ * @param  length: number of bytes
+ * @retval None
+ */
+static void encoder_emit(Encoder* encoder, const char* data, size_t length) {
+    if (encoder->block == NULL) {
+        line_writer_write(encoder->streamWrite, data, length);
+        return;
+    }
+    while (length > 0) {
+        size_t room = ENCODING_BLOCK_SIZE - encoder->blockLength;
+        size_t taken = length < room ? length : room;
+        memcpy(encoder->block + encoder->blockLength, data, taken);
+        encoder->blockLength += taken;
+        data += taken;
+        length -= taken;
+        if (encoder->blockLength == ENCODING_BLOCK_SIZE) {
+            encoder_flush_block(encoder);
+        }
+    }
+}
+
+/**
+ * @brief  writes one line of a dump
+ * @param  encoder: the encoder
+ * @param  text: the line, without '\n'
+ * @param  length: chars in text
+ * @param  repeat: times the line occurs (plain writes it that many
+ * times), 0 for a line which is not counted like an ID:PORT
+ * @retval None
+ */
+void encoder_line(Encoder* encoder, const char* text, size_t length,
+        long repeat) {
+    char number[32];
+    if (encoder->encoding.kind == ENCODING_PLAIN) {
+        for (long i = 0; i < (repeat > 0 ? repeat : 1); i++) {
+            encoder_emit(encoder, text, length);
+            encoder_emit(encoder, "\n", 1);
+        }
+        return;
+    }
+    if (encoder->encoding.kind == ENCODING_FRONT) {
+        size_t shared = 0;
+        while (shared < length && shared < encoder->previousLength
+                && text[shared] == encoder->previous[shared]) {
+            shared++;
+        }
+        if (length + 1 > encoder->previousCapacity) {
+            encoder->previousCapacity = length + 1;
+            encoder->previous = (char*)realloc(encoder->previous,
+                    encoder->previousCapacity);
+        }
+        memcpy(encoder->previous + shared, text + shared, length - shared);
+        encoder->previousLength = length;
+        encoder_emit(encoder, number, snprintf(number, sizeof(number),
+                "%zu:", shared));
+        text += shared;
+        length -= shared;
+    }
+    encoder_emit(encoder, text, length);
+    if (repeat > 0) {
+        encoder_emit(encoder, number, snprintf(number, sizeof(number),
+                " x%ld", repeat));
+    }
+    encoder_emit(encoder, "\n", 1);
+}
+
+/**
+ * @brief  ends a dump, sending the last block
+ * @param  encoder: the encoder to free
+ * @retval None
+ */
+void encoder_free(Encoder* encoder) {
+    if (encoder->block != NULL) {
+        encoder_flush_block(encoder);
+        free(encoder->block);
+    }
+    free(encoder->previous);
+    free(encoder);
+}
+
+/**
+ * @brief  gets the most bytes lz_compress may write
+ * @param  length: bytes to compress
+ * @retval the size of the destination to give lz_compress
+ */
+size_t lz_bound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+/**
+ * @brief  writes the rest of a length which did not fit in its token
+ * @param  output: place to write
+ * @param  length: what is left of the length
+ * @retval one past the last byte written
+ */
+static unsigned char* lz_write_length(unsigned char* output, size_t length) {
+    while (length >= 255) {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = (unsigned char)length;
+    return output;
+}
+
+/**
+ * @brief  writes one LZ4 sequence: literals then (unless last) a match
+ * @param  output: place to write
+ * @param  literals: the literal bytes
+ * @param  literalLength: number of literal bytes
+ * @param  offset: distance back to the match, 0 for the last sequence
+ * @param  matchLength: length of the match
+ * @retval one past the last byte written
+ */
+static unsigned char* lz_sequence(unsigned char* output,
+        const unsigned char* literals, size_t literalLength, size_t offset,
+        size_t matchLength) {
+    unsigned char* token = output++;
+    *token = (literalLength < 15 ? literalLength : 15) << 4;
+    if (literalLength >= 15) {
+        output = lz_write_length(output, literalLength - 15);
+    }
+    memcpy(output, literals, literalLength);
+    output += literalLength;
+    if (offset == 0) {
+        return output;
+    }
+    *output++ = offset & 0xff;
+    *output++ = offset >> 8;
+    size_t extra = matchLength - LZ_MIN_MATCH;
+    *token |= extra < 15 ? extra : 15;
+    if (extra >= 15) {
+        output = lz_write_length(output, extra - 15);
+    }
+    return output;
+}
+
+/**
+ * @brief  reads 4 bytes from any alignment
+ * @param  data: the bytes
+ * @retval the bytes as a number
+ */
+static uint32_t lz_read32(const unsigned char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief  compresses bytes into an LZ4 block (any LZ4 block decoder reads
+ * it), using a single hash probe per position
+ * @param  source: the bytes
+ * @param  length: number of bytes
+ * @param  destination: lz_bound(length) bytes
+ * @retval compressed size
+ */
+size_t lz_compress(const char* source, size_t length, char* destination) {
+    const unsigned char* input = (const unsigned char*)source;
+    unsigned char* output = (unsigned char*)destination;
+    long table[1 << LZ_HASH_BITS];
+    memset(table, 0xff, sizeof(table)); // -1, no position yet
+    size_t anchor = 0; // first byte not yet written
+    size_t position = 0;
+    while (length > LZ_MATCH_LIMIT && position < length - LZ_MATCH_LIMIT) {
+        uint32_t sequence = lz_read32(input + position);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        long candidate = table[hash];
+        table[hash] = position;
+        if (candidate < 0 || position - candidate > LZ_MAX_OFFSET
+                || lz_read32(input + candidate) != sequence) {
+            position++;
+            continue;
+        }
+        size_t matchLength = LZ_MIN_MATCH;
+        while (position + matchLength < length - LZ_LAST_LITERALS
+                && input[candidate + matchLength]
+                == input[position + matchLength]) {
+            matchLength++;
+        }
+        output = lz_sequence(output, input + anchor, position - anchor,
+                position - candidate, matchLength);
+        position += matchLength;
+        anchor = position;
+    }
+    output = lz_sequence(output, input + anchor, length - anchor, 0, 0);
+    return output - (unsigned char*)destination;
+}
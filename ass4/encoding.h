@@ -0,0 +1,49 @@
+#ifndef ENCODING_H_
+#define ENCODING_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include "lineStream.h"
+
+#define ENCODING_BLOCK_SIZE 65536 // raw bytes per compressed block
+#define ENCODING_NAME_SIZE 16 // longest name from encoding_name, plus '\0'
+
+/* how the lines of a dump are written */
+typedef enum {
+    ENCODING_PLAIN = 0, // as before, a plane once per visit
+    ENCODING_RLE = 1, // a plane once, "NAME xVISITS"
+    ENCODING_FRONT = 2 // as rle, "SHARED:REST" after the previous line
+} EncodingKind;
+
+/* an encoding a client asked for, e.g. "front+lz" */
+typedef struct {
+    EncodingKind kind;
+    bool compress; // lz: lines sent in LZ4 blocks "*SIZE RAWSIZE\n"
+} Encoding;
+
+/* writes the lines of one dump in an encoding */
+typedef struct {
+    LineWriter* streamWrite;
+    Encoding encoding;
+    char* previous; // last line written, for front coding
+    size_t previousLength;
+    size_t previousCapacity;
+    char* block; // lines waiting to be compressed, NULL without lz
+    size_t blockLength;
+} Encoder;
+
+bool encoding_parse(const char* text, Encoding* encoding);
+
+void encoding_name(Encoding encoding, char name[ENCODING_NAME_SIZE]);
+
+Encoder* encoder_create(Encoding encoding, LineWriter* streamWrite);
+
+void encoder_line(Encoder* encoder, const char* text, size_t length,
+        long repeat);
+
+void encoder_free(Encoder* encoder);
+
+size_t lz_compress(const char* source, size_t length, char* destination);
+
+size_t lz_bound(size_t length);
+
+#endif
@@ -0,0 +1,440 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "fleet.h"
+#include "connectionHandler.h"
+#include "trace.h"
+
+#define NS_PER_MS 1000000
+
+/**
+ * @brief  wraps a file descriptor holding a sorted log
+ * @param  fileDescriptor: a control connection or a temp file, closed
+ * with the source
+ * @retval newly created source, before its first plane
+ */
+static FleetSource* fleet_source_create(int fileDescriptor) {
+    FleetSource* source = (FleetSource*)malloc(sizeof(FleetSource));
+    source->fileDescriptor = fileDescriptor;
+    source->reader = line_reader_create(fileDescriptor, FLEET_LINE_SIZE);
+    source->planeName = NULL;
+    source->visits = 0;
+    source->airportName = NULL;
+    source->deadline = 0;
+    source->skipped = false;
+    return source;
+}
+
+/**
+ * @brief  closes and frees a source, a skipped control is reported as 
+ * "-ID"
+ * @param  source: the source to free
+ * @param  skipped: place to report skipped controls
+ * @retval None
+ */
+static void fleet_source_free(FleetSource* source, LineWriter* skipped) {
+    if (source->skipped && source->airportName != NULL) {
+        line_writer_printf(skipped, "-%s\n", source->airportName);
+    }
+    line_reader_free(source->reader);
+    if (source->fileDescriptor >= 0) {
+        close(source->fileDescriptor);
+    }
+    free(source->planeName);
+    free(source->airportName);
+    free(source);
+}
+
+/**
+ * @brief  waits until a control's socket is ready, or its deadline
+ * @note   a control that is ready gets another FLEET_TIMEOUT_MS
+ * @param  source: the control's source
+ * @param  events: POLLIN or POLLOUT
+ * @retval true if ready, false if the deadline passed (it is skipped)
+ */
+static bool fleet_source_wait(FleetSource* source, short events) {
+    struct pollfd poller = {source->fileDescriptor, events, 0};
+    int ready;
+    do {
+        uint64_t now = trace_now();
+        ready = now < source->deadline ? poll(&poller, 1, 
+                (int)((source->deadline - now + NS_PER_MS - 1) / NS_PER_MS)) 
+                : 0;
+    } while (ready < 0 && errno == EINTR);
+    if (ready <= 0) {
+        source->skipped = true;
+        return false;
+    }
+    source->deadline = trace_now() + (uint64_t)FLEET_TIMEOUT_MS * NS_PER_MS;
+    return true;
+}
+
+/**
+ * @brief  moves to the next plane of a source, lines are PLANE (one
+ * visit, as a control's log) or PLANE:VISITS (as a merged run)
+ * @note   a control's socket is non-blocking, it is only waited for 
+ * until its deadline. A control's line which is not a plane name (e.g. 
+ * an error from something else on the port) skips the control.
+ * @param  source: the source to advance
+ * @retval true if there is a plane, false once the log ended with "." 
+ * (or the source was skipped)
+ */
+static bool fleet_source_next(FleetSource* source) {
+    StringView line;
+    LineStatus status;
+    free(source->planeName);
+    source->planeName = NULL;
+    if (source->skipped) {
+        return false;
+    }
+    while (status = line_reader_next(source->reader, &line),
+            status == LINE_TOO_LONG || (status == LINE_ERROR 
+            && errno == EAGAIN && fleet_source_wait(source, POLLIN))) {
+        // not a plane name, or more of the reply arrived
+    }
+    if (status != LINE_OK) {
+        source->skipped = true; // cut off before "."
+        return false;
+    }
+    if (!strcmp(line.data, ".")) {
+        return false;
+    }
+    if (source->airportName != NULL && !is_valid_name(line.data)) {
+        source->skipped = true; // not a log
+        return false;
+    }
+    char* colon = strchr(line.data, ':');
+    source->visits = 1;
+    if (colon != NULL) {
+        *colon = '\0';
+        source->visits = strtol(colon + 1, NULL, 10);
+    }
+    source->planeName = strdup(line.data);
+    return true;
+}
+
+/**
+ * @brief  checks whether the first line of a control's reply refused the 
+ * log: ";" for an id it does not host (an alias of a shared port, whose 
+ * airports are asked by their own ids), or busy (the control is skipped)
+ * @param  source: the source whose first line was read
+ * @retval true if no log follows, otherwise false
+ */
+static bool fleet_is_refusal(FleetSource* source) {
+    const char* line = source->planeName;
+    if (strlen(line) == strlen(BUSY_REPLY) - 1 
+            && !strncmp(line, BUSY_REPLY, strlen(line))) {
+        source->skipped = true;
+        return true;
+    }
+    return !strcmp(line, ";");
+}
+
+/**
+ * @brief  starts connecting to the control of an airport without waiting
+ * @note   every control of a merge is connected to at once, its request 
+ * is sent by fleet_source_ask
+ * @param  airportName: the airport (taken over by the source)
+ * @param  portNumber: its control's port
+ * @param  address: localhost, NULL if it could not be looked up
+ * @retval the source, skipped if the connect failed at once
+ */
+static FleetSource* fleet_source_airport(char* airportName, 
+        long portNumber, const struct sockaddr_in* address) {
+    int fileDescriptor = address != NULL 
+            ? socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0) : -1;
+    FleetSource* source = fleet_source_create(fileDescriptor);
+    source->airportName = airportName;
+    source->deadline = trace_now() + (uint64_t)FLEET_TIMEOUT_MS * NS_PER_MS;
+    if (fileDescriptor < 0) {
+        source->skipped = true;
+        return source;
+    }
+    struct sockaddr_in to = *address;
+    to.sin_port = htons((uint16_t)portNumber);
+    if (connect(fileDescriptor, (struct sockaddr*)&to, 
+            sizeof(struct sockaddr_in)) && errno != EINPROGRESS) {
+        source->skipped = true;
+    }
+    return source;
+}
+
+/**
+ * @brief  waits for a control's connect and asks for its log, selecting 
+ * the airport with =ID only if its port hosts several
+ * @note   the request is sent straight away, so every control of a merge
+ * builds its log at the same time
+ * @param  source: the control's source
+ * @param  shared: whether the mapper lists several airports on its port
+ * @retval None
+ */
+static void fleet_source_ask(FleetSource* source, bool shared) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (source->skipped || !fleet_source_wait(source, POLLOUT) 
+            || getsockopt(source->fileDescriptor, SOL_SOCKET, SO_ERROR, 
+            &error, &length) || error) {
+        source->skipped = true;
+        return;
+    }
+    LineWriter* streamWrite = line_writer_create(source->fileDescriptor);
+    if (shared) {
+        line_writer_printf(streamWrite, "=%s\n", source->airportName);
+    }
+    line_writer_write(streamWrite, "log\n", 4);
+    source->skipped = !line_writer_flush(streamWrite);
+    line_writer_free(streamWrite);
+}
+
+/**
+ * @brief  orders port numbers, lowest first
+ * @param  first: a long
+ * @param  second: a long
+ * @retval negative, zero or positive
+ */
+static int fleet_compare_ports(const void* first, const void* second) {
+    long a = *(const long*)first;
+    long b = *(const long*)second;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief  checks whether the mapper lists several airports on a port
+ * @param  sortedPorts: the port of every airport, sorted
+ * @param  count: number of ports
+ * @param  port: the port
+ * @retval true if shared, otherwise false
+ */
+static bool fleet_port_shared(const long* sortedPorts, int count, 
+        long port) {
+    int low = 0;
+    int high = count;
+    while (low < high) { // first entry not below port
+        int middle = low + (high - low) / 2;
+        if (sortedPorts[middle] < port) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low + 1 < count && sortedPorts[low + 1] == port;
+}
+
+/**
+ * @brief  looks localhost up once for every control of the fleet
+ * @param  address: set to its address
+ * @retval true if found, otherwise false
+ */
+static bool fleet_localhost(struct sockaddr_in* address) {
+    struct addrinfo* addressInfo = NULL;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo("localhost", NULL, &hints, &addressInfo)) {
+        return false;
+    }
+    memcpy(address, addressInfo->ai_addr, sizeof(struct sockaddr_in));
+    freeaddrinfo(addressInfo);
+    return true;
+}
+
+/**
+ * @brief  restores the heap order below index
+ * @param  heap: sources ordered by their current plane name
+ * @param  count: sources in the heap
+ * @param  index: the entry which may be out of order
+ * @retval None
+ */
+static void fleet_sift_down(FleetSource** heap, int count, int index) {
+    while (true) {
+        int smallest = index;
+        for (int child = 2 * index + 1; child <= 2 * index + 2
+                && child < count; child++) {
+            if (strcmp(heap[child]->planeName,
+                    heap[smallest]->planeName) < 0) {
+                smallest = child;
+            }
+        }
+        if (smallest == index) {
+            return;
+        }
+        FleetSource* swap = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+/**
+ * @brief  merges sorted sources into one sorted PLANE:VISITS stream, the
+ * visits of a plane from every source added up
+ * @note   holds one line per source, never a whole log
+ * @param  sources: the sources (freed)
+ * @param  count: number of sources
+ * @param  streamWrite: place to write, without the final "."
+ * @param  skipped: place to report skipped controls
+ * @retval None
+ */
+static void fleet_merge(FleetSource** sources, int count,
+        LineWriter* streamWrite, LineWriter* skipped) {
+    FleetSource* heap[count + 1];
+    int heapCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (fleet_source_next(sources[i])
+                && !fleet_is_refusal(sources[i])) {
+            heap[heapCount++] = sources[i];
+        }
+    }
+    for (int i = heapCount / 2 - 1; i >= 0; i--) {
+        fleet_sift_down(heap, heapCount, i);
+    }
+
+    char* planeName = NULL; // plane being added up
+    long visits = 0;
+    while (heapCount > 0) {
+        FleetSource* top = heap[0];
+        if (planeName != NULL && !strcmp(planeName, top->planeName)) {
+            visits += top->visits;
+        } else {
+            if (planeName != NULL) {
+                line_writer_printf(streamWrite, "%s:%ld\n", planeName,
+                        visits);
+                free(planeName);
+            }
+            planeName = top->planeName; // taken over from the source
+            top->planeName = NULL;
+            visits = top->visits;
+        }
+        if (!fleet_source_next(top)) {
+            heap[0] = heap[--heapCount];
+        }
+        fleet_sift_down(heap, heapCount, 0);
+    }
+    if (planeName != NULL) {
+        line_writer_printf(streamWrite, "%s:%ld\n", planeName, visits);
+        free(planeName);
+    }
+    for (int i = 0; i < count; i++) {
+        fleet_source_free(sources[i], skipped);
+    }
+}
+
+/**
+ * @brief  merges sources into a new temp file
+ * @param  sources: the sources (freed)
+ * @param  count: number of sources
+ * @param  skipped: place to report skipped controls
+ * @retval file descriptor of the run, read from its start, -1 on error
+ */
+static int fleet_merge_run(FleetSource** sources, int count, 
+        LineWriter* skipped) {
+    FILE* run = tmpfile(); // already unlinked
+    int fileDescriptor = run != NULL ? dup(fileno(run)) : -1;
+    if (run != NULL) {
+        fclose(run);
+    }
+    if (fileDescriptor < 0) {
+        for (int i = 0; i < count; i++) {
+            fleet_source_free(sources[i], skipped);
+        }
+        return -1;
+    }
+    LineWriter* streamWrite = line_writer_create(fileDescriptor);
+    fleet_merge(sources, count, streamWrite, skipped);
+    line_writer_write(streamWrite, ".\n", 2);
+    line_writer_free(streamWrite);
+    lseek(fileDescriptor, 0, SEEK_SET);
+    return fileDescriptor;
+}
+
+/**
+ * @brief  (MAPPER) sends the visits of every registered airport as one
+ * sorted PLANE:VISITS log, then a "-ID" line per airport skipped, ended 
+ * by "."
+ * @note   the logs are asked for FLEET_FAN_IN at a time and merged as
+ * they stream in. A bigger fleet is merged in runs kept in temp files,
+ * which are merged FLEET_FAN_IN at a time until one merge is left, so
+ * apart from the list of airports memory does not grow with the fleet 
+ * or its logs. Connects and reads never block, a control that can not 
+ * be reached, is busy or stays silent for FLEET_TIMEOUT_MS is skipped.
+ * @param  mapping: the local map
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void fleet_print_log(Mapper* mapping, LineWriter* streamWrite) {
+    char** airportNames;
+    long* portNumbers;
+    int airportCount = mapping_list_airports(mapping, &airportNames,
+            &portNumbers);
+    long* sortedPorts = (long*)malloc(sizeof(long) * (airportCount + 1));
+    memcpy(sortedPorts, portNumbers, sizeof(long) * airportCount);
+    qsort(sortedPorts, airportCount, sizeof(long), fleet_compare_ports);
+    struct sockaddr_in address;
+    bool found = fleet_localhost(&address);
+    LineWriter* skipped = line_writer_create_memory();
+    FleetSource* sources[FLEET_FAN_IN];
+    int runCount = 0;
+    int* runs = (int*)malloc(sizeof(int)
+            * (airportCount / FLEET_FAN_IN + 1));
+
+    for (int first = 0; first < airportCount; first += FLEET_FAN_IN) {
+        int count = 0;
+        for (int i = first; i < airportCount && i < first + FLEET_FAN_IN;
+                i++) {
+            sources[count++] = fleet_source_airport(airportNames[i],
+                    portNumbers[i], found ? &address : NULL);
+        }
+        for (int i = 0; i < count; i++) {
+            fleet_source_ask(sources[i], fleet_port_shared(sortedPorts, 
+                    airportCount, portNumbers[first + i]));
+        }
+        if (airportCount <= FLEET_FAN_IN) { // one pass is enough
+            fleet_merge(sources, count, streamWrite, skipped);
+        } else {
+            int run = fleet_merge_run(sources, count, skipped);
+            if (run >= 0) {
+                runs[runCount++] = run;
+            }
+        }
+    }
+    free(airportNames);
+    free(portNumbers);
+    free(sortedPorts);
+
+    // merge the runs down to one final merge
+    while (runCount > 0) {
+        int merged = 0;
+        for (int first = 0; first < runCount; first += FLEET_FAN_IN) {
+            int count = 0;
+            for (int i = first; i < runCount && i < first + FLEET_FAN_IN;
+                    i++) {
+                sources[count++] = fleet_source_create(runs[i]);
+            }
+            if (runCount <= FLEET_FAN_IN) {
+                fleet_merge(sources, count, streamWrite, skipped);
+            } else {
+                int run = fleet_merge_run(sources, count, skipped);
+                if (run >= 0) {
+                    runs[merged++] = run;
+                }
+            }
+        }
+        runCount = runCount <= FLEET_FAN_IN ? 0 : merged;
+    }
+    free(runs);
+    size_t length;
+    char* report = line_writer_take(skipped, &length);
+    line_writer_free(skipped);
+    if (report != NULL) {
+        line_writer_write(streamWrite, report, length);
+        free(report);
+    }
+    line_writer_write(streamWrite, ".\n", 2);
+    line_writer_flush(streamWrite);
+}
@@ -0,0 +1,23 @@
+#ifndef FLEET_H_
+#define FLEET_H_
+#include "shared.h"
+#include "lineStream.h"
+
+#define FLEET_FAN_IN 64 // logs merged at once, more go through temp files
+#define FLEET_LINE_SIZE 4096 // longest log line read from a control
+#define FLEET_TIMEOUT_MS 5000 // a control silent this long is skipped
+
+/* one sorted stream of plane visits being merged */
+typedef struct {
+    int fileDescriptor;
+    LineReader* reader;
+    char* planeName; // current plane, NULL once the stream ended
+    long visits; // visits of the current plane
+    char* airportName; // the control's airport, NULL for a temp file
+    uint64_t deadline; // trace_now() a silent control is skipped at
+    bool skipped; // unreachable, busy, silent or cut off before "."
+} FleetSource;
+
+void fleet_print_log(Mapper* mapping, LineWriter* streamWrite);
+
+#endif
@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "green.h"
+
+static GreenWorker* workers = NULL;
+static int workerCount = 0;
+
+// hands out new green threads to workers round robin
+static unsigned int nextWorker = 0;
+
+// the worker running on this thread, NULL on other threads
+static __thread GreenWorker* thisWorker = NULL;
+
+// green threads waiting for a semaphore, set up by green_start
+static GreenWaitQueue waitQueues[GREEN_WAIT_QUEUES];
+
+/**
+ * @brief  appends a green thread to the worker's run queue
+ * @note   only called on the worker's own thread
+ * @param  worker: the worker to run it
+ * @param  green: the green thread
+ * @retval None
+ */
+static void green_ready(GreenWorker* worker, Green* green) {
+    green->next = NULL;
+    if (worker->readyTail != NULL) {
+        worker->readyTail->next = green;
+    } else {
+        worker->readyHead = green;
+    }
+    worker->readyTail = green;
+}
+
+/**
+ * @brief  first function of every green thread, returning ends it
+ * @note   the context's uc_link goes back to the worker's scheduler
+ * @retval None
+ */
+static void green_entry() {
+    Green* green = thisWorker->current;
+    green->function(green->argument);
+    green->finished = true;
+}
+
+/**
+ * @brief  runs a green thread until it waits, yields or finishes
+ * @param  worker: the worker on this thread
+ * @param  green: the green thread to run
+ * @retval None
+ */
+static void green_run(GreenWorker* worker, Green* green) {
+    worker->current = green;
+    trace_swap(&green->trace);
+    swapcontext(&worker->scheduler, &green->context);
+    trace_swap(&green->trace);
+    worker->current = NULL;
+    if (green->finished) {
+        munmap(green->stack, GREEN_STACK_SIZE + sysconf(_SC_PAGESIZE));
+        free(green);
+    }
+}
+
+/**
+ * @brief  moves green threads spawned by other threads to the run queue
+ * @param  worker: the worker on this thread
+ * @retval None
+ */
+static void green_take_incoming(GreenWorker* worker) {
+    uint64_t wakeCount;
+    if (read(worker->wakeFD, &wakeCount, sizeof(uint64_t)) < 0) {
+        // already cleared by an earlier wake up
+    }
+    sem_wait(worker->lock);
+    Green* incoming = worker->incoming;
+    worker->incoming = NULL;
+    sem_post(worker->lock);
+    while (incoming != NULL) {
+        Green* next = incoming->next;
+        green_ready(worker, incoming);
+        incoming = next;
+    }
+}
+
+/**
+ * @brief  the scheduler: waits for sockets to become ready and runs the
+ * green threads waiting on them
+ * @param  passArg: pointer to the GreenWorker
+ * @retval never returns
+ */
+static void* green_worker_thread(void* passArg) {
+    GreenWorker* worker = (GreenWorker*)passArg;
+    thisWorker = worker;
+    struct epoll_event events[GREEN_MAX_EVENTS];
+    while (true) {
+        // only poll if something is still ready to run
+        int count = epoll_wait(worker->epollFD, events, GREEN_MAX_EVENTS,
+                worker->readyHead != NULL ? 0 : -1);
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                green_take_incoming(worker);
+            } else {
+                green_ready(worker, (Green*)events[i].data.ptr);
+            }
+        }
+
+        // green threads yielding now go to the back, run on the next turn
+        Green* ready = worker->readyHead;
+        worker->readyHead = NULL;
+        worker->readyTail = NULL;
+        while (ready != NULL) {
+            Green* next = ready->next;
+            green_run(worker, ready);
+            ready = next;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  starts the OS threads green threads are run on
+ * @note   call once, after the signal mask is set (workers inherit it)
+ * @param  count: number of worker threads
+ * @retval true if all workers started, otherwise false
+ */
+bool green_start(int count) {
+    for (int i = 0; i < GREEN_WAIT_QUEUES; i++) {
+        waitQueues[i].head = NULL;
+        waitQueues[i].waiting = 0;
+        waitQueues[i].lock = (sem_t*)malloc(sizeof(sem_t));
+        sem_init(waitQueues[i].lock, 0, 1);
+    }
+    workers = (GreenWorker*)malloc(sizeof(GreenWorker) * count);
+    for (int i = 0; i < count; i++) {
+        GreenWorker* worker = &workers[i];
+        worker->epollFD = epoll_create1(0);
+        worker->wakeFD = eventfd(0, EFD_NONBLOCK);
+        if (worker->epollFD < 0 || worker->wakeFD < 0) {
+            return false;
+        }
+        struct epoll_event wake;
+        wake.events = EPOLLIN;
+        wake.data.ptr = NULL; // the only event without a green thread
+        if (epoll_ctl(worker->epollFD, EPOLL_CTL_ADD, worker->wakeFD,
+                &wake)) {
+            return false;
+        }
+        worker->current = NULL;
+        worker->readyHead = NULL;
+        worker->readyTail = NULL;
+        worker->incoming = NULL;
+        worker->lock = (sem_t*)malloc(sizeof(sem_t));
+        sem_init(worker->lock, 0, 1);
+
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, green_worker_thread, worker)) {
+            return false;
+        }
+        pthread_detach(tid);
+        workerCount = i + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief  checks whether green_start was called
+ * @retval true if new connections should get green threads
+ */
+bool green_enabled() {
+    return workerCount > 0;
+}
+
+/**
+ * @brief  hands a green thread to its worker from any thread, which runs 
+ * it on its next turn
+ * @param  worker: the worker to run it
+ * @param  green: the green thread
+ * @retval None
+ */
+static void green_send(GreenWorker* worker, Green* green) {
+    sem_wait(worker->lock);
+    green->next = worker->incoming;
+    worker->incoming = green;
+    sem_post(worker->lock);
+    uint64_t one = 1;
+    if (write(worker->wakeFD, &one, sizeof(uint64_t)) < 0) {
+        // counter is already non zero, the worker wakes up anyway
+    }
+}
+
+/**
+ * @brief  creates a green thread running function(argument) on one of
+ * the workers
+ * @note   safe to call from any thread
+ * @param  function: what the green thread runs
+ * @param  argument: passed to function
+ * @retval true if created, false if no stack could be mapped
+ */
+bool green_spawn(GreenFunction function, void* argument) {
+    GreenWorker* worker = &workers[__atomic_fetch_add(&nextWorker, 1,
+            __ATOMIC_RELAXED) % workerCount];
+    long page = sysconf(_SC_PAGESIZE);
+    char* stack = (char*)mmap(NULL, GREEN_STACK_SIZE + page,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+        return false;
+    }
+    mprotect(stack, page, PROT_NONE); // overflow faults, never corrupts
+
+    Green* green = (Green*)malloc(sizeof(Green));
+    memset(&green->trace, 0, sizeof(TraceState));
+    green->stack = stack;
+    green->function = function;
+    green->argument = argument;
+    green->worker = worker;
+    green->finished = false;
+    green->waitingOn = NULL;
+    getcontext(&green->context);
+    green->context.uc_stack.ss_sp = stack + page;
+    green->context.uc_stack.ss_size = GREEN_STACK_SIZE;
+    green->context.uc_link = &worker->scheduler;
+    makecontext(&green->context, green_entry, 0);
+    green_send(worker, green);
+    return true;
+}
+
+/**
+ * @brief  sleeps the running green thread until fileDescriptor is ready
+ * @note   used by the line streams when a non-blocking socket would block
+ * @param  fileDescriptor: the socket to wait on
+ * @param  writing: wait to write if true, otherwise to read
+ * @retval true once ready, false if not on a green thread (or epoll
+ * failed) so the caller should treat EAGAIN as an error
+ */
+bool green_wait_fd(int fileDescriptor, bool writing) {
+    GreenWorker* worker = thisWorker;
+    if (worker == NULL || worker->current == NULL) {
+        return false;
+    }
+    struct epoll_event event;
+    event.events = (writing ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    event.data.ptr = worker->current;
+    if (epoll_ctl(worker->epollFD, EPOLL_CTL_MOD, fileDescriptor, &event)
+            && (errno != ENOENT || epoll_ctl(worker->epollFD,
+            EPOLL_CTL_ADD, fileDescriptor, &event))) {
+        return false;
+    }
+    swapcontext(&worker->current->context, &worker->scheduler);
+    return true;
+}
+
+/**
+ * @brief  lets the other green threads of this worker run first
+ * @note   on an OS thread it is only sched_yield()
+ * @retval None
+ */
+void green_yield() {
+    GreenWorker* worker = thisWorker;
+    if (worker == NULL || worker->current == NULL) {
+        sched_yield();
+        return;
+    }
+    Green* green = worker->current;
+    green_ready(worker, green);
+    swapcontext(&green->context, &worker->scheduler);
+}
+
+/**
+ * @brief  gets the wait queue of a semaphore
+ * @param  semaphore: the semaphore
+ * @retval its queue
+ */
+static GreenWaitQueue* green_wait_queue(sem_t* semaphore) {
+    return &waitQueues[((uintptr_t)semaphore / sizeof(sem_t)) 
+            % GREEN_WAIT_QUEUES];
+}
+
+/**
+ * @brief  sem_wait which never blocks a worker: a green thread parks on 
+ * the semaphore's wait queue until green_sem_post wakes it
+ * @note   a green thread may sleep on its socket while holding a
+ * semaphore, blocking in sem_wait would then deadlock the worker. A 
+ * semaphore waited on this way must be posted with green_sem_post.
+ * @param  semaphore: the semaphore to take
+ * @retval None
+ */
+void green_sem_wait(sem_t* semaphore) {
+    GreenWorker* worker = thisWorker;
+    if (worker == NULL || worker->current == NULL) {
+        sem_wait(semaphore);
+        return;
+    }
+    Green* green = worker->current;
+    GreenWaitQueue* queue = green_wait_queue(semaphore);
+    while (sem_trywait(semaphore)) {
+        sem_wait(queue->lock);
+        // counted before trying again, so a post in between sees us
+        __atomic_add_fetch(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+        if (!sem_trywait(semaphore)) {
+            __atomic_sub_fetch(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+            sem_post(queue->lock);
+            return;
+        }
+        green->waitingOn = semaphore;
+        green->next = NULL;
+        Green** link = &queue->head;
+        while (*link != NULL) {
+            link = &(*link)->next;
+        }
+        *link = green;
+        sem_post(queue->lock);
+        swapcontext(&green->context, &worker->scheduler); // until woken
+    }
+}
+
+/**
+ * @brief  sem_post which also wakes the oldest green thread parked on 
+ * the semaphore, it takes the semaphore if nobody got it first
+ * @note   safe to call from any thread, only takes the queue lock if 
+ * something is parked on its queue
+ * @param  semaphore: the semaphore to give back
+ * @retval None
+ */
+void green_sem_post(sem_t* semaphore) {
+    sem_post(semaphore);
+    GreenWaitQueue* queue = green_wait_queue(semaphore);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue->waiting, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+    sem_wait(queue->lock);
+    Green** link = &queue->head;
+    while (*link != NULL && (*link)->waitingOn != semaphore) {
+        link = &(*link)->next;
+    }
+    Green* green = *link;
+    if (green != NULL) {
+        *link = green->next;
+        green->waitingOn = NULL;
+        __atomic_sub_fetch(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+    }
+    sem_post(queue->lock);
+    if (green != NULL) {
+        green_send(green->worker, green);
+    }
+}
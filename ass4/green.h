@@ -0,0 +1,65 @@
+#ifndef GREEN_H_
+#define GREEN_H_
+#include <stdbool.h>
+#include <semaphore.h>
+#include <ucontext.h>
+#include "trace.h"
+
+#define GREEN_STACK_SIZE (64 * 1024) // per green thread, plus a guard page
+#define GREEN_MAX_EVENTS 64 // epoll events taken per wait
+#define GREEN_WAIT_QUEUES 64 // semaphores are hashed over this many queues
+
+/* the code a green thread runs */
+typedef void (*GreenFunction)(void* argument);
+
+struct GreenWorker;
+
+/* a user space thread, only ever run by the worker it was given to */
+struct Green {
+    ucontext_t context;
+    char* stack; // mmap'd, lowest page is the guard
+    GreenFunction function;
+    void* argument;
+    struct GreenWorker* worker;
+    TraceState trace; // its request while it is not running
+    bool finished;
+    sem_t* waitingOn; // semaphore it is parked on, NULL if none
+    struct Green* next; // next in the run queue (or wait queue)
+};
+typedef struct Green Green;
+
+/* green threads parked on semaphores hashing to the same queue */
+typedef struct {
+    Green* head; // oldest first, guarded by lock
+    int waiting; // parked count, checked without the lock by posts
+    sem_t* lock;
+} GreenWaitQueue;
+
+/* an OS thread running green threads as their sockets become ready */
+struct GreenWorker {
+    int epollFD;
+    int wakeFD; // eventfd, signalled when incoming is filled
+    ucontext_t scheduler;
+    Green* current; // running green thread, NULL in the scheduler
+    Green* readyHead; // run queue, only used by the worker itself
+    Green* readyTail;
+    Green* incoming; // spawned by other threads, guarded by lock
+    sem_t* lock;
+};
+typedef struct GreenWorker GreenWorker;
+
+bool green_start(int workers);
+
+bool green_enabled();
+
+bool green_spawn(GreenFunction function, void* argument);
+
+bool green_wait_fd(int fileDescriptor, bool writing);
+
+void green_yield();
+
+void green_sem_wait(sem_t* semaphore);
+
+void green_sem_post(sem_t* semaphore);
+
+#endif
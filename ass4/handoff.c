@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "handoff.h"
+#include "connectionHandler.h"
+
+#define HANDOFF_TAG 'H' // the one data byte carrying the listening socket
+
+// Used to pass arguments to handoff_delta_thread()
+typedef struct {
+    Mapper* mapping;
+    LineReader* streamRead;
+    int handoffFD;
+} DeltaThreadArgs;
+
+/**
+ * @brief  fills a unix socket address for path
+ * @param  address: address to fill
+ * @param  path: socket file name
+ * @retval true if path fits, otherwise false
+ */
+static bool handoff_address(struct sockaddr_un* address, const char* path) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+/**
+ * @brief  listens on a unix socket for the next mapper to take over
+ * @param  path: socket file name (replaced if it exists)
+ * @retval listening unix socket, -1 on error
+ */
+int handoff_listen(const char* path) {
+    struct sockaddr_un address;
+    if (!handoff_address(&address, path)) {
+        return -1;
+    }
+    int handoffSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (bind(handoffSocket, (struct sockaddr*)&address, 
+            sizeof(struct sockaddr_un)) 
+            || listen(handoffSocket, HANDOFF_BACKLOG)) {
+        close(handoffSocket);
+        return -1;
+    }
+    return handoffSocket;
+}
+
+/**
+ * @brief  stores an ID:PORT line from the old mapper, puts the airport 
+ * under a lease for an ID:PORT:TTL line, or removes it for ID:0 (its 
+ * lease ran out on the old mapper)
+ * @param  mapping: the local map
+ * @param  line: the line (changed in place)
+ * @retval None
+ */
+static void handoff_apply_line(Mapper* mapping, char* line) {
+    char* colon = strchr(line, ':'); // names never contain ':'
+    if (colon == NULL) {
+        return;
+    }
+    colon[0] = '\0';
+    char* portEnd;
+    long portNumber = strtol(colon + 1, &portEnd, 10);
+    if (!is_valid_name(line) || portNumber < 0 || portEnd == colon + 1) {
+        return;
+    }
+    if (portNumber == 0) {
+        mapping_remove_port_number(mapping, line);
+    } else if (portEnd[0] == ':') {
+        long ttl = parse_positive_number(portEnd + 1);
+        if (ttl > 0) {
+            mapping_renew_port_number(mapping, line, portNumber, ttl);
+        }
+    } else {
+        mapping_set_port_number(mapping, line, portNumber, 0);
+    }
+}
+
+/**
+ * @brief  applies registrations the old mapper takes while it drains, 
+ * until it closes the handoff connection
+ * @param  passArgs: pointer to DeltaThreadArgs
+ * @retval None
+ */
+static void* handoff_delta_thread(void* passArgs) {
+    DeltaThreadArgs* args = (DeltaThreadArgs*)passArgs;
+    StringView line;
+    while (line_reader_next(args->streamRead, &line) == LINE_OK) {
+        handoff_apply_line(args->mapping, line.data);
+    }
+    line_reader_free(args->streamRead);
+    close(args->handoffFD);
+    free(args);
+    return NULL;
+}
+
+/**
+ * @brief  takes over from a running mapper listening on path: gets its 
+ * listening socket and registry, then keeps applying its late changes 
+ * in the background
+ * @param  path: handoff socket file name
+ * @param  mapping: the local map to fill
+ * @retval the inherited listening socket, -1 if there is no old mapper
+ */
+int handoff_receive(const char* path, Mapper* mapping) {
+    struct sockaddr_un address;
+    if (!handoff_address(&address, path)) {
+        return -1;
+    }
+    int handoffFD = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(handoffFD, (struct sockaddr*)&address, 
+            sizeof(struct sockaddr_un))) {
+        close(handoffFD);
+        return -1; // nobody to take over from, start fresh
+    }
+
+    // first the listening socket as SCM_RIGHTS ancillary data
+    char tag;
+    struct iovec data = {&tag, 1};
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr message;
+    memset(&message, 0, sizeof(struct msghdr));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.space;
+    message.msg_controllen = sizeof(control.space);
+    struct cmsghdr* header;
+    if (recvmsg(handoffFD, &message, 0) != 1 || tag != HANDOFF_TAG 
+            || (header = CMSG_FIRSTHDR(&message)) == NULL 
+            || header->cmsg_type != SCM_RIGHTS) {
+        close(handoffFD);
+        return -1;
+    }
+    int listenSocket;
+    memcpy(&listenSocket, CMSG_DATA(header), sizeof(int));
+
+    // then the registry as ID:PORT lines, leased ones again with their 
+    // ttl left as ID:PORT:TTL, up to a line holding only .
+    LineReader* streamRead = line_reader_create(handoffFD, MAX_LINE_SIZE);
+    StringView line;
+    while (line_reader_next(streamRead, &line) == LINE_OK 
+            && strcmp(line.data, ".")) {
+        handoff_apply_line(mapping, line.data);
+    }
+
+    DeltaThreadArgs* args = (DeltaThreadArgs*)
+            malloc(sizeof(DeltaThreadArgs));
+    args->mapping = mapping;
+    args->streamRead = streamRead;
+    args->handoffFD = handoffFD;
+    pthread_t tid;
+    pthread_create(&tid, NULL, handoff_delta_thread, args);
+    pthread_detach(tid);
+    return listenSocket;
+}
+
+/**
+ * @brief  sends the registry as ID:PORT lines, leased ones again with 
+ * their ttl left as ID:PORT:TTL
+ * @param  mapping: the local map
+ * @param  streamWrite: the handoff connection
+ * @retval None
+ */
+static void handoff_send_snapshot(Mapper* mapping, LineWriter* streamWrite) {
+    Encoding plain = {ENCODING_PLAIN, false};
+    mapping_print_airport_port_numbers(mapping, plain, streamWrite);
+    mapping_print_leases(mapping, streamWrite);
+}
+
+/**
+ * @brief  gives the listening socket and registry to the new mapper, then 
+ * forwards registrations from connections still being served until they 
+ * are all done (or HANDOFF_DRAIN_SECONDS passed)
+ * @note   the caller must have stopped accepting, and exits afterwards. 
+ * Registrations are forwarded as ID:PORT, or ID:PORT:TTL with the ttl 
+ * left if leased, and expiries as ID:0. If the new mapper falls too far 
+ * behind, the whole registry is sent again, which it applies like any 
+ * other line.
+ * @param  handoffFD: connection from the new mapper
+ * @param  listenSocket: the command port socket to pass on
+ * @param  mapping: the local map
+ * @retval None
+ */
+void handoff_send(int handoffFD, int listenSocket, Mapper* mapping) {
+    char tag = HANDOFF_TAG;
+    struct iovec data = {&tag, 1};
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr message;
+    memset(&message, 0, sizeof(struct msghdr));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.space;
+    message.msg_controllen = sizeof(control.space);
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &listenSocket, sizeof(int));
+    if (sendmsg(handoffFD, &message, 0) != 1) {
+        close(handoffFD);
+        return;
+    }
+
+    // subscribe before the snapshot so no registration falls in between
+    Subscriber* subscriber = mapping_subscribe(mapping, "");
+    LineWriter* streamWrite = line_writer_create(handoffFD);
+    handoff_send_snapshot(mapping, streamWrite);
+    line_writer_write(streamWrite, ".\n", 2);
+
+    time_t deadline = time(NULL) + HANDOFF_DRAIN_SECONDS;
+    Delta delta;
+    while (line_writer_flush(streamWrite) && time(NULL) < deadline) {
+        SubscriberStatus status = subscriber_next(subscriber, &delta);
+        if (status == SUBSCRIBER_DELTA) {
+            long ttl = delta.portNumber > 0 
+                    ? mapping_get_lease_left(mapping, delta.airportName) : 0;
+            if (ttl > 0) {
+                line_writer_printf(streamWrite, "%s:%ld:%ld\n", 
+                        delta.airportName, delta.portNumber, ttl);
+            } else {
+                line_writer_printf(streamWrite, "%s:%ld\n", 
+                        delta.airportName, delta.portNumber);
+            }
+            free(delta.airportName);
+        } else if (status == SUBSCRIBER_DROPPED) {
+            // deltas were lost, resubscribe first so none fall in between
+            mapping_unsubscribe(mapping, subscriber);
+            subscriber = mapping_subscribe(mapping, "");
+            handoff_send_snapshot(mapping, streamWrite);
+        } else if (connection_active_count() == 0) {
+            break;
+        }
+    }
+    mapping_unsubscribe(mapping, subscriber);
+    line_writer_free(streamWrite);
+    close(handoffFD);
+}
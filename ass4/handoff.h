@@ -0,0 +1,15 @@
+#ifndef HANDOFF_H_
+#define HANDOFF_H_
+#include <stdbool.h>
+#include "shared.h"
+
+#define HANDOFF_DRAIN_SECONDS 30 // longest the old mapper waits to drain
+#define HANDOFF_BACKLOG 1
+
+int handoff_listen(const char* path);
+
+int handoff_receive(const char* path, Mapper* mapping);
+
+void handoff_send(int handoffFD, int listenSocket, Mapper* mapping);
+
+#endif
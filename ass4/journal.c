@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "journal.h"
+#include "lineStream.h"
+#include "green.h"
+
+/** 
+ * A non-zero value means the semaphore is shared between processes 
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+#define JOURNAL_INIT_SIZE 4096
+#define JOURNAL_MAX_LINE 65536
+#define JOURNAL_MODE 0644
+#define MS_PER_SECOND 1000
+#define NS_PER_MS 1000000
+
+// every open journal, one thread flushes them all. Only ever pushed to, 
+// with a compare and swap.
+static Journal* journals = NULL;
+
+/**
+ * @brief  appends bytes to a journal buffer, growing it when needed
+ * @param  buffer: buffer to append to
+ * @param  data: bytes to append
+ * @param  length: number of bytes
+ * @retval None
+ */
+static void journal_buffer_append(JournalBuffer* buffer, const char* data,
+        size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity 
+                : JOURNAL_INIT_SIZE;
+        while (buffer->length + length > capacity) {
+            capacity *= 2;
+        }
+        buffer->data = (char*)realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+/**
+ * @brief  writes the whole buffer to a file descriptor
+ * @param  fileDescriptor: where to write
+ * @param  buffer: what to write
+ * @retval true on success, otherwise false
+ */
+static bool journal_write_all(int fileDescriptor, JournalBuffer* buffer) {
+    size_t written = 0;
+    while (written < buffer->length) {
+        ssize_t result = write(fileDescriptor, buffer->data + written, 
+                buffer->length - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+/**
+ * @brief  records a visit in memory, written out later by the flusher
+ * @note   never touches the disk, caller holds airport->semaphore
+ * @param  journal: the journal to append to
+ * @param  planeName: the plane which visited
+ * @retval None
+ */
+void journal_record(Journal* journal, const char* planeName) {
+    sem_wait(journal->lock);
+    journal_buffer_append(&journal->pending, planeName, strlen(planeName));
+    journal_buffer_append(&journal->pending, "\n", 1);
+    journal->dirty = true;
+    sem_post(journal->lock);
+}
+
+/**
+ * @brief  rebuilds the airport trie from the journal file
+ * @note   a last line without '\n' was torn by a crash and is ignored
+ * @param  airport: the airport to fill
+ * @param  fileDescriptor: the journal, read from the start
+ * @retval None
+ */
+static void journal_replay(Airport* airport, int fileDescriptor) {
+    LineReader* reader = line_reader_create(fileDescriptor, 
+            JOURNAL_MAX_LINE);
+    StringView line;
+    LineStatus status;
+    while (status = line_reader_next(reader, &line), 
+            status == LINE_OK || status == LINE_TOO_LONG) {
+        if (status == LINE_TOO_LONG || !line.complete) {
+            continue;
+        }
+        int visits = 1;
+        char* colon = strchr(line.data, ':'); // names never contain ':'
+        if (colon != NULL) {
+            colon[0] = '\0';
+            visits = atoi(colon + 1);
+        }
+        if (is_valid_name(line.data) && visits > 0) {
+            airport_add_visits(airport, line.data, visits);
+        }
+    }
+    line_reader_free(reader);
+}
+
+/**
+ * @brief  adds one PLANE:COUNT line to the compaction snapshot
+ * @param  planeName: plane visited the airport
+ * @param  visits: number of visits
+ * @param  context: the JournalBuffer being built
+ * @retval None
+ */
+static void journal_snapshot_plane(const char* planeName, int visits, 
+        void* context) {
+    char count[32];
+    int length = snprintf(count, sizeof(count), ":%d\n", visits);
+    journal_buffer_append((JournalBuffer*)context, planeName, 
+            strlen(planeName));
+    journal_buffer_append((JournalBuffer*)context, count, length);
+}
+
+/**
+ * @brief  rewrites the journal as one PLANE:COUNT line per plane
+ * @note   only the snapshot is taken under the airport semaphore, the 
+ * file is written afterwards so visits never wait on the disk
+ * @param  journal: the journal to compact
+ * @retval true on success, otherwise false (old journal kept)
+ */
+static bool journal_compact(Journal* journal) {
+    JournalBuffer snapshot = {NULL, 0, 0};
+    sem_wait(journal->airport->semaphore);
+    airport_for_each_plane(journal->airport, journal_snapshot_plane, 
+            &snapshot);
+    // everything pending is already part of the snapshot
+    sem_wait(journal->lock);
+    journal->pending.length = 0;
+    journal->dirty = false;
+    sem_post(journal->lock);
+    green_sem_post(journal->airport->semaphore);
+
+    size_t pathLength = strlen(journal->path) + sizeof(".tmp");
+    char* tempPath = (char*)malloc(pathLength);
+    snprintf(tempPath, pathLength, "%s.tmp", journal->path);
+    int tempFD = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, JOURNAL_MODE);
+    bool success = tempFD >= 0 && journal_write_all(tempFD, &snapshot) 
+            && fdatasync(tempFD) == 0 && rename(tempPath, journal->path) == 0;
+    if (tempFD >= 0) {
+        close(tempFD);
+    }
+    if (success) {
+        close(journal->fileDescriptor);
+        journal->fileDescriptor = open(journal->path, 
+                O_WRONLY | O_APPEND | O_CREAT, JOURNAL_MODE);
+    } else {
+        unlink(tempPath);
+    }
+    free(tempPath);
+    free(snapshot.data);
+    return success;
+}
+
+/**
+ * @brief  swaps out the pending visits and appends them to the file
+ * @param  journal: the journal to flush
+ * @retval None
+ */
+static void journal_flush(Journal* journal) {
+    sem_wait(journal->lock);
+    JournalBuffer swap = journal->pending;
+    journal->pending = journal->writing;
+    journal->writing = swap;
+    sem_post(journal->lock);
+
+    if (journal->writing.length == 0) {
+        return;
+    }
+    if (journal_write_all(journal->fileDescriptor, &journal->writing)) {
+        fdatasync(journal->fileDescriptor);
+    }
+    journal->writing.length = 0;
+}
+
+/**
+ * @brief  background thread, flushes every journal every JOURNAL_FLUSH_MS 
+ * and compacts them every JOURNAL_COMPACT_SECONDS
+ * @param  passArg: unused
+ * @retval never returns
+ */
+static void* journal_flusher_thread(void* passArg) {
+    struct timespec wait = {JOURNAL_FLUSH_MS / MS_PER_SECOND, 
+            (JOURNAL_FLUSH_MS % MS_PER_SECOND) * NS_PER_MS};
+    int flushes = 0;
+    int flushesPerCompact = JOURNAL_COMPACT_SECONDS * MS_PER_SECOND 
+            / JOURNAL_FLUSH_MS;
+    while (true) {
+        nanosleep(&wait, NULL);
+        bool compact = ++flushes >= flushesPerCompact;
+        if (compact) {
+            flushes = 0;
+        }
+        for (Journal* journal = __atomic_load_n(&journals, 
+                __ATOMIC_ACQUIRE); journal != NULL; 
+                journal = journal->next) {
+            journal_flush(journal);
+            if (!compact) {
+                continue;
+            }
+            sem_wait(journal->lock);
+            bool dirty = journal->dirty;
+            sem_post(journal->lock);
+            if (dirty) {
+                journal_compact(journal);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  opens (or creates) the journal, replays it into the airport, 
+ * compacts it and hands it to the flusher thread (started by the first)
+ * @note   must be called before the airport accepts connections
+ * @param  airport: the airport to journal, journal is attached to it
+ * @param  path: journal file name
+ * @retval the journal, or NULL if the file can not be used
+ */
+Journal* journal_open(Airport* airport, const char* path) {
+    int fileDescriptor = open(path, O_RDONLY | O_CREAT, JOURNAL_MODE);
+    if (fileDescriptor < 0) {
+        return NULL;
+    }
+    journal_replay(airport, fileDescriptor);
+    close(fileDescriptor);
+
+    Journal* journal = (Journal*)malloc(sizeof(Journal));
+    journal->path = strdup(path);
+    journal->airport = airport;
+    journal->pending = (JournalBuffer){NULL, 0, 0};
+    journal->writing = (JournalBuffer){NULL, 0, 0};
+    journal->dirty = false;
+    journal->lock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(journal->lock, SEMA_SHARE_THREAD, 1);
+    journal->fileDescriptor = -1;
+
+    // start from a clean file so a torn last line is never appended to
+    if (!journal_compact(journal)) {
+        sem_destroy(journal->lock);
+        free(journal->lock);
+        free(journal->path);
+        free(journal);
+        return NULL;
+    }
+    airport->journal = journal;
+    journal->next = __atomic_load_n(&journals, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&journals, &journal->next, 
+            journal, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        // another journal was added first, next now points at it
+    }
+    if (journal->next == NULL) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, journal_flusher_thread, NULL);
+        pthread_detach(tid);
+    }
+    return journal;
+}
@@ -0,0 +1,36 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "shared.h"
+
+#define JOURNAL_FLUSH_MS 100 // how long a visit may sit in memory
+#define JOURNAL_COMPACT_SECONDS 60 // how often the file is rewritten
+
+/* growable in memory chunk of journal lines */
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} JournalBuffer;
+
+/* append only file of visits, PLANE for one visit or PLANE:COUNT */
+struct Journal {
+    char* path;
+    int fileDescriptor; // opened O_APPEND, only used by the flusher
+    Airport* airport; // compaction snapshots its trie
+    JournalBuffer pending; // visits not written yet, guarded by lock
+    JournalBuffer writing; // owned by the flusher while writing
+    sem_t* lock;
+    bool dirty; // anything appended since the last compaction
+    struct Journal* next; // every journal shares one flusher thread
+};
+typedef struct Journal Journal;
+
+Journal* journal_open(Airport* airport, const char* path);
+
+void journal_record(Journal* journal, const char* planeName);
+
+#endif
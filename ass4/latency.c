@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "latency.h"
+#include "trace.h"
+#include "green.h"
+
+/**
+ * A non-zero value means the semaphore is shared between processes
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+#define NS_PER_US 1000.0
+
+static const char* kindNames[LATENCY_KINDS] = {"?", "!", "@", "visit",
+        "log", "lock"};
+
+// percentiles reported, the last is the max
+static const double percentiles[] = {50, 90, 99, 99.9, 100};
+static const char* percentileNames[] = {"p50", "p90", "p99", "p99.9",
+        "max"};
+#define PERCENTILE_COUNT 5
+
+// guards the lists below, taken once per thread, never per sample
+static sem_t* setLock = NULL;
+static LatencySet* allSets = NULL;
+static LatencySet* freeSets = NULL;
+
+// hands a thread's set back when the thread exits
+static pthread_key_t setKey;
+
+// the set this thread records into, NULL until its first sample
+static __thread LatencySet* threadSet = NULL;
+
+/**
+ * @brief  puts the set of an exiting thread on the free list, its counts
+ * are kept for the next thread
+ * @param  passArg: the set
+ * @retval None
+ */
+static void latency_release_set(void* passArg) {
+    LatencySet* set = (LatencySet*)passArg;
+    sem_wait(setLock);
+    set->nextFree = freeSets;
+    freeSets = set;
+    sem_post(setLock);
+}
+
+/**
+ * @brief  gives this thread a set, reusing one of an exited thread
+ * @retval the set, NULL if latency_start was not called
+ */
+static LatencySet* latency_thread_set() {
+    if (setLock == NULL) {
+        return NULL;
+    }
+    sem_wait(setLock);
+    LatencySet* set = freeSets;
+    if (set != NULL) {
+        freeSets = set->nextFree;
+    } else {
+        set = (LatencySet*)calloc(1, sizeof(LatencySet));
+        set->next = allSets;
+        __atomic_store_n(&allSets, set, __ATOMIC_RELEASE);
+    }
+    sem_post(setLock);
+    pthread_setspecific(setKey, set);
+    threadSet = set;
+    return set;
+}
+
+/**
+ * @brief  gets the bucket of a sample: exact below 2^LATENCY_SUB_BITS,
+ * then 2^LATENCY_SUB_BITS equal buckets per power of two
+ * @param  value: the sample
+ * @retval index of its bucket
+ */
+static unsigned latency_bucket(uint64_t value) {
+    if (value >> LATENCY_MAX_BITS) {
+        value = (1ULL << LATENCY_MAX_BITS) - 1;
+    }
+    if (value < (1u << LATENCY_SUB_BITS)) {
+        return value;
+    }
+    int shift = 63 - __builtin_clzll(value) - LATENCY_SUB_BITS;
+    return ((shift + 1) << LATENCY_SUB_BITS)
+            | ((value >> shift) & ((1u << LATENCY_SUB_BITS) - 1));
+}
+
+/**
+ * @brief  gets the largest sample a bucket holds
+ * @param  bucket: index of the bucket
+ * @retval the value reported for samples in it
+ */
+static uint64_t latency_bucket_value(unsigned bucket) {
+    if (bucket < (1u << LATENCY_SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)((1u << LATENCY_SUB_BITS)
+            | (bucket & ((1u << LATENCY_SUB_BITS) - 1))) << shift;
+    return low + (1ULL << shift) - 1;
+}
+
+/**
+ * @brief  adds a sample to this thread's histogram of kind
+ * @note   a thread local add, no lock or atomic read-modify-write
+ * @param  kind: what was timed, LATENCY_NONE is ignored
+ * @param  nanoseconds: how long it took
+ * @retval None
+ */
+void latency_record(LatencyKind kind, uint64_t nanoseconds) {
+    LatencySet* set = threadSet;
+    if (kind == LATENCY_NONE
+            || (set == NULL && (set = latency_thread_set()) == NULL)) {
+        return;
+    }
+    uint64_t* count = &set->counts[kind][latency_bucket(nanoseconds)];
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED); // only writer
+}
+
+/**
+ * @brief  gets the histogram a command is timed into
+ * @param  opcode: the opcode of its trace record
+ * @retval the kind, LATENCY_NONE for commands which are not timed
+ */
+LatencyKind latency_kind(char opcode) {
+    switch (opcode) {
+        case '?':
+            return LATENCY_ASK;
+        case '!':
+            return LATENCY_ADD;
+        case '@':
+            return LATENCY_ALL;
+        case 'v':
+            return LATENCY_VISIT;
+        case 'l':
+            return LATENCY_LOG;
+        default:
+            return LATENCY_NONE;
+    }
+}
+
+/**
+ * @brief  takes a mapper or airport semaphore, timing the wait
+ * @note   an uncontended semaphore is taken without reading the clock
+ * and counts as a wait of 0
+ * @param  semaphore: the semaphore to take
+ * @retval None
+ */
+void latency_lock(sem_t* semaphore) {
+    if (!sem_trywait(semaphore)) {
+        latency_record(LATENCY_LOCK, 0);
+        return;
+    }
+    uint64_t start = trace_now();
+    green_sem_wait(semaphore);
+    latency_record(LATENCY_LOCK, trace_now() - start);
+}
+
+/**
+ * @brief  prints a percentile line for every kind with samples, merging
+ * the sets of all threads
+ * @note   sets are read while their threads write, so a line may miss
+ * samples recorded meanwhile
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void latency_print(LineWriter* streamWrite) {
+    uint64_t* merged = (uint64_t*)malloc(sizeof(uint64_t)
+            * LATENCY_BUCKETS);
+    for (int kind = 0; kind < LATENCY_KINDS; kind++) {
+        memset(merged, 0, sizeof(uint64_t) * LATENCY_BUCKETS);
+        uint64_t total = 0;
+        for (LatencySet* set = __atomic_load_n(&allSets, __ATOMIC_ACQUIRE);
+                set != NULL; set = set->next) {
+            for (int i = 0; i < LATENCY_BUCKETS; i++) {
+                uint64_t count = __atomic_load_n(&set->counts[kind][i],
+                        __ATOMIC_RELAXED);
+                merged[i] += count;
+                total += count;
+            }
+        }
+        if (total == 0) {
+            continue;
+        }
+        line_writer_printf(streamWrite, "%s n=%llu", kindNames[kind],
+                (unsigned long long)total);
+        int bucket = 0;
+        uint64_t seen = merged[0];
+        for (int i = 0; i < PERCENTILE_COUNT; i++) {
+            uint64_t rank = (uint64_t)(percentiles[i] / 100 * total + 0.5);
+            rank = rank < 1 ? 1 : rank;
+            while (seen < rank) {
+                seen += merged[++bucket];
+            }
+            line_writer_printf(streamWrite, " %s=%.1fus",
+                    percentileNames[i],
+                    latency_bucket_value(bucket) / NS_PER_US);
+        }
+        line_writer_write(streamWrite, "\n", 1);
+    }
+    free(merged);
+}
+
+/**
+ * @brief  waits for SIGINT or SIGTERM, then prints the histograms to
+ * stderr and exits as the signal would have
+ * @param  passArg: unused
+ * @retval never returns
+ */
+static void* latency_signal_thread(void* passArg) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    int signal;
+    while (sigwait(&set, &signal)) {
+        // try again
+    }
+    LineWriter* streamWrite = line_writer_create(STDERR_FILENO);
+    latency_print(streamWrite);
+    line_writer_flush(streamWrite);
+    line_writer_free(streamWrite);
+    _exit(128 + signal);
+}
+
+/**
+ * @brief  starts recording latencies, and reporting them on shutdown
+ * @note   SIGINT and SIGTERM must already be blocked in the calling thread
+ * so every later thread inherits the mask
+ * @retval None
+ */
+void latency_start() {
+    setLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(setLock, SEMA_SHARE_THREAD, 1);
+    pthread_key_create(&setKey, latency_release_set);
+    pthread_t tid;
+    pthread_create(&tid, NULL, latency_signal_thread, NULL);
+    pthread_detach(tid);
+}
@@ -0,0 +1,42 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <semaphore.h>
+#include "lineStream.h"
+
+#define LATENCY_SUB_BITS 4 // 16 linear buckets per power of two, ~3% error
+#define LATENCY_MAX_BITS 36 // samples from ~69s up share the last bucket
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) \
+        << LATENCY_SUB_BITS)
+
+/* what a sample timed */
+typedef enum {
+    LATENCY_ASK = 0, // ? on the mapper
+    LATENCY_ADD = 1, // !
+    LATENCY_ALL = 2, // @
+    LATENCY_VISIT = 3, // a plane visiting a control
+    LATENCY_LOG = 4, // any log
+    LATENCY_LOCK = 5, // wait for a mapper or airport semaphore
+    LATENCY_KINDS = 6,
+    LATENCY_NONE = -1 // a command which is not timed
+} LatencyKind;
+
+/* log-linear nanosecond counts of one thread, which alone writes them */
+typedef struct LatencySet {
+    uint64_t counts[LATENCY_KINDS][LATENCY_BUCKETS];
+    struct LatencySet* next; // every set made, merged by latency_print
+    struct LatencySet* nextFree; // sets of exited threads, reused
+} LatencySet;
+
+void latency_start();
+
+LatencyKind latency_kind(char opcode);
+
+void latency_record(LatencyKind kind, uint64_t nanoseconds);
+
+void latency_lock(sem_t* semaphore);
+
+void latency_print(LineWriter* streamWrite);
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lease.h"
+
+/**
+ * @brief  gets the current time on the lease clock
+ * @retval whole CLOCK_MONOTONIC seconds
+ */
+long lease_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+ * @brief  creates a lease running out ttl seconds from now
+ * @param  airportName: the registered airport (copied)
+ * @param  portNumber: the registered port
+ * @param  ttl: seconds until the lease runs out
+ * @param  node: the mapper trie node holding the registration
+ * @retval newly created lease
+ */
+Lease* lease_create(const char* airportName, long portNumber, long ttl,
+        TrieNode* node) {
+    Lease* lease = (Lease*)malloc(sizeof(Lease));
+    lease->airportName = strdup(airportName);
+    lease->portNumber = portNumber;
+    lease->deadline = lease_now() + ttl;
+    lease->node = node;
+    lease->next = NULL;
+    return lease;
+}
+
+/**
+ * @brief  pushes the deadline to ttl seconds from now
+ * @note   never touches the wheel, so renewals do not take its lock
+ * @param  lease: the lease to renew
+ * @param  ttl: seconds until the lease runs out
+ * @retval None
+ */
+void lease_renew(Lease* lease, long ttl) {
+    __atomic_store_n(&lease->deadline, lease_now() + ttl, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief  checks whether the lease ran out
+ * @param  lease: the lease to check
+ * @param  now: current lease_now()
+ * @retval true if not renewed in time, otherwise false
+ */
+bool lease_expired(Lease* lease, long now) {
+    return __atomic_load_n(&lease->deadline, __ATOMIC_ACQUIRE) <= now;
+}
+
+/**
+ * @brief  frees a lease which is no longer in a wheel
+ * @param  lease: the lease to free
+ * @retval None
+ */
+void lease_free(Lease* lease) {
+    free(lease->airportName);
+    free(lease);
+}
+
+/**
+ * @brief  creates an empty wheel starting at the current second
+ * @retval newly created wheel
+ */
+LeaseWheel* lease_wheel_create() {
+    LeaseWheel* wheel = (LeaseWheel*)malloc(sizeof(LeaseWheel));
+    for (int i = 0; i < LEASE_WHEEL_SLOTS; i++) {
+        wheel->slots[i] = NULL;
+    }
+    wheel->due = NULL;
+    wheel->tick = lease_now();
+    wheel->lock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(wheel->lock, 0, 1);
+    return wheel;
+}
+
+/**
+ * @brief  puts a lease into the slot of its deadline
+ * @note   caller must not hold wheel->lock
+ * @param  wheel: the wheel to add to
+ * @param  lease: the lease to add
+ * @retval None
+ */
+void lease_wheel_add(LeaseWheel* wheel, Lease* lease) {
+    sem_wait(wheel->lock);
+    Lease** slot = &wheel->slots[lease->deadline % LEASE_WHEEL_SLOTS];
+    lease->next = *slot;
+    *slot = lease;
+    sem_post(wheel->lock);
+}
+
+/**
+ * @brief  turns the wheel up to now and moves the leases which ran out 
+ * to its due list, where lease_wheel_take_due finds them
+ * @note   leases renewed since they were added are moved to the slot of
+ * their new deadline instead. Only the slots passed are visited, so the
+ * cost depends on the leases due, not on how many there are.
+ * @param  wheel: the wheel to turn
+ * @param  now: current lease_now()
+ * @retval true if any lease is due, otherwise false
+ */
+bool lease_wheel_due(LeaseWheel* wheel, long now) {
+    sem_wait(wheel->lock);
+    if (now - wheel->tick > LEASE_WHEEL_SLOTS) {
+        wheel->tick = now - LEASE_WHEEL_SLOTS; // each slot once is enough
+    }
+    while (wheel->tick < now) {
+        wheel->tick++;
+        Lease** slot = &wheel->slots[wheel->tick % LEASE_WHEEL_SLOTS];
+        Lease* lease = *slot;
+        *slot = NULL;
+        while (lease != NULL) {
+            Lease* next = lease->next;
+            long deadline = __atomic_load_n(&lease->deadline,
+                    __ATOMIC_ACQUIRE);
+            Lease** target = deadline <= now ? &wheel->due
+                    : &wheel->slots[deadline % LEASE_WHEEL_SLOTS];
+            lease->next = *target;
+            *target = lease;
+            lease = next;
+        }
+    }
+    bool due = wheel->due != NULL;
+    sem_post(wheel->lock);
+    return due;
+}
+
+/**
+ * @brief  takes the next lease off the due list
+ * @note   caller must hold the mapper lock until the lease is re-added 
+ * or freed, so lease_wheel_print never misses it
+ * @param  wheel: the wheel
+ * @retval the lease, NULL once the due list is empty
+ */
+Lease* lease_wheel_take_due(LeaseWheel* wheel) {
+    sem_wait(wheel->lock);
+    Lease* lease = wheel->due;
+    if (lease != NULL) {
+        wheel->due = lease->next;
+    }
+    sem_post(wheel->lock);
+    return lease;
+}
+
+/**
+ * @brief  prints ID:PORT:TTL for each live lease in a list
+ * @param  lease: first lease of the list
+ * @param  now: current lease_now()
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+static void lease_print_list(Lease* lease, long now, 
+        LineWriter* streamWrite) {
+    for (; lease != NULL; lease = lease->next) {
+        long left = __atomic_load_n(&lease->deadline, __ATOMIC_ACQUIRE) 
+                - now;
+        if (lease->node != NULL) {
+            line_writer_printf(streamWrite, "%s:%ld:%ld\n",
+                    lease->airportName, lease->portNumber,
+                    left > 0 ? left : 1);
+        }
+    }
+}
+
+/**
+ * @brief  prints ID:PORT:TTL for each live lease, TTL being the seconds
+ * left (at least 1)
+ * @note   caller must hold the mapper lock so nodes are not dropped. 
+ * Leases on the due list are printed too, a sweep may be part way 
+ * through it and some of them were renewed.
+ * @param  wheel: the wheel to print
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void lease_wheel_print(LeaseWheel* wheel, LineWriter* streamWrite) {
+    long now = lease_now();
+    sem_wait(wheel->lock);
+    for (int i = 0; i < LEASE_WHEEL_SLOTS; i++) {
+        lease_print_list(wheel->slots[i], now, streamWrite);
+    }
+    lease_print_list(wheel->due, now, streamWrite);
+    sem_post(wheel->lock);
+}
@@ -0,0 +1,56 @@
+#ifndef LEASE_H_
+#define LEASE_H_
+#include <stdbool.h>
+#include <semaphore.h>
+#include "lineStream.h"
+#include "trie.h"
+
+#define LEASE_WHEEL_SLOTS 64 // one slot per second, longer leases go round
+#define LEASE_SWEEP_SECONDS 1 // how often the wheel is turned
+#define LEASE_SWEEP_BATCH 64 // expiries applied per hold of the mapper lock
+#define LEASE_RENEWALS 3 // a control renews this many times per lease
+
+/* a registration which lapses unless renewed within ttl seconds */
+struct Lease {
+    char* airportName;
+    long portNumber;
+    long deadline; // second the lease runs out, moved by renewals
+    TrieNode* node; // the registration, NULL once dropped (mapper lock)
+    struct Lease* next; // next lease in the same wheel slot
+};
+typedef struct Lease Lease;
+
+/**
+ * hashed timing wheel holding every lease by deadline % LEASE_WHEEL_SLOTS.
+ * Renewals only move the deadline, the lease is moved to its new slot
+ * when the wheel reaches the old one.
+ */
+typedef struct {
+    Lease* slots[LEASE_WHEEL_SLOTS];
+    Lease* due; // taken out of the slots, still being expired or re-added
+    long tick; // last second swept
+    sem_t* lock; // guards the slots and due, taken after the mapper lock
+} LeaseWheel;
+
+long lease_now();
+
+Lease* lease_create(const char* airportName, long portNumber, long ttl,
+        TrieNode* node);
+
+void lease_renew(Lease* lease, long ttl);
+
+bool lease_expired(Lease* lease, long now);
+
+void lease_free(Lease* lease);
+
+LeaseWheel* lease_wheel_create();
+
+void lease_wheel_add(LeaseWheel* wheel, Lease* lease);
+
+bool lease_wheel_due(LeaseWheel* wheel, long now);
+
+Lease* lease_wheel_take_due(LeaseWheel* wheel);
+
+void lease_wheel_print(LeaseWheel* wheel, LineWriter* streamWrite);
+
+#endif
@@ -0,0 +1,325 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "lineStream.h"
+#include "green.h"
+
+/**
+ * @brief  creates a reader over an already connected socket
+ * @note   the reader does not own the file descriptor
+ * @param  fileDescriptor: socket to read from
+ * @param  maxLineSize: longest line accepted (excluding '\n')
+ * @retval newly created reader
+ */
+LineReader* line_reader_create(int fileDescriptor, size_t maxLineSize) {
+    LineReader* reader = (LineReader*)malloc(sizeof(LineReader));
+    reader->fileDescriptor = fileDescriptor;
+    reader->maxLineSize = maxLineSize;
+    reader->capacity = LINE_READER_INIT_SIZE;
+    if (reader->capacity > maxLineSize + 2) {
+        reader->capacity = maxLineSize + 2; // line, '\n' and '\0'
+    }
+    reader->buffer = (char*)malloc(sizeof(char) * reader->capacity);
+    reader->start = 0;
+    reader->end = 0;
+    reader->scanned = 0;
+    reader->eof = false;
+    reader->capture = NULL;
+    return reader;
+}
+
+/**
+ * @brief  reads more bytes from the socket into the reader buffer
+ * moves unread bytes to the front and grows the buffer (up to the cap)
+ * @param  reader: the reader to fill
+ * @retval number of bytes read, 0 on EOF, -1 on error
+ */
+static ssize_t line_reader_fill(LineReader* reader) {
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start,
+                reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    // always keep one spare byte to terminate the line
+    if (reader->end + 1 >= reader->capacity) {
+        size_t newCapacity = reader->capacity * 2;
+        if (newCapacity > reader->maxLineSize + 2) {
+            newCapacity = reader->maxLineSize + 2;
+        }
+        if (newCapacity > reader->capacity) {
+            reader->buffer = (char*)realloc(reader->buffer, newCapacity);
+            reader->capacity = newCapacity;
+        }
+    }
+
+    ssize_t readSize;
+    do {
+        readSize = read(reader->fileDescriptor, reader->buffer + reader->end,
+                reader->capacity - 1 - reader->end);
+    } while (readSize < 0 && (errno == EINTR || (errno == EAGAIN 
+            && green_wait_fd(reader->fileDescriptor, false))));
+    if (readSize == 0) {
+        reader->eof = true;
+    } else if (readSize > 0) {
+        capture_input(reader->capture, reader->buffer + reader->end, 
+                readSize);
+        reader->end += readSize;
+    }
+    return readSize;
+}
+
+/**
+ * @brief  throws away input until the end of the current (too long) line
+ * @param  reader: the reader to skip on
+ * @retval LINE_TOO_LONG, or LINE_ERROR if the socket failed
+ */
+static LineStatus line_reader_skip_line(LineReader* reader) {
+    while (true) {
+        char* newline = memchr(reader->buffer + reader->start, '\n',
+                reader->end - reader->start);
+        if (newline != NULL) {
+            reader->start = newline - reader->buffer + 1;
+            reader->scanned = 0;
+            return LINE_TOO_LONG;
+        }
+        reader->start = 0;
+        reader->end = 0;
+        reader->scanned = 0;
+        if (reader->eof) {
+            return LINE_TOO_LONG;
+        }
+        if (line_reader_fill(reader) < 0) {
+            return LINE_ERROR;
+        }
+    }
+}
+
+/**
+ * @brief  gets the next line from the socket without copying it
+ * @note   the '\n' is replaced by '\0', the view is valid until the next
+ * call. A final line without '\n' is still returned (complete is false).
+ * @param  reader: the reader to read from
+ * @param  line: filled with a view of the line
+ * @retval LINE_OK, LINE_EOF, LINE_TOO_LONG (line dropped) or LINE_ERROR
+ */
+LineStatus line_reader_next(LineReader* reader, StringView* line) {
+    while (true) {
+        char* searchStart = reader->buffer + reader->start + reader->scanned;
+        size_t unread = reader->end - reader->start;
+        char* newline = memchr(searchStart, '\n', unread - reader->scanned);
+        if (newline != NULL) {
+            size_t length = newline - (reader->buffer + reader->start);
+            newline[0] = '\0';
+            line->data = reader->buffer + reader->start;
+            line->length = length;
+            line->complete = true;
+            reader->start += length + 1;
+            reader->scanned = 0;
+            return LINE_OK;
+        }
+        reader->scanned = unread;
+
+        if (unread > reader->maxLineSize) {
+            return line_reader_skip_line(reader);
+        }
+        if (reader->eof) {
+            if (unread == 0) {
+                return LINE_EOF;
+            }
+            // spare byte is always kept by line_reader_fill
+            reader->buffer[reader->end] = '\0';
+            line->data = reader->buffer + reader->start;
+            line->length = unread;
+            line->complete = false;
+            reader->start = reader->end;
+            reader->scanned = 0;
+            return LINE_OK;
+        }
+        if (line_reader_fill(reader) < 0) {
+            return LINE_ERROR;
+        }
+    }
+}
+
+/**
+ * @brief  frees the reader, the file descriptor is left open
+ * @param  reader: the reader to free
+ * @retval None
+ */
+void line_reader_free(LineReader* reader) {
+    free(reader->buffer);
+    free(reader);
+}
+
+/**
+ * @brief  creates a writer over an already connected socket
+ * @note   the writer does not own the file descriptor
+ * @param  fileDescriptor: socket to write to
+ * @retval newly created writer
+ */
+LineWriter* line_writer_create(int fileDescriptor) {
+    LineWriter* writer = (LineWriter*)malloc(sizeof(LineWriter));
+    writer->fileDescriptor = fileDescriptor;
+    writer->length = 0;
+    writer->sent = 0;
+    writer->failed = false;
+    writer->memory = NULL;
+    writer->memoryLength = 0;
+    writer->memoryCapacity = 0;
+    writer->capture = NULL;
+    return writer;
+}
+
+/**
+ * @brief  creates a writer which keeps everything flushed in memory, for 
+ * servers sending replies themselves (e.g. through io_uring)
+ * @retval newly created writer, take its output with line_writer_take
+ */
+LineWriter* line_writer_create_memory() {
+    return line_writer_create(-1);
+}
+
+/**
+ * @brief  flushes a memory writer and takes everything written so far
+ * @param  writer: a writer from line_writer_create_memory
+ * @param  length: set to the number of bytes taken
+ * @retval the bytes (caller frees), NULL if nothing was written
+ */
+char* line_writer_take(LineWriter* writer, size_t* length) {
+    line_writer_flush(writer);
+    char* memory = writer->memory;
+    *length = writer->memoryLength;
+    writer->memory = NULL;
+    writer->memoryLength = 0;
+    writer->memoryCapacity = 0;
+    return memory;
+}
+
+/**
+ * @brief  keeps bytes a memory writer sends
+ * @param  writer: the memory writer
+ * @param  data: bytes to keep
+ * @param  length: number of bytes
+ * @retval None
+ */
+static void line_writer_keep(LineWriter* writer, const char* data, 
+        size_t length) {
+    if (writer->memoryLength + length > writer->memoryCapacity) {
+        size_t capacity = writer->memoryCapacity ? writer->memoryCapacity 
+                : LINE_WRITER_SIZE;
+        while (capacity < writer->memoryLength + length) {
+            capacity *= 2;
+        }
+        writer->memory = (char*)realloc(writer->memory, capacity);
+        writer->memoryCapacity = capacity;
+    }
+    memcpy(writer->memory + writer->memoryLength, data, length);
+    writer->memoryLength += length;
+    writer->sent += length;
+    capture_output(writer->capture, data, length);
+}
+
+/**
+ * @brief  writes all of the given bytes to the socket
+ * @param  writer: the writer (marked failed on error)
+ * @param  data: bytes to send
+ * @param  length: number of bytes to send
+ * @retval None
+ */
+static void line_writer_send(LineWriter* writer, const char* data,
+        size_t length) {
+    if (writer->fileDescriptor < 0) {
+        line_writer_keep(writer, data, length);
+        return;
+    }
+    while (length > 0 && !writer->failed) {
+        ssize_t sent = write(writer->fileDescriptor, data, length);
+        if (sent < 0) {
+            if (errno == EINTR || (errno == EAGAIN 
+                    && green_wait_fd(writer->fileDescriptor, true))) {
+                continue; // a green thread slept until it could write
+            }
+            writer->failed = true; // peer gone, drop the rest
+            return;
+        }
+        capture_output(writer->capture, data, sent);
+        data += sent;
+        length -= sent;
+        writer->sent += sent;
+    }
+}
+
+/**
+ * @brief  appends bytes to the writer, sending the buffer once it is full
+ * @param  writer: the writer to append to
+ * @param  data: bytes to append
+ * @param  length: number of bytes to append
+ * @retval None
+ */
+void line_writer_write(LineWriter* writer, const char* data, size_t length) {
+    if (writer->length + length > LINE_WRITER_SIZE) {
+        line_writer_flush(writer);
+        if (length > LINE_WRITER_SIZE) {
+            line_writer_send(writer, data, length); // too big to buffer
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+/**
+ * @brief  formatted append, same as fprintf but into the writer
+ * @param  writer: the writer to append to
+ * @param  format: printf style format
+ * @retval None
+ */
+void line_writer_printf(LineWriter* writer, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t space = LINE_WRITER_SIZE - writer->length;
+    int length = vsnprintf(writer->buffer + writer->length, space, format,
+            args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length < space) {
+        writer->length += length;
+        return;
+    }
+
+    // did not fit, format into a temporary buffer instead
+    char* temp = (char*)malloc(sizeof(char) * (length + 1));
+    va_start(args, format);
+    vsnprintf(temp, length + 1, format, args);
+    va_end(args);
+    line_writer_write(writer, temp, length);
+    free(temp);
+}
+
+/**
+ * @brief  sends everything buffered in the writer
+ * @param  writer: the writer to flush
+ * @retval true if the socket is still good, otherwise false
+ */
+bool line_writer_flush(LineWriter* writer) {
+    line_writer_send(writer, writer->buffer, writer->length);
+    writer->length = 0;
+    return !writer->failed;
+}
+
+/**
+ * @brief  flushes and frees the writer, the file descriptor is left open
+ * @param  writer: the writer to free
+ * @retval None
+ */
+void line_writer_free(LineWriter* writer) {
+    line_writer_flush(writer);
+    free(writer->memory);
+    free(writer);
+}
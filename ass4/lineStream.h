@@ -0,0 +1,71 @@
+#ifndef LINE_STREAM_H_
+#define LINE_STREAM_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include "capture.h"
+
+#define LINE_READER_INIT_SIZE 256 // first buffer, grows up to the cap
+#define LINE_WRITER_SIZE 4096 // flushed to the socket once full
+
+/* a view into the reader buffer, only valid until the next read */
+typedef struct {
+    char* data; // always '\0' terminated at data[length]
+    size_t length;
+    bool complete; // false if the line was ended by EOF, not '\n'
+} StringView;
+
+/* result of line_reader_next */
+typedef enum {
+    LINE_OK = 0,
+    LINE_EOF = 1,
+    LINE_TOO_LONG = 2, // line dropped, longer than maxLineSize
+    LINE_ERROR = 3
+} LineStatus;
+
+/* buffered reader working directly on a socket file descriptor */
+typedef struct {
+    int fileDescriptor;
+    char* buffer;
+    size_t capacity;
+    size_t start; // first unread char
+    size_t end; // one past the last buffered char
+    size_t scanned; // chars after start already searched for '\n'
+    size_t maxLineSize; // cap on the length of a line (excluding '\n')
+    bool eof;
+    Capture* capture; // gets everything read, NULL if not captured
+} LineReader;
+
+/* buffered writer which replaces fdopen(fd, "w") */
+typedef struct {
+    int fileDescriptor; // -1 for a writer collecting into memory
+    char buffer[LINE_WRITER_SIZE];
+    size_t length;
+    size_t sent; // bytes written to the socket so far
+    bool failed; // a write to the socket failed, drop further output
+    char* memory; // everything flushed, without a file descriptor
+    size_t memoryLength;
+    size_t memoryCapacity;
+    Capture* capture; // gets everything sent, NULL if not captured
+} LineWriter;
+
+LineReader* line_reader_create(int fileDescriptor, size_t maxLineSize);
+
+LineStatus line_reader_next(LineReader* reader, StringView* line);
+
+void line_reader_free(LineReader* reader);
+
+LineWriter* line_writer_create(int fileDescriptor);
+
+LineWriter* line_writer_create_memory();
+
+char* line_writer_take(LineWriter* writer, size_t* length);
+
+void line_writer_write(LineWriter* writer, const char* data, size_t length);
+
+void line_writer_printf(LineWriter* writer, const char* format, ...);
+
+bool line_writer_flush(LineWriter* writer);
+
+void line_writer_free(LineWriter* writer);
+
+#endif
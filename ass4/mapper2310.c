@@ -5,24 +5,97 @@
 #include <signal.h>
 #include <ctype.h>
 #include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
 #include "shared.h"
 #include "connectionHandler.h"
+#include "trace.h"
+#include "latency.h"
+#include "handoff.h"
 
 #define BUFFER_SIZE 79 // as spec4.1 said max length
 #define LISTEN 15 // max 15 hold thread
 
+/* optional settings given as -x value */
+typedef struct {
+    const char* handoffPath; // -h: unix socket for hot restart, or NULL
+    long maxConnections; // -c: connections served at once
+    long maxExpensive; // -e: @ dumps sent at once
+    const char* tracePath; // -t: SIGUSR1 trace dump file, or NULL
+    const char* capturePath; // -r: traffic capture file, or NULL
+    long registrySlots; // -m: shared memory slots for local rocs
+} MapperOptions;
+
+// Used to pass arguments to bind_and_listen()
+typedef struct {
+    Mapper* mapping;
+    const char* handoffPath;
+    long registrySlots;
+} ListenArgs;
+
 /**
- * @brief  Binds to an unspecified port 
- * prints the port number 
- * and spawns new threads to deal every incomming connection
- * @note   if any error occurs (listen or bind), code exits with 1.
- * must return a void* and take a void* argument
- * @param  passArg: a reference to the local map  
+ * @brief  consumes the -x value options
+ * @param  argc: argument count
+ * @param  argv: run arguments
+ * @param  options: filled with the given options (others left default)
+ * @retval true if all arguments are known options, otherwise false
  */
-void* bind_and_listen(void* passArg) {
+bool parse_options(int argc, char const* argv[], MapperOptions* options) {
+    options->handoffPath = NULL;
+    options->tracePath = NULL;
+    options->capturePath = NULL;
+    options->maxConnections = DEFAULT_MAX_CONNECTIONS;
+    options->maxExpensive = DEFAULT_MAX_EXPENSIVE;
+    options->registrySlots = REGISTRY_SLOTS;
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            return false;
+        }
+        if (!strcmp(argv[i], "-h")) {
+            options->handoffPath = argv[i + 1];
+        } else if (!strcmp(argv[i], "-t")) {
+            options->tracePath = argv[i + 1];
+        } else if (!strcmp(argv[i], "-r")) {
+            options->capturePath = argv[i + 1];
+        } else if (!strcmp(argv[i], "-c")) {
+            options->maxConnections = parse_positive_number(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-e")) {
+            options->maxExpensive = parse_positive_number(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-m")) {
+            options->registrySlots = registry_slot_count(
+                    parse_positive_number(argv[i + 1]));
+        } else {
+            return false;
+        }
+    }
+    // limits must be positive numbers small enough to count in an int
+    return options->maxConnections > 0 && options->maxExpensive > 0 
+            && options->maxConnections <= MAX_CONNECTION_LIMIT 
+            && options->maxExpensive <= MAX_CONNECTION_LIMIT 
+            && options->registrySlots > 0;
+}
+
+/**
+ * @brief  turns the lease wheel once a second, dropping registrations 
+ * which were not renewed in time
+ * @param  passArg: a reference to the local map
+ * @retval never returns
+ */
+void* lease_sweep_thread(void* passArg) {
     Mapper* mapping = (Mapper*)passArg;
+    while (true) {
+        sleep(LEASE_SWEEP_SECONDS);
+        mapping_expire_leases(mapping);
+    }
+    return NULL;
+}
 
+/**
+ * @brief  Binds to an unspecified port and listens on it
+ * @note   if any error occurs (listen or bind), code exits with 1.
+ * @retval the listening socket
+ */
+int create_listen_socket() {
     struct addrinfo* addressInfo = NULL; // get local address info
     struct addrinfo hints;
     // setting the whole structure to zero and 
@@ -44,6 +117,43 @@ void* bind_and_listen(void* passArg) {
             sizeof(struct sockaddr))) {
         exit(1);
     }
+    freeaddrinfo(addressInfo);
+
+    // listen on the socket for incoming connections
+    if (listen(localSocket, LISTEN)) {    
+        exit(1);
+    }
+    return localSocket;
+}
+
+/**
+ * @brief  Binds to an unspecified port (or inherits the port of the old 
+ * mapper on a hot restart), prints the port number 
+ * and spawns new threads to deal every incomming connection
+ * @note   if any error occurs (listen or bind), code exits with 1.
+ * With a handoff path it also waits for a new mapper to take over, then 
+ * hands off, drains and exits with 0.
+ * must return a void* and take a void* argument
+ * @param  passArg: a reference to ListenArgs
+ */
+void* bind_and_listen(void* passArg) {
+    ListenArgs* args = (ListenArgs*)passArg;
+    Mapper* mapping = args->mapping;
+
+    int localSocket = -1;
+    int handoffSocket = -1;
+    if (args->handoffPath != NULL) {
+        localSocket = handoff_receive(args->handoffPath, mapping);
+    }
+    if (localSocket < 0) {
+        localSocket = create_listen_socket();
+    }
+    if (args->handoffPath != NULL) {
+        handoffSocket = handoff_listen(args->handoffPath);
+        if (handoffSocket < 0) {
+            exit(1);
+        }
+    }
 
     // print command port to stdout
     struct sockaddr_in serverAddr;
@@ -57,35 +167,70 @@ void* bind_and_listen(void* passArg) {
     printf("%u\n", port);
     fflush(stdout);
     mapping->port = port;
-    
-    // listen on the socket for incoming connections
-    if (listen(localSocket, LISTEN)) {    
-        exit(1);
-    }
+    mapping_start_registry(mapping, port, args->registrySlots);
 
     // spawn thread to handle new incoming connection
-    int connectionFD;
-    while (connectionFD = accept(localSocket, 0, 0), 
-            connectionFD >= 0) { 
-        handle_connection(mapping, connectionFD);
+    struct pollfd waitFor[2] = {{localSocket, POLLIN, 0}, 
+            {handoffSocket, POLLIN, 0}}; // negative fd is ignored
+    while (poll(waitFor, 2, -1) >= 0) {
+        if (waitFor[1].revents & POLLIN) {
+            int handoffFD = accept(handoffSocket, 0, 0);
+            if (handoffFD < 0) {
+                continue;
+            }
+            // the new mapper owns the path and the port from now on
+            close(handoffSocket);
+            handoff_send(handoffFD, localSocket, mapping);
+            exit(0);
+        }
+        if (waitFor[0].revents & POLLIN) {
+            int connectionFD = accept(localSocket, 0, 0);
+            if (connectionFD >= 0) {
+                handle_connection(mapping, connectionFD);
+            }
+        }
     }
     return NULL;
 } 
 
-int main() {
-    // create Mapper
-    Mapper* mapping = mapping_create();
+int main(int argc, char const* argv[]) {
+    MapperOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        return 1;
+    }
 
     // ignoring/blocking SIGHUP & SIGPIPE signal in multi-threaded program
     sigset_t set; 
     sigemptyset(&set);
     sigaddset(&set, SIGHUP);
     sigaddset(&set, SIGPIPE);
+    sigaddset(&set, SIGUSR1); // only the trace thread takes it
+    sigaddset(&set, SIGINT); // only the latency thread takes these
+    sigaddset(&set, SIGTERM);
     pthread_sigmask(SIG_BLOCK, &set, NULL); // NULL indentical to 0
+    trace_start(options.tracePath, "mapper2310");
+    latency_start();
+    if (options.capturePath != NULL && !capture_start(options.capturePath)) {
+        return 1;
+    }
+
+    connection_set_limits(options.maxConnections, options.maxExpensive);
+
+    // create Mapper
+    Mapper* mapping = mapping_create();
+    trie_start_compactor(mapping->mapperRootTrieNode, mapping->semaphore, 
+            &mapping->trieChanges);
+    pthread_t sweepTid;
+    pthread_create(&sweepTid, NULL, lease_sweep_thread, mapping);
+    pthread_detach(sweepTid);
 
     // create connection handling thread
+    ListenArgs* args = (ListenArgs*)malloc(sizeof(ListenArgs));
+    args->mapping = mapping;
+    args->handoffPath = options.handoffPath;
+    args->registrySlots = options.registrySlots;
     pthread_t tid;
-    pthread_create(&tid, NULL, bind_and_listen, mapping); 
+    pthread_create(&tid, NULL, bind_and_listen, args); 
     // tid: pthread_create will fill out with infor on the thread it creates
 
     // wait till EOF
@@ -96,4 +241,4 @@ int main() {
     // exit(0);
     // pthread_join(tid, NULL); // do i need this?
     pthread_exit(NULL);
-}
\ No newline at end of file
+}
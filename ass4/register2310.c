@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include "shared.h"
+#include "connectionHandler.h"
+
+#define BASE 10
+#define ARGS 2
+#define INIT_AIRPORTS 64
+
+/** An enum
+ * Define exit status 
+ */
+typedef enum {
+    NORMAL_OPERATION = 0,
+    WRONG_ARG_NUMBER = 1,
+    INVALID_MAPPER_PORT = 2,
+    UNABLE_TO_CONNECT_MAPPER = 3,
+    NOT_ALL_REGISTERED = 4
+} Status;
+
+/** 
+ * Output error message for status and return status
+ *	- Returns nothing
+ *	- Prints exit status messages out to stderr(Standard error) 
+ * @param status: output status
+ */
+Status exit_message(Status status) {
+    const char* messages[] = {"", //0
+            "Usage: register2310 mapper < airports\n", //1
+            "Invalid mapper port\n", //2
+            "Failed to connect to mapper\n", //3
+            "Not all airports registered\n"}; //4
+    fputs(messages[status], stderr);
+    return status;
+}
+
+/**
+ * @brief  reads ID:PORT lines from stdin, empty lines are skipped
+ * @param  count: set to the number of lines read
+ * @retval array of copied lines
+ */
+char** read_airports(int* count) {
+    int capacity = INIT_AIRPORTS;
+    char** airports = (char**)malloc(sizeof(char*) * capacity);
+    *count = 0;
+
+    LineReader* streamRead = line_reader_create(STDIN_FILENO, 
+            MAX_LINE_SIZE);
+    StringView line;
+    LineStatus status;
+    while (status = line_reader_next(streamRead, &line), 
+            (status == LINE_OK || status == LINE_TOO_LONG) 
+            && *count < MAX_BULK_SIZE) {
+        if (status == LINE_TOO_LONG || line.length == 0) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            airports = (char**)realloc(airports, sizeof(char*) * capacity);
+        }
+        airports[(*count)++] = strdup(line.data);
+    }
+    line_reader_free(streamRead);
+    return airports;
+}
+
+/**
+ * @brief  frees the lines read by read_airports
+ * @param  airports: the lines
+ * @param  count: number of lines
+ * @retval None
+ */
+void free_airports(char** airports, int count) {
+    for (int i = 0; i < count; i++) {
+        free(airports[i]);
+    }
+    free(airports);
+}
+
+/**
+ * @brief  sends all airports to the mapper as one & message
+ * @param  fileDescriptor: connection to the mapper
+ * @param  airports: ID:PORT lines to register
+ * @param  count: number of lines
+ * @retval number of airports the mapper stored, -1 if no reply
+ */
+int send_bulk_message(int fileDescriptor, char** airports, int count) {
+    LineReader* streamRead = line_reader_create(fileDescriptor, 
+            MAX_LINE_SIZE);
+    LineWriter* streamWrite = line_writer_create(fileDescriptor);
+
+    line_writer_printf(streamWrite, "&%d\n", count);
+    for (int i = 0; i < count; i++) {
+        line_writer_printf(streamWrite, "%s\n", airports[i]);
+    }
+    line_writer_flush(streamWrite);
+
+    int applied = -1;
+    StringView line;
+    if (line_reader_next(streamRead, &line) == LINE_OK 
+            && line.data[0] == '&') {
+        applied = atoi(line.data + 1);
+    }
+
+    // connection terminated
+    line_reader_free(streamRead);
+    line_writer_free(streamWrite);
+    close(fileDescriptor);
+    return applied;
+}
+
+int main(int argc, char const* argv[]) {
+    if (argc != ARGS) {
+        return exit_message(WRONG_ARG_NUMBER);
+    }
+    char* mappingPortError;
+    long mappingPort = strtol(argv[1], &mappingPortError, BASE);
+    if (*mappingPortError != '\0' || mappingPort <= 0 
+            || mappingPort > MAXMI_VALID_PORT) {
+        return exit_message(INVALID_MAPPER_PORT);
+    }
+
+    // ignoring/blocking SIGPIPE if the mapper goes away
+    sigset_t set; 
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+
+    int count;
+    char** airports = read_airports(&count);
+    if (count == 0) {
+        free(airports);
+        return exit_message(NORMAL_OPERATION); // nothing to register
+    }
+
+    int fileDescriptor = connect_to_port(argv[1]);
+    if (fileDescriptor == -1) {
+        free_airports(airports, count);
+        return exit_message(UNABLE_TO_CONNECT_MAPPER);
+    }
+    int applied = send_bulk_message(fileDescriptor, airports, count);
+    printf("%d\n", applied < 0 ? 0 : applied);
+    fflush(stdout);
+
+    free_airports(airports, count);
+    if (applied != count) {
+        return exit_message(NOT_ALL_REGISTERED);
+    }
+    return exit_message(NORMAL_OPERATION);
+}
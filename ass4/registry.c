@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "registry.h"
+#include "lease.h"
+
+#define REGISTRY_PATH_SIZE 32
+
+/**
+ * @brief  gets the shared memory name of the mapper on port
+ * @param  path: filled with the name
+ * @param  port: the mapper's port
+ * @retval None
+ */
+static void registry_path(char path[REGISTRY_PATH_SIZE], uint16_t port) {
+    snprintf(path, REGISTRY_PATH_SIZE, "/mapper2310.%u", port);
+}
+
+/**
+ * @brief  gets the size of a segment with a number of slots
+ * @param  slots: the number of slots
+ * @retval size in bytes
+ */
+static size_t registry_size(uint32_t slots) {
+    return sizeof(RegistryTable) + sizeof(RegistrySlot) * (size_t)slots;
+}
+
+/**
+ * @brief  hashes a name (FNV-1a)
+ * @param  table: the table the name goes in
+ * @param  name: the name to hash
+ * @retval the first slot to probe
+ */
+static unsigned registry_hash(RegistryTable* table, const char* name) {
+    uint32_t hash = 2166136261u;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash & (table->slotCount - 1);
+}
+
+/**
+ * @brief  gets the number of slots a segment is made with, e.g. for -m
+ * @param  wanted: the number of slots asked for
+ * @retval wanted rounded up to a power of 2, -1 if it is not positive or 
+ * more than REGISTRY_MAX_SLOTS
+ */
+long registry_slot_count(long wanted) {
+    if (wanted <= 0 || wanted > REGISTRY_MAX_SLOTS) {
+        return -1;
+    }
+    long slots = 1;
+    while (slots < wanted) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+/**
+ * @brief  creates the segment of the mapper on port, replacing one left
+ * by an earlier mapper on the same port
+ * @param  port: the mapper's port
+ * @param  slots: number of slots, from registry_slot_count
+ * @retval newly created registry, NULL if shared memory is not available
+ */
+Registry* registry_create(uint16_t port, long slots) {
+    char path[REGISTRY_PATH_SIZE];
+    registry_path(path, port);
+    shm_unlink(path); // readers still mapping the old one keep it
+    int segment = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (segment < 0) {
+        return NULL;
+    }
+    size_t size = registry_size(slots);
+    void* mapping = MAP_FAILED;
+    if (!ftruncate(segment, size)) {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, 
+                segment, 0);
+    }
+    close(segment);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(path);
+        return NULL;
+    }
+    Registry* registry = (Registry*)malloc(sizeof(Registry));
+    registry->table = (RegistryTable*)mapping; // zero filled
+    registry->size = size;
+    registry->table->slotCount = slots;
+    registry->table->owner = getpid();
+    __atomic_store_n(&registry->table->magic, REGISTRY_MAGIC,
+            __ATOMIC_RELEASE);
+    return registry;
+}
+
+/**
+ * @brief  maps the segment of the mapper on port read only
+ * @param  port: the mapper's port
+ * @retval the registry, NULL if there is none or its mapper is gone
+ */
+Registry* registry_open(uint16_t port) {
+    char path[REGISTRY_PATH_SIZE];
+    registry_path(path, port);
+    int segment = shm_open(path, O_RDONLY, 0);
+    if (segment < 0) {
+        return NULL;
+    }
+    struct stat status;
+    void* mapping = MAP_FAILED;
+    if (!fstat(segment, &status)
+            && (size_t)status.st_size >= sizeof(RegistryTable)) {
+        mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED,
+                segment, 0);
+    }
+    close(segment);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    Registry* registry = (Registry*)malloc(sizeof(Registry));
+    registry->table = (RegistryTable*)mapping;
+    registry->size = status.st_size;
+    RegistryTable* table = registry->table;
+    if (__atomic_load_n(&table->magic, __ATOMIC_ACQUIRE) != REGISTRY_MAGIC
+            || registry_slot_count(table->slotCount) != table->slotCount
+            || registry_size(table->slotCount) != registry->size
+            || (kill(table->owner, 0) && errno == ESRCH)) {
+        registry_close(registry); // unfinished, or its mapper was killed
+        return NULL;
+    }
+    return registry;
+}
+
+/**
+ * @brief  finds the slot of name, or the empty slot it would go in
+ * @param  table: the table to search
+ * @param  name: the name to find
+ * @retval the slot, NULL if name is not there and the table is full
+ */
+static RegistrySlot* registry_find(RegistryTable* table, const char* name) {
+    unsigned index = registry_hash(table, name);
+    for (uint32_t probe = 0; probe < table->slotCount; probe++) {
+        RegistrySlot* slot = &table->slots[index];
+        if (slot->name[0] == '\0' || !strcmp(slot->name, name)) {
+            return slot;
+        }
+        index = (index + 1) & (table->slotCount - 1);
+    }
+    return NULL;
+}
+
+/**
+ * @brief  publishes the registration of an airport, caller must hold the
+ * mapper lock (the only writer)
+ * @note   names too long for a slot, or past 3/4 of the slots, are left
+ * to the TCP path. The first registration left out because the table is 
+ * full is logged to stderr, as a hint to restart with a larger -m.
+ * @param  registry: the mapper's registry
+ * @param  name: the airport
+ * @param  port: its port, 0 once dropped
+ * @param  deadline: lease_now() second its lease runs out, 0 for never
+ * @retval None
+ */
+void registry_publish(Registry* registry, const char* name, long port,
+        long deadline) {
+    RegistryTable* table = registry->table;
+    RegistrySlot* slot = NULL;
+    if (strlen(name) < REGISTRY_NAME_SIZE) {
+        slot = registry_find(table, name);
+    }
+    bool adding = slot != NULL && slot->name[0] == '\0';
+    if (adding && port == 0) {
+        slot = NULL; // nothing to drop
+    } else if (adding && table->used >= table->slotCount / 4 * 3) {
+        slot = NULL; // keep probe chains short
+        if (!table->overflow) {
+            fprintf(stderr, "Registry full at %u airports, others are "
+                    "only answered over TCP\n", table->used);
+        }
+    }
+    if (slot == NULL && (port == 0 || table->overflow)) {
+        return;
+    }
+
+    uint32_t sequence = table->sequence;
+    __atomic_store_n(&table->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // odd before the writes
+    if (slot == NULL) {
+        table->overflow = true;
+    } else {
+        if (adding) {
+            strcpy(slot->name, name);
+            table->used++;
+        }
+        slot->port = port;
+        slot->deadline = deadline;
+    }
+    __atomic_store_n(&table->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief  looks an airport up with plain memory reads
+ * @param  registry: a registry from registry_open
+ * @param  name: the airport
+ * @retval its port, 0 if it is not registered (or its lease ran out),
+ * REGISTRY_UNKNOWN if the mapper has to be asked
+ */
+long registry_lookup(Registry* registry, const char* name) {
+    RegistryTable* table = registry->table;
+    if (strlen(name) >= REGISTRY_NAME_SIZE) {
+        return REGISTRY_UNKNOWN;
+    }
+    for (int try = 0; try < REGISTRY_READ_TRIES; try++) {
+        uint32_t before = __atomic_load_n(&table->sequence,
+                __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue; // mid write
+        }
+        RegistrySlot* slot = registry_find(table, name);
+        bool found = slot != NULL && slot->name[0] != '\0';
+        long port = found ? slot->port : 0;
+        long deadline = found ? slot->deadline : 0;
+        bool overflow = table->overflow;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE); // reads before the check
+        if (__atomic_load_n(&table->sequence, __ATOMIC_RELAXED) != before) {
+            continue; // torn, read again
+        }
+        if (!found) {
+            return overflow ? REGISTRY_UNKNOWN : 0;
+        }
+        if (deadline != 0 && deadline <= lease_now()) {
+            return 0; // ran out, the sweep has not got to it yet
+        }
+        return port;
+    }
+    return REGISTRY_UNKNOWN;
+}
+
+/**
+ * @brief  gets the name of the slot counting the airports of a port, ':' 
+ * is never part of an airport name, so it can not be mistaken for one
+ * @param  name: filled with ":PORT"
+ * @param  port: the port
+ * @retval None
+ */
+void registry_port_name(char name[REGISTRY_NAME_SIZE], long port) {
+    snprintf(name, REGISTRY_NAME_SIZE, ":%ld", port);
+}
+
+/**
+ * @brief  unmaps the segment (it stays for other readers)
+ * @param  registry: the registry to free
+ * @retval None
+ */
+void registry_close(Registry* registry) {
+    munmap(registry->table, registry->size);
+    free(registry);
+}
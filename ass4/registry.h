@@ -0,0 +1,60 @@
+#ifndef REGISTRY_H_
+#define REGISTRY_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define REGISTRY_MAGIC 0x32333130 // "2310", marks a finished segment
+#define REGISTRY_SLOTS 4096 // hash slots by default (power of 2)
+#define REGISTRY_MAX_SLOTS (1 << 22) // most slots -m may ask for
+#define REGISTRY_NAME_SIZE 64 // longest published name plus the '\0'
+#define REGISTRY_READ_TRIES 64 // seqlock retries before asking over TCP
+#define REGISTRY_UNKNOWN -1 // lookup could not tell, ask the mapper
+
+/**
+ * one airport in the segment, port 0 once it was dropped. A port hosting 
+ * several airports also has a slot named ":PORT" holding their count.
+ */
+typedef struct {
+    char name[REGISTRY_NAME_SIZE]; // "" if the slot was never used
+    int32_t port;
+    int64_t deadline; // lease_now() second the lease runs out, 0 for never
+} RegistrySlot;
+
+/**
+ * the shared memory segment a mapper publishes its registrations in.
+ * Only the mapper writes (under its lock), readers retry while sequence
+ * is odd or moved during their read.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence; // seqlock, odd while the mapper is writing
+    pid_t owner; // the mapper, readers ignore a segment it left behind
+    uint32_t slotCount; // power of 2, fixed when the segment is made
+    uint32_t used; // slots holding a name
+    bool overflow; // a name did not fit, misses are not final
+    RegistrySlot slots[]; // open addressing, linear probing
+} RegistryTable;
+
+/* a mapping of a mapper's segment */
+typedef struct {
+    RegistryTable* table;
+    size_t size; // bytes mapped
+} Registry;
+
+long registry_slot_count(long wanted);
+
+Registry* registry_create(uint16_t port, long slots);
+
+Registry* registry_open(uint16_t port);
+
+void registry_publish(Registry* registry, const char* name, long port,
+        long deadline);
+
+long registry_lookup(Registry* registry, const char* name);
+
+void registry_port_name(char name[REGISTRY_NAME_SIZE], long port);
+
+void registry_close(Registry* registry);
+
+#endif
@@ -0,0 +1,433 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/socket.h>
+#include "shared.h"
+#include "connectionHandler.h"
+#include "trace.h"
+
+#define SEMA_SHARE_THREAD 0
+#define NS_PER_US 1000
+#define NS_PER_MS 1000000
+#define NS_PER_SECOND 1000000000ULL
+#define REPLAY_TIMEOUT_MS 5000 // longest wait for a reply the capture had
+#define REPLAY_READ_SIZE 65536
+#define REPLAY_INIT_SIZE 16
+#define REPLAY_SHOWN_MISMATCHES 10 // connections listed by id
+
+/** An enum
+ * Define exit status
+ */
+typedef enum {
+    NORMAL_OPERATION = 0,
+    WRONG_ARG_NUMBER = 1,
+    INVALID_CAPTURE = 2,
+    INVALID_PORT = 3,
+    REPLAY_DIFFERED = 4
+} Status;
+
+/* one captured input of a connection */
+typedef struct {
+    uint64_t time; // microseconds into the capture
+    const char* data; // bytes to send
+    uint64_t length;
+    uint64_t answered; // reply bytes in all once answered, 0 if never
+} ReplayEvent;
+
+/* a captured connection and what replaying it found */
+typedef struct {
+    unsigned long id;
+    uint64_t openTime; // microseconds into the capture
+    uint64_t closeTime;
+    ReplayEvent* events;
+    int eventCount;
+    int eventCapacity;
+    uint64_t replied; // reply bytes in the capture so far, while loading
+    bool closed; // the capture saw it end, so its replies can be checked
+    uint64_t outLength; // bytes the server sent in the capture
+    uint64_t outHash;
+    uint64_t received; // bytes the server sent on replay
+    bool refused; // could not connect
+    bool mismatch;
+} ReplayConnection;
+
+/* the socket of a connection being replayed */
+typedef struct {
+    int fileDescriptor;
+    uint64_t received;
+    uint64_t hash; // capture_hash of everything received
+    bool eof;
+} ReplaySocket;
+
+// replay settings, set before any connection starts
+static const char* targetPort;
+static double speed; // 1 as captured, N times faster, 0 as fast as possible
+static uint64_t replayStart; // trace_now() the replay started
+
+// latencies in nanoseconds of inputs answered on replay, guarded by lock
+static sem_t* latencyLock;
+static uint64_t* latencies;
+static size_t latencyCount = 0;
+static size_t latencyCapacity = 0;
+
+/**
+ * Output error message for status and return status
+ *	- Returns nothing
+ *	- Prints exit status messages out to stderr(Standard error)
+ * @param status: output status
+ */
+Status exit_message(Status status) {
+    const char* messages[] = {"", //0
+            "Usage: replay2310 [-s speed] capture port\n", //1
+            "Can not read capture\n", //2
+            "Invalid port\n", //3
+            ""}; //4 (differences are in the report)
+    fputs(messages[status], stderr);
+    return status;
+}
+
+/**
+ * @brief  gets when a moment of the capture comes round on replay
+ * @param  time: microseconds into the capture
+ * @retval the trace_now() it is due, 0 (always due) when unthrottled
+ */
+uint64_t replay_due(uint64_t time) {
+    if (speed == 0) {
+        return 0;
+    }
+    return replayStart + (uint64_t)(time * NS_PER_US / speed);
+}
+
+/**
+ * @brief  sleeps until a moment of the capture comes round on replay
+ * @param  time: microseconds into the capture
+ * @retval None
+ */
+void replay_wait_until(uint64_t time) {
+    uint64_t target = replay_due(time);
+    struct timespec wake = {target / NS_PER_SECOND, target % NS_PER_SECOND};
+    while (target != 0 && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+            &wake, NULL) == EINTR) {
+        // woken by a signal, sleep the rest
+    }
+}
+
+/**
+ * @brief  reads whatever the server sent, without blocking
+ * @param  peer: the connection, eof set once the server hung up
+ * @retval None
+ */
+void replay_read(ReplaySocket* peer) {
+    char buffer[REPLAY_READ_SIZE];
+    ssize_t readSize;
+    while (readSize = recv(peer->fileDescriptor, buffer, sizeof(buffer),
+            MSG_DONTWAIT), readSize > 0) {
+        peer->received += readSize;
+        peer->hash = capture_hash(peer->hash, buffer, readSize);
+    }
+    if (readSize == 0 || (errno != EAGAIN && errno != EWOULDBLOCK 
+            && errno != EINTR)) {
+        peer->eof = true;
+    }
+}
+
+/**
+ * @brief  notes how long an input took to be answered
+ * @param  latency: nanoseconds from sending it to the last reply byte
+ * @retval None
+ */
+void replay_record_latency(uint64_t latency) {
+    sem_wait(latencyLock);
+    if (latencyCount == latencyCapacity) {
+        latencyCapacity = latencyCapacity ? latencyCapacity * 2
+                : REPLAY_INIT_SIZE;
+        latencies = (uint64_t*)realloc(latencies,
+                sizeof(uint64_t) * latencyCapacity);
+    }
+    latencies[latencyCount++] = latency;
+    sem_post(latencyLock);
+}
+
+/**
+ * @brief  replays one connection: each input is sent at its (scaled)
+ * time without waiting for replies, while the replies are read as they
+ * come. An input is answered once the server sent as many bytes in all 
+ * as it had in the capture when that input's replies were done.
+ * @param  passArg: the ReplayConnection
+ * @retval NULL
+ */
+void* replay_thread(void* passArg) {
+    ReplayConnection* connection = (ReplayConnection*)passArg;
+    ReplaySocket peer = {connect_to_port(targetPort), 0, CAPTURE_HASH_INIT,
+            false};
+    if (peer.fileDescriptor < 0) {
+        connection->refused = true;
+        return NULL;
+    }
+    // inputs sent and waiting for their replies, in the order sent
+    int* waiting = (int*)malloc(sizeof(int) * (connection->eventCount + 1));
+    uint64_t* sentTimes = (uint64_t*)malloc(sizeof(uint64_t) 
+            * (connection->eventCount + 1));
+    int waitingHead = 0, waitingTail = 0;
+    int next = 0; // next input to send
+    uint64_t offset = 0; // bytes of it sent so far
+    while (!peer.eof) {
+        uint64_t now = trace_now();
+        ReplayEvent* event = next < connection->eventCount 
+                ? &connection->events[next] : NULL;
+        uint64_t due = replay_due(event != NULL ? event->time 
+                : connection->closeTime);
+        if (event == NULL && waitingHead == waitingTail && due <= now) {
+            break; // everything sent and answered, the client hangs up
+        }
+        bool sending = event != NULL && due <= now;
+        int timeout = REPLAY_TIMEOUT_MS;
+        if (due > now && (due - now) / NS_PER_MS < REPLAY_TIMEOUT_MS) {
+            timeout = (due - now) / NS_PER_MS + 1;
+        }
+        struct pollfd waitFor = {peer.fileDescriptor, 
+                POLLIN | (sending ? POLLOUT : 0), 0};
+        int ready = poll(&waitFor, 1, timeout);
+        if (ready == 0 && event == NULL && due <= now) {
+            break; // replies the capture had never came
+        }
+        if (waitFor.revents & (POLLIN | POLLHUP | POLLERR)) {
+            replay_read(&peer);
+            now = trace_now();
+            while (waitingHead < waitingTail && peer.received 
+                    >= connection->events[waiting[waitingHead]].answered) {
+                replay_record_latency(now - sentTimes[waitingHead++]);
+            }
+        }
+        if (sending && (waitFor.revents & POLLOUT)) {
+            ssize_t sent = send(peer.fileDescriptor, event->data + offset,
+                    event->length - offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0 && errno != EAGAIN && errno != EINTR) {
+                break;
+            }
+            offset += sent > 0 ? sent : 0;
+            if (offset == event->length) {
+                if (event->answered > 0) {
+                    waiting[waitingTail] = next;
+                    sentTimes[waitingTail++] = trace_now();
+                }
+                next++;
+                offset = 0;
+            }
+        }
+    }
+    free(waiting);
+    free(sentTimes);
+
+    // the rest of the replies, until the server hangs up or goes quiet
+    shutdown(peer.fileDescriptor, SHUT_WR);
+    struct pollfd waitFor = {peer.fileDescriptor, POLLIN, 0};
+    while (!peer.eof && poll(&waitFor, 1, REPLAY_TIMEOUT_MS) > 0) {
+        replay_read(&peer);
+    }
+    close(peer.fileDescriptor);
+    connection->received = peer.received;
+    connection->mismatch = connection->closed
+            && (peer.received != connection->outLength
+            || peer.hash != connection->outHash);
+    return NULL;
+}
+
+/**
+ * @brief  gets a connection of the capture, creating it on first use
+ * @param  connections: connections by id, grown as needed
+ * @param  capacity: size of connections
+ * @param  id: the connection's id
+ * @retval the connection
+ */
+ReplayConnection* replay_connection(ReplayConnection*** connections,
+        unsigned long* capacity, unsigned long id) {
+    if (id >= *capacity) {
+        unsigned long newCapacity = *capacity ? *capacity : REPLAY_INIT_SIZE;
+        while (id >= newCapacity) {
+            newCapacity *= 2;
+        }
+        *connections = (ReplayConnection**)realloc(*connections,
+                sizeof(ReplayConnection*) * newCapacity);
+        memset(*connections + *capacity, 0,
+                sizeof(ReplayConnection*) * (newCapacity - *capacity));
+        *capacity = newCapacity;
+    }
+    if ((*connections)[id] == NULL) {
+        (*connections)[id] = (ReplayConnection*)
+                calloc(1, sizeof(ReplayConnection));
+        (*connections)[id]->id = id;
+    }
+    return (*connections)[id];
+}
+
+/**
+ * @brief  sorts the connections of a capture into their events
+ * @param  reader: the capture
+ * @param  count: set to one past the highest connection id
+ * @retval connections by id, NULL where an id was not captured
+ */
+ReplayConnection** replay_load(CaptureReader* reader, unsigned long* count) {
+    ReplayConnection** connections = NULL;
+    unsigned long capacity = 0;
+    CaptureRecord record;
+    *count = 0;
+    while (capture_reader_next(reader, &record)) {
+        ReplayConnection* connection = replay_connection(&connections,
+                &capacity, record.id);
+        *count = record.id + 1 > *count ? record.id + 1 : *count;
+        if (record.tag == CAPTURE_OPEN) {
+            connection->openTime = record.time;
+        } else if (record.tag == CAPTURE_REPLY) {
+            connection->replied += record.length;
+            if (connection->eventCount > 0) {
+                connection->events[connection->eventCount - 1].answered 
+                        = connection->replied;
+            }
+        } else if (record.tag == CAPTURE_CLOSE) {
+            connection->closed = true;
+            connection->closeTime = record.time;
+            connection->outLength = record.length;
+            connection->outHash = record.hash;
+        } else {
+            if (connection->eventCount == connection->eventCapacity) {
+                connection->eventCapacity = connection->eventCapacity
+                        ? connection->eventCapacity * 2 : REPLAY_INIT_SIZE;
+                connection->events = (ReplayEvent*)realloc(
+                        connection->events, sizeof(ReplayEvent)
+                        * connection->eventCapacity);
+            }
+            ReplayEvent event = {record.time, record.data, record.length,
+                    0};
+            connection->events[connection->eventCount++] = event;
+        }
+    }
+    return connections;
+}
+
+/**
+ * @brief  comparator for qsort
+ * @retval order of two latencies
+ */
+int compare_latency(const void* a, const void* b) {
+    uint64_t left = *(const uint64_t*)a;
+    uint64_t right = *(const uint64_t*)b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief  prints what the replay found
+ * @param  connections: connections by id
+ * @param  count: one past the highest id
+ * @param  elapsed: nanoseconds the replay took
+ * @retval NORMAL_OPERATION, or REPLAY_DIFFERED if a connection was
+ * refused or answered differently
+ */
+Status replay_report(ReplayConnection** connections, unsigned long count,
+        uint64_t elapsed) {
+    unsigned long replayed = 0, refused = 0, mismatched = 0, unchecked = 0;
+    for (unsigned long id = 0; id < count; id++) {
+        ReplayConnection* connection = connections[id];
+        if (connection == NULL) {
+            continue;
+        }
+        replayed++;
+        refused += connection->refused;
+        unchecked += !connection->closed;
+        if (connection->mismatch
+                && ++mismatched <= REPLAY_SHOWN_MISMATCHES) {
+            printf("mismatch %lu: %lu bytes captured, %lu replayed\n", id,
+                    (unsigned long)connection->outLength,
+                    (unsigned long)connection->received);
+        }
+    }
+    printf("connections %lu refused %lu unchecked %lu mismatched %lu\n",
+            replayed, refused, unchecked, mismatched);
+    printf("elapsed %.3fs answered %zu\n", (double)elapsed / NS_PER_SECOND,
+            latencyCount);
+    if (latencyCount > 0) {
+        qsort(latencies, latencyCount, sizeof(uint64_t), compare_latency);
+        const int permille[] = {500, 900, 990, 999, 1000};
+        const char* names[] = {"p50", "p90", "p99", "p99.9", "max"};
+        printf("latency us");
+        for (int i = 0; i < 5; i++) {
+            size_t index = (latencyCount - 1) * permille[i] / 1000;
+            printf(" %s %.1f", names[i],
+                    (double)latencies[index] / NS_PER_US);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+    return refused || mismatched ? REPLAY_DIFFERED : NORMAL_OPERATION;
+}
+
+int main(int argc, char const* argv[]) {
+    speed = 1;
+    int first = 1;
+    if (argc == 5 && !strcmp(argv[1], "-s")) {
+        char* speedErr;
+        speed = strtod(argv[2], &speedErr);
+        if (*speedErr != '\0' || speed < 0) {
+            return exit_message(WRONG_ARG_NUMBER);
+        }
+        first = 3;
+    } else if (argc != 3) {
+        return exit_message(WRONG_ARG_NUMBER);
+    }
+    char* portErr;
+    long port = strtol(argv[first + 1], &portErr, 10);
+    if (*portErr != '\0' || port <= 0 || port > MAXMI_VALID_PORT) {
+        return exit_message(INVALID_PORT);
+    }
+    targetPort = argv[first + 1];
+    CaptureReader* reader = capture_reader_open(argv[first]);
+    if (reader == NULL) {
+        return exit_message(INVALID_CAPTURE);
+    }
+    unsigned long count;
+    ReplayConnection** connections = replay_load(reader, &count);
+
+    signal(SIGPIPE, SIG_IGN);
+    latencyLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(latencyLock, SEMA_SHARE_THREAD, 1);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * count);
+    bool* started = (bool*)calloc(count, sizeof(bool));
+    replayStart = trace_now();
+
+    // connections start in the order they were accepted
+    for (unsigned long id = 0; id < count; id++) {
+        if (connections[id] != NULL) {
+            replay_wait_until(connections[id]->openTime);
+            started[id] = !pthread_create(&threads[id], NULL, replay_thread,
+                    connections[id]);
+            connections[id]->refused = !started[id];
+        }
+    }
+    for (unsigned long id = 0; id < count; id++) {
+        if (started[id]) {
+            pthread_join(threads[id], NULL);
+        }
+    }
+    Status status = replay_report(connections, count,
+            trace_now() - replayStart);
+
+    for (unsigned long id = 0; id < count; id++) {
+        if (connections[id] != NULL) {
+            free(connections[id]->events);
+            free(connections[id]);
+        }
+    }
+    free(connections);
+    free(threads);
+    free(started);
+    free(latencies);
+    capture_reader_free(reader);
+    return exit_message(status);
+}
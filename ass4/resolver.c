@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "resolver.h"
+#include "shared.h"
+#include "connectionHandler.h"
+
+/**
+ * A non-zero value means the semaphore is shared between processes
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+#define RESOLVER_ASK_TRIES 2 // a mapper connection found closed is redone
+
+/**
+ * @brief  creates a resolver, looking localhost up once for every
+ * connection it will make
+ * @param  mapperPort: port of the mapper, 0 if destinations are all ports
+ * @retval newly created resolver, NULL if localhost can not be looked up
+ */
+Resolver* resolver_create(long mapperPort) {
+    struct addrinfo* addressInfo = NULL;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo("localhost", NULL, &hints, &addressInfo)) {
+        return NULL;
+    }
+    Resolver* resolver = (Resolver*)malloc(sizeof(Resolver));
+    memcpy(&resolver->address, addressInfo->ai_addr,
+            sizeof(struct sockaddr_in));
+    freeaddrinfo(addressInfo);
+    resolver->mapperPort = mapperPort;
+    resolver->registry = mapperPort != 0 ? registry_open(mapperPort) : NULL;
+    resolver->mapperFD = -1;
+    resolver->mapperRead = NULL;
+    resolver->mapperWrite = NULL;
+    resolver->askPorts = true;
+    resolver->mapperLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(resolver->mapperLock, SEMA_SHARE_THREAD, 1);
+    resolver->cache = trie_create();
+    resolver->cacheLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(resolver->cacheLock, SEMA_SHARE_THREAD, 1);
+    return resolver;
+}
+
+/**
+ * @brief  connects to a port on localhost without looking it up again
+ * @param  resolver: the resolver
+ * @param  port: the port
+ * @retval file descriptor of the connection, -1 if it was refused
+ */
+int resolver_connect(Resolver* resolver, long port) {
+    struct sockaddr_in address = resolver->address;
+    address.sin_port = htons((uint16_t)port);
+    int fileDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fileDescriptor, (struct sockaddr*)&address,
+            sizeof(struct sockaddr_in))) {
+        close(fileDescriptor);
+        return -1;
+    }
+    return fileDescriptor;
+}
+
+/**
+ * @brief  starts connecting to a port on localhost without waiting, the
+ * socket becomes writable once the connect finished (or failed)
+ * @param  resolver: the resolver
+ * @param  port: the port
+ * @retval non-blocking file descriptor, -1 if the connect failed at once
+ */
+int resolver_connect_start(Resolver* resolver, long port) {
+    struct sockaddr_in address = resolver->address;
+    address.sin_port = htons((uint16_t)port);
+    int fileDescriptor = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (connect(fileDescriptor, (struct sockaddr*)&address,
+            sizeof(struct sockaddr_in)) && errno != EINPROGRESS) {
+        close(fileDescriptor);
+        return -1;
+    }
+    return fileDescriptor;
+}
+
+/**
+ * @brief  drops the mapper connection, the next question opens another
+ * @note   caller must hold mapperLock
+ * @param  resolver: the resolver
+ * @retval None
+ */
+static void resolver_disconnect_mapper(Resolver* resolver) {
+    if (resolver->mapperFD >= 0) {
+        line_reader_free(resolver->mapperRead);
+        line_writer_free(resolver->mapperWrite);
+        close(resolver->mapperFD);
+        resolver->mapperFD = -1;
+    }
+}
+
+/**
+ * @brief  asks the mapper for an airport with ?ID on the kept connection
+ * @note   caller must hold mapperLock
+ * @param  resolver: the resolver
+ * @param  airportId: the airport
+ * @param  port: set to its port
+ * @retval RESOLVE_OK, RESOLVE_NO_ENTRY or RESOLVE_MAPPER_FAILED
+ */
+static ResolveStatus resolver_ask(Resolver* resolver, const char* airportId,
+        long* port) {
+    StringView line;
+    for (int try = 0; try < RESOLVER_ASK_TRIES; try++) {
+        if (resolver->mapperFD < 0) {
+            resolver->mapperFD = resolver_connect(resolver,
+                    resolver->mapperPort);
+            if (resolver->mapperFD < 0) {
+                return RESOLVE_MAPPER_FAILED;
+            }
+            resolver->mapperRead = line_reader_create(resolver->mapperFD,
+                    RESOLVER_LINE_SIZE);
+            resolver->mapperWrite = line_writer_create(resolver->mapperFD);
+        }
+        line_writer_printf(resolver->mapperWrite, "?%s\n", airportId);
+        if (line_writer_flush(resolver->mapperWrite)
+                && line_reader_next(resolver->mapperRead, &line) == LINE_OK) {
+            if (!strcmp(line.data, ";")) {
+                return RESOLVE_NO_ENTRY;
+            }
+            char* portError;
+            *port = strtol(line.data, &portError, 10);
+            if (*portError == '\0' && *port > 0
+                    && *port <= MAXMI_VALID_PORT) {
+                return RESOLVE_OK;
+            }
+        } // otherwise closed (or BUSY) since the last question
+        resolver_disconnect_mapper(resolver);
+    }
+    return RESOLVE_MAPPER_FAILED;
+}
+
+/**
+ * @brief  asks the mapper how many airports share a port with $PORT on 
+ * the kept connection
+ * @note   caller must hold mapperLock. The reply is waited for at most 
+ * PORT_QUESTION_TIMEOUT_MS, after which the mapper is not asked again.
+ * @param  resolver: the resolver
+ * @param  port: the port
+ * @param  count: set to the number of airports listed
+ * @retval RESOLVE_OK or RESOLVE_MAPPER_FAILED
+ */
+static ResolveStatus resolver_ask_port(Resolver* resolver, long port,
+        long* count) {
+    StringView line;
+    for (int try = 0; try < RESOLVER_ASK_TRIES; try++) {
+        if (resolver->mapperFD < 0) {
+            resolver->mapperFD = resolver_connect(resolver,
+                    resolver->mapperPort);
+            if (resolver->mapperFD < 0) {
+                return RESOLVE_MAPPER_FAILED;
+            }
+            resolver->mapperRead = line_reader_create(resolver->mapperFD,
+                    RESOLVER_LINE_SIZE);
+            resolver->mapperWrite = line_writer_create(resolver->mapperFD);
+        }
+        line_writer_printf(resolver->mapperWrite, "$%ld\n", port);
+        *count = 0;
+        if (line_writer_flush(resolver->mapperWrite)) {
+            set_read_timeout(resolver->mapperFD, PORT_QUESTION_TIMEOUT_MS);
+            LineStatus status;
+            while (status = line_reader_next(resolver->mapperRead, &line), 
+                    status == LINE_OK && line.complete) {
+                if (!strcmp(line.data, ".")) {
+                    set_read_timeout(resolver->mapperFD, 0);
+                    return RESOLVE_OK;
+                }
+                (*count)++;
+            }
+            if (status == LINE_ERROR && errno == EAGAIN) {
+                resolver->askPorts = false; // does not know $PORT
+                resolver_disconnect_mapper(resolver);
+                return RESOLVE_MAPPER_FAILED;
+            }
+        } // otherwise closed since the last question
+        resolver_disconnect_mapper(resolver);
+    }
+    return RESOLVE_MAPPER_FAILED;
+}
+
+/**
+ * @brief  checks whether a control has to be told which airport a plane 
+ * visits, because its port hosts several
+ * @note   the count comes from the cache, the mapper's shared memory or 
+ * the mapper itself. If none can tell the port is taken as not shared, 
+ * as it is for a mapper which does not know $PORT.
+ * @param  resolver: the resolver
+ * @param  port: the port an id resolved to
+ * @retval true if =ID has to be sent, otherwise false
+ */
+static bool resolver_shared(Resolver* resolver, long port) {
+    char name[REGISTRY_NAME_SIZE];
+    registry_port_name(name, port);
+    sem_wait(resolver->cacheLock);
+    TrieNode* node = trie_lookup(resolver->cache, name);
+    long count = node != NULL ? node->portNumber : 0;
+    sem_post(resolver->cacheLock);
+    if (count > 0) {
+        return count > 1;
+    }
+    count = resolver->registry != NULL
+            ? registry_lookup(resolver->registry, name) : REGISTRY_UNKNOWN;
+    if (count != REGISTRY_UNKNOWN) {
+        return count > 1;
+    }
+    sem_wait(resolver->mapperLock);
+    ResolveStatus status = resolver->askPorts 
+            ? resolver_ask_port(resolver, port, &count) 
+            : RESOLVE_MAPPER_FAILED;
+    sem_post(resolver->mapperLock);
+    if (status != RESOLVE_OK) {
+        return false;
+    }
+    bool created;
+    sem_wait(resolver->cacheLock);
+    trie_insert(resolver->cache, name, &created)->portNumber 
+            = count > 0 ? count : 1; // 0 would read as not cached
+    sem_post(resolver->cacheLock);
+    return count > 1;
+}
+
+/**
+ * @brief  finds the port of a destination: a port number as it is, then
+ * an id from the cache, the mapper's shared memory or the mapper itself
+ * @note   safe to call from many threads, only mapper questions are
+ * serialised
+ * @param  resolver: the resolver
+ * @param  destination: a port number or an airport id
+ * @param  port: set to the port
+ * @param  byId: set to true if destination was an id, so its port may 
+ * have changed
+ * @param  select: set to true if the port hosts several airports, so the 
+ * control has to be told the id with =ID
+ * @retval RESOLVE_OK, or why there is no port
+ */
+ResolveStatus resolver_lookup(Resolver* resolver, const char* destination,
+        long* port, bool* byId, bool* select) {
+    char* portError;
+    *port = strtol(destination, &portError, 10);
+    *byId = false;
+    *select = false;
+    if (*portError == '\0' && *port > 0 && *port <= MAXMI_VALID_PORT) {
+        return RESOLVE_OK;
+    }
+    if (resolver->mapperPort == 0) {
+        return RESOLVE_MAPPER_NEEDED;
+    }
+    *byId = true;
+    sem_wait(resolver->cacheLock);
+    TrieNode* node = trie_lookup(resolver->cache, destination);
+    *port = node != NULL ? node->portNumber : 0;
+    sem_post(resolver->cacheLock);
+    if (*port > 0) {
+        *select = resolver_shared(resolver, *port);
+        return RESOLVE_OK;
+    }
+    // shared memory is always current, so it is read rather than cached
+    *port = resolver->registry != NULL
+            ? registry_lookup(resolver->registry, destination)
+            : REGISTRY_UNKNOWN;
+    if (*port != REGISTRY_UNKNOWN) {
+        if (*port <= 0) {
+            return RESOLVE_NO_ENTRY;
+        }
+        *select = resolver_shared(resolver, *port);
+        return RESOLVE_OK;
+    }
+    sem_wait(resolver->mapperLock);
+    ResolveStatus status = resolver_ask(resolver, destination, port);
+    sem_post(resolver->mapperLock);
+    if (status == RESOLVE_OK) {
+        bool created;
+        sem_wait(resolver->cacheLock);
+        trie_insert(resolver->cache, destination, &created)->portNumber
+                = *port;
+        sem_post(resolver->cacheLock);
+        *select = resolver_shared(resolver, *port);
+    }
+    return status;
+}
+
+/**
+ * @brief  forgets the cached port of an airport, and how many airports 
+ * share it, e.g. after its control refused a connection, so the next 
+ * lookup asks the mapper again
+ * @param  resolver: the resolver
+ * @param  airportId: the airport
+ * @retval None
+ */
+void resolver_forget(Resolver* resolver, const char* airportId) {
+    char name[REGISTRY_NAME_SIZE];
+    sem_wait(resolver->cacheLock);
+    TrieNode* node = trie_lookup(resolver->cache, airportId);
+    if (node != NULL && node->portNumber > 0) {
+        registry_port_name(name, node->portNumber);
+        node->portNumber = 0;
+        node = trie_lookup(resolver->cache, name);
+        if (node != NULL) {
+            node->portNumber = 0;
+        }
+    }
+    sem_post(resolver->cacheLock);
+}
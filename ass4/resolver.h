@@ -0,0 +1,49 @@
+#ifndef RESOLVER_H_
+#define RESOLVER_H_
+#include <stdbool.h>
+#include <semaphore.h>
+#include <netinet/in.h>
+#include "lineStream.h"
+#include "registry.h"
+#include "trie.h"
+
+#define RESOLVER_LINE_SIZE 4096 // longest mapper reply read
+
+/* result of resolver_lookup, the values are the roc2310 exit statuses */
+typedef enum {
+    RESOLVE_OK = 0,
+    RESOLVE_MAPPER_NEEDED = 3, // an id was given without a mapper
+    RESOLVE_MAPPER_FAILED = 4, // the mapper could not be reached
+    RESOLVE_NO_ENTRY = 5 // the mapper does not know the id
+} ResolveStatus;
+
+/**
+ * turns destinations into control ports for a long running roc, keeping
+ * one mapper connection open and the ids it answered
+ */
+typedef struct {
+    long mapperPort; // 0 without a mapper ("-")
+    Registry* registry; // NULL unless the mapper runs on this host
+    struct sockaddr_in address; // localhost, looked up once
+    int mapperFD; // -1 until the mapper is first asked
+    LineReader* mapperRead;
+    LineWriter* mapperWrite;
+    sem_t* mapperLock; // one question on the connection at a time
+    bool askPorts; // false once the mapper left a $PORT unanswered
+    TrieNode* cache; // ids the mapper answered, port 0 once forgotten,
+            // and the airport count of their ports under ":PORT"
+    sem_t* cacheLock;
+} Resolver;
+
+Resolver* resolver_create(long mapperPort);
+
+ResolveStatus resolver_lookup(Resolver* resolver, const char* destination,
+        long* port, bool* byId, bool* select);
+
+void resolver_forget(Resolver* resolver, const char* airportId);
+
+int resolver_connect(Resolver* resolver, long port);
+
+int resolver_connect_start(Resolver* resolver, long port);
+
+#endif
@@ -8,6 +8,9 @@
 #include <pthread.h>
 #include "shared.h"
 #include "connectionHandler.h"
+#include "registry.h"
+#include "rocDaemon.h"
+#include "simulate.h"
 
 #define BUFFER_SIZE 79
 #define BASE 10
@@ -23,9 +26,20 @@ typedef enum {
     MAPPER_NEEDED = 3,
     UNABLE_TO_CONNECT_MAPPER = 4,
     MAPPER_NO_DEST = 5,
-    UNABLE_TO_CONNECT_DEST = 6
+    UNABLE_TO_CONNECT_DEST = 6,
+    DAEMON_FAILED = 7,
+    INVALID_SCHEDULE = 8
 } Status;
 
+/* options of the daemon and simulation modes */
+typedef struct {
+    const char* daemonSource; // -d stdin|listen
+    const char* schedulePath; // -f, planes from a file
+    long planeCount; // -n, generated planes, 0 if not given
+    long workers; // -w, 0 for the mode's default
+    long inFlight; // -c, planes simulated at once
+} RocOptions;
+
 /** 
  * Output error message for status and return status
  *	- Returns nothing
@@ -39,7 +53,9 @@ Status exit_message(Status status) {
             "Mapper required\n", //3
             "Failed to connect to mapper\n", //4
             "No map entry for destination\n", //5
-            "Failed to connect to at least one destination\n"}; //6
+            "Failed to connect to at least one destination\n", //6
+            "Failed to start daemon\n", //7
+            "Can not read schedule\n"}; //8
     fputs(messages[status], stderr);
     return status;
 }
@@ -53,13 +69,15 @@ Status exit_message(Status status) {
  * @param  failed: true if error during connection
  * @param  planeId: plane name
  * @param  portNumberString: airport port number string version 
+ * @param  selectIds: the id to send as =ID for each airport, NULL unless 
+ * its port hosts several airports
  * @param  argv: run arguments
  * @param  portNumber: airport port number
  * @retval boolean value: failed, if failed during connection then true
  */
 bool connect_port(bool hasMapper, int numberOfAirport, bool failed, 
         const char* planeId, const char* portNumberString[], 
-        const char* argv[], double portNumber[]) {
+        const char* selectIds[], const char* argv[], double portNumber[]) {
     if (hasMapper) {
         for (int i = 0; i < numberOfAirport; i++) {
             // add plane to airport and print airport info
@@ -68,7 +86,11 @@ bool connect_port(bool hasMapper, int numberOfAirport, bool failed,
                 failed = true;
                 break;
             }
-            handle_connection_plane(planeId, fileDescriptor);
+            if (!handle_connection_plane(selectIds[i], planeId, 
+                    fileDescriptor)) {
+                failed = true;
+                break;
+            }
         }
     } else {  // no mapper (-)
         for (int i = 0; i < numberOfAirport; i++) {
@@ -87,26 +109,25 @@ bool connect_port(bool hasMapper, int numberOfAirport, bool failed,
                 failed = true;
                 break;
             }
-            handle_connection_plane(planeId, fileDescriptor);
+            handle_connection_plane(NULL, planeId, fileDescriptor);
         }
     }
     return failed;
 }
 
 /**
- * @brief  try to connect the mapper
- * use to detect if error in the mapper port
- * @note   may raise unable to connnection error, then exit with code 2
- * @param  argv: run arguments
- * @retval fileDescriptor: if connection successful
+ * @brief  checks the mapper port argument
+ * @note   may raise invalid mapper port error, then exit with code 2
+ * @param  mapper: the mapper argument
+ * @retval the mapper port
  */
-int try_connect_mapper(const char* argv[]) {
-    if (!strcmp("0", argv[2])) { // special case
+int check_mapper_port(const char* mapper) {
+    if (!strcmp("0", mapper)) { // special case
         exit_message(INVALID_MAPPER_PORT);
         exit(2);
     }
     char* mappingPortError;
-    int mappingPort = strtol(argv[2], &mappingPortError, BASE);
+    int mappingPort = strtol(mapper, &mappingPortError, BASE);
     if (mappingPort != 0) { // strtol return 0 means fault
         if (*mappingPortError != '\0' || mappingPort <= 0 
                 || mappingPort > MAXMI_VALID_PORT) {
@@ -117,6 +138,18 @@ int try_connect_mapper(const char* argv[]) {
         exit_message(INVALID_MAPPER_PORT); // not a number
         exit(2);
     }
+    return mappingPort;
+}
+
+/**
+ * @brief  try to connect the mapper
+ * use to detect if error in the mapper port
+ * @note   may raise unable to connnection error, then exit with code 4
+ * @param  argv: run arguments
+ * @retval fileDescriptor: if connection successful
+ */
+int try_connect_mapper(const char* argv[]) {
+    check_mapper_port(argv[2]);
     int fileDescriptor = connect_to_port(argv[2]);
     if (fileDescriptor == -1) {
         exit_message(UNABLE_TO_CONNECT_MAPPER);
@@ -125,11 +158,70 @@ int try_connect_mapper(const char* argv[]) {
     return fileDescriptor;
 }
 
+/**
+ * @brief  asks the mapper for the port of an airport with ?ID
+ * @note   may raise mapper no destination error, then exit with code 5
+ * @param  streamRead: reader of the mapper connection
+ * @param  streamWrite: writer of the mapper connection
+ * @param  airportId: the airport to look up
+ * @param  buffer: filled with the port number string
+ * @retval None
+ */
+void ask_mapper(LineReader* streamRead, LineWriter* streamWrite, 
+        const char* airportId, char* buffer) {
+    StringView line;
+    line_writer_printf(streamWrite, "?%s\n", airportId);
+    line_writer_flush(streamWrite);
+    if (line_reader_next(streamRead, &line) != LINE_OK 
+            || !strncmp(";", line.data, 1)) {
+        exit_message(MAPPER_NO_DEST);
+        exit(5);
+    }
+    // view is reused by the next read so keep a copy
+    snprintf(buffer, BUFFER_SIZE, "%s", line.data);
+}
+
+/**
+ * @brief  asks the mapper with $PORT how many airports a port hosts
+ * @note   the reply is waited for at most PORT_QUESTION_TIMEOUT_MS, as a 
+ * mapper which does not know $PORT never replies. The connection can 
+ * not be used any more if the mapper did not answer.
+ * @param  streamRead: reader of the mapper connection
+ * @param  streamWrite: writer of the mapper connection
+ * @param  port: the port number string
+ * @retval the number of airports, REGISTRY_UNKNOWN if the mapper did not 
+ * answer
+ */
+long ask_mapper_shared(LineReader* streamRead, LineWriter* streamWrite, 
+        const char* port) {
+    StringView line;
+    long count = 0;
+    line_writer_printf(streamWrite, "$%s\n", port);
+    if (!line_writer_flush(streamWrite)) {
+        return REGISTRY_UNKNOWN;
+    }
+    set_read_timeout(streamRead->fileDescriptor, PORT_QUESTION_TIMEOUT_MS);
+    while (line_reader_next(streamRead, &line) == LINE_OK 
+            && line.complete) {
+        if (!strcmp(line.data, ".")) {
+            set_read_timeout(streamRead->fileDescriptor, 0);
+            return count;
+        }
+        count++;
+    }
+    return REGISTRY_UNKNOWN;
+}
+
 /**
  * @brief  if has mapper connect mapper first, convert all id into port number
  * then try to connect each airport port 
  * @note   if has mapper else no mapper
- * may raise mapper no destination error, then exit with code 5
+ * may raise mapper no destination error, then exit with code 5.
+ * When the mapper runs on this host its shared memory registry is read 
+ * instead, and the mapper is only connected to for ids it can not answer.
+ * An id is only sent to its control (=ID) if its port hosts several 
+ * airports. Each port is asked about once, and not at all after the 
+ * mapper left a question unanswered, so such ports are not shared.
  * @param  hasMapper: true if has mapper
  * @param  numberOfAirport: number of airport from argument
  * @param  failed: true if error during connection
@@ -142,56 +234,193 @@ bool handle_all_connection(const char* argv[], int numberOfAirport,
         bool hasMapper, double portNumber[], const char* portNumberString[]) {
     bool failed = false; // test if connect failed at lease once;
     char buffer[numberOfAirport + 1][BUFFER_SIZE];
+    const char* selectIds[numberOfAirport + 1];
     const char* planeId = argv[1]; // load id of plane
     // load mapper port (optional)
     if (!strncmp("-", argv[2], 1)) { // Mapper is dash do nothing
     } else {
-        int fileDescriptor = try_connect_mapper(argv);
+        Registry* registry = registry_open(check_mapper_port(argv[2]));
+        int fileDescriptor = -1;
+        if (registry == NULL) {
+            fileDescriptor = try_connect_mapper(argv);
+        }
         hasMapper = true;
-        int fileDescriptor2 = dup(fileDescriptor);
-        FILE* streamWrite = fdopen(fileDescriptor, "w");
-        FILE* streamRead = fdopen(fileDescriptor2, "r");
+        LineReader* streamRead = NULL;
+        LineWriter* streamWrite = NULL;
+        bool askShared = true; // false once the mapper did not answer
+        long shareds[numberOfAirport + 1];
 
         // conver all to port number
         for (int i = 0; i < numberOfAirport; i++) {   
+            const char* destination = argv[MINIM_ARGS + i];
+            selectIds[i] = NULL;
             char* portError;
-            portNumber[i] = strtol(argv[MINIM_ARGS + i], &portError, BASE);
-            if (*portError != '\0' || portNumber[i] <= 0 
-                    || portNumber[i] > MAXMI_VALID_PORT) {
-                failed = true;
-            } else {
-                portNumberString[i] = argv[MINIM_ARGS + i]; // WORKS FINE
+            portNumber[i] = strtol(destination, &portError, BASE);
+            if (*portError == '\0' && portNumber[i] > 0 
+                    && portNumber[i] <= MAXMI_VALID_PORT) {
+                portNumberString[i] = destination; // WORKS FINE
+                continue;
             }
-
-            if (failed) { // kind of second chance
-                fprintf(streamWrite, "?%s\n", argv[MINIM_ARGS + i]);
-                fflush(streamWrite);
-                if (fgets(buffer[i], BUFFER_SIZE, streamRead) != NULL) { 
-                    if (!strncmp(";", buffer[i], 1)) { 
-                        exit_message(MAPPER_NO_DEST);
-                        exit(5);
-                    } else {
-                        buffer[i][strcspn(buffer[i], "\n")] = '\0';
-                        portNumberString[i] = buffer[i]; 
-                        failed = false; // reinitialize
+            // kind of second chance, from memory if the mapper is local
+            long port = registry != NULL 
+                    ? registry_lookup(registry, destination) 
+                    : REGISTRY_UNKNOWN;
+            long shared = REGISTRY_UNKNOWN;
+            shareds[i] = REGISTRY_UNKNOWN;
+            if (port == 0) {
+                exit_message(MAPPER_NO_DEST);
+                exit(5);
+            } else if (port > 0) {
+                snprintf(buffer[i], BUFFER_SIZE, "%ld", port);
+                char name[REGISTRY_NAME_SIZE];
+                registry_port_name(name, port);
+                shared = registry_lookup(registry, name);
+            }
+            if (port < 0 || (shared == REGISTRY_UNKNOWN && askShared)) {
+                if (fileDescriptor < 0) {
+                    fileDescriptor = try_connect_mapper(argv);
+                }
+                if (streamRead == NULL) {
+                    streamRead = line_reader_create(fileDescriptor, 
+                            MAX_LINE_SIZE);
+                    streamWrite = line_writer_create(fileDescriptor);
+                }
+                if (port < 0) {
+                    ask_mapper(streamRead, streamWrite, destination, 
+                            buffer[i]);
+                }
+                for (int j = 0; j < i; j++) {
+                    if (!strcmp(portNumberString[j], buffer[i])) {
+                        shared = shareds[j]; // asked about already
                     }
-                } else {
-                    exit_message(MAPPER_NO_DEST);
-                    exit(5);
+                }
+                if (shared == REGISTRY_UNKNOWN && askShared) {
+                    shared = ask_mapper_shared(streamRead, streamWrite, 
+                            buffer[i]);
+                }
+                if (shared == REGISTRY_UNKNOWN && askShared) {
+                    askShared = false; // a late reply would mix with ?ID
+                    line_reader_free(streamRead);
+                    line_writer_free(streamWrite);
+                    close(fileDescriptor);
+                    streamRead = NULL;
+                    streamWrite = NULL;
+                    fileDescriptor = -1;
                 }
             }
+            // the control only has to be told the id if it hosts several
+            shareds[i] = shared;
+            selectIds[i] = shared > 1 ? destination : NULL;
+            portNumberString[i] = buffer[i]; 
+        }
+        if (streamRead != NULL) {
+            line_reader_free(streamRead); // connection terminated
+            line_writer_free(streamWrite);
+        }
+        if (fileDescriptor >= 0) {
+            close(fileDescriptor);
+        }
+        if (registry != NULL) {
+            registry_close(registry);
         }
-        fclose(streamRead); // connection terminated
-        fclose(streamWrite);
     }
     
     // try to connect all port number
     failed = connect_port(hasMapper, numberOfAirport, failed, planeId, 
-            portNumberString, argv, portNumber);
+            portNumberString, selectIds, argv, portNumber);
     return failed;
 }
 
+/**
+ * @brief  consumes the leading -x value options of the daemon and 
+ * simulation modes
+ * @param  argc: argument count
+ * @param  argv: run arguments
+ * @param  options: filled with the given options (others left default)
+ * @retval number of arguments consumed, -1 if an option is unknown or 
+ * the modes are mixed
+ */
+int parse_options(int argc, char const* argv[], RocOptions* options) {
+    int consumed = 0;
+    options->daemonSource = NULL;
+    options->schedulePath = NULL;
+    options->planeCount = 0;
+    options->workers = 0;
+    options->inFlight = SIMULATE_IN_FLIGHT;
+    while (consumed + 2 < argc && argv[consumed + 1][0] == '-' 
+            && argv[consumed + 1][1] != '\0') { // "-" is a mapper
+        const char* option = argv[consumed + 1];
+        const char* value = argv[consumed + 2];
+        if (!strcmp(option, "-d") && (!strcmp(value, "stdin") 
+                || !strcmp(value, "listen"))) {
+            options->daemonSource = value;
+        } else if (!strcmp(option, "-f")) {
+            options->schedulePath = value;
+        } else if (!strcmp(option, "-n")) {
+            options->planeCount = parse_positive_number(value);
+        } else if (!strcmp(option, "-w")) {
+            options->workers = parse_positive_number(value);
+        } else if (!strcmp(option, "-c")) {
+            options->inFlight = parse_positive_number(value);
+        } else {
+            return -1;
+        }
+        consumed += 2;
+    }
+    int modes = (options->daemonSource != NULL) 
+            + (options->schedulePath != NULL) + (options->planeCount != 0);
+    if (modes != 1 || options->planeCount < 0 || options->workers < 0 
+            || options->inFlight < 0) {
+        return -1;
+    }
+    return consumed;
+}
+
+/**
+ * @brief  runs as a daemon for "roc2310 -d stdin|listen [-w workers] 
+ * mapper", flying one itinerary per line (see roc_daemon_run), or 
+ * simulates many planes for "roc2310 -n planes [-w threads] [-c planes] 
+ * mapper {airports}" and "roc2310 -f schedule [-w threads] [-c planes] 
+ * mapper" (see simulate_run)
+ * @note   may raise invalid mapper port error, then exit with code 2
+ * @param  argc: argument count
+ * @param  argv: run arguments
+ * @retval status to exit with
+ */
+Status run_options(int argc, char const* argv[]) {
+    RocOptions options;
+    int consumed = parse_options(argc, argv, &options);
+    if (consumed < 0 || consumed + 2 > argc || (options.planeCount == 0 
+            && consumed + 2 != argc)) {
+        return exit_message(WRONG_ARG_NUMBER);
+    }
+    const char* mapper = argv[consumed + 1];
+    long mapperPort = strcmp(mapper, "-") ? check_mapper_port(mapper) : 0;
+    if (options.daemonSource != NULL) {
+        if (!roc_daemon_run(mapperPort, options.workers != 0 
+                ? options.workers : ROC_DAEMON_WORKERS, 
+                !strcmp(options.daemonSource, "listen"))) {
+            return exit_message(DAEMON_FAILED);
+        }
+        return exit_message(NORMAL_OPERATION);
+    }
+    SimSchedule* schedule = options.planeCount != 0 
+            ? simulate_generate(options.planeCount, argv + consumed + 2, 
+            argc - consumed - 2) 
+            : simulate_load(options.schedulePath);
+    if (schedule == NULL) {
+        return exit_message(INVALID_SCHEDULE);
+    }
+    int status = simulate_run(schedule, mapperPort, options.workers != 0 
+            ? options.workers : SIMULATE_THREADS, options.inFlight);
+    return exit_message(status < 0 ? DAEMON_FAILED : (Status)status);
+}
+
 int main(int argc, char const* argv[]) {
+    if (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0' 
+            && strchr("dfnwc", argv[1][1]) && argv[1][2] == '\0') {
+        return run_options(argc, argv);
+    }
     if (argc < MINIM_ARGS) {
         return exit_message(WRONG_ARG_NUMBER);
     }
@@ -0,0 +1,347 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "rocDaemon.h"
+#include "connectionHandler.h"
+
+/**
+ * A non-zero value means the semaphore is shared between processes
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+#define LISTEN 128
+#define USAGE_STATUS 1 // no plane id, as roc2310 without one
+#define DEST_STATUS 6 // a control refused or did not host the airport
+
+// shared by every worker
+static Resolver* resolver;
+
+// itineraries read but not flown yet, oldest first, guarded by queueLock
+static RocJob* queueHead = NULL;
+static RocJob* queueTail = NULL;
+static sem_t* queueLock;
+static sem_t* queueItems; // jobs in the queue
+static sem_t* queueSlots; // room left, a reader waits once it is full
+
+/**
+ * @brief  creates a stream held by its reading thread
+ * @param  readFD: where itineraries come from
+ * @param  writeFD: where results go, may be readFD
+ * @param  finished: posted once the stream is freed, NULL to close readFD
+ * then instead
+ * @retval newly created stream
+ */
+static RocStream* roc_stream_create(int readFD, int writeFD,
+        sem_t* finished) {
+    RocStream* stream = (RocStream*)malloc(sizeof(RocStream));
+    stream->reader = line_reader_create(readFD, ROC_DAEMON_LINE_SIZE);
+    stream->writer = line_writer_create(writeFD);
+    stream->writeLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(stream->writeLock, SEMA_SHARE_THREAD, 1);
+    stream->references = 1;
+    stream->finished = finished;
+    return stream;
+}
+
+/**
+ * @brief  writes a result (if any) and drops a reference to the stream,
+ * freeing it with the last one
+ * @note   results are only flushed once nothing else of the stream is
+ * waiting, so a burst of itineraries costs a few writes
+ * @param  stream: the stream
+ * @param  result: a whole result line, NULL when the reader is done
+ * @param  length: length of result
+ * @retval None
+ */
+static void roc_stream_release(RocStream* stream, const char* result,
+        size_t length) {
+    sem_wait(stream->writeLock);
+    if (result != NULL) {
+        line_writer_write(stream->writer, result, length);
+    }
+    int references = __atomic_sub_fetch(&stream->references, 1,
+            __ATOMIC_ACQ_REL);
+    if (references <= 1) {
+        line_writer_flush(stream->writer);
+    }
+    sem_post(stream->writeLock);
+    if (references > 0) {
+        return;
+    }
+    int readFD = stream->reader->fileDescriptor;
+    line_reader_free(stream->reader);
+    line_writer_free(stream->writer);
+    sem_destroy(stream->writeLock);
+    free(stream->writeLock);
+    if (stream->finished != NULL) {
+        sem_post(stream->finished);
+    } else {
+        close(readFD);
+    }
+    free(stream);
+}
+
+/**
+ * @brief  queues an itinerary, waiting while the queue is full
+ * @param  job: the itinerary
+ * @retval None
+ */
+static void roc_queue_push(RocJob* job) {
+    sem_wait(queueSlots);
+    job->next = NULL;
+    sem_wait(queueLock);
+    if (queueTail != NULL) {
+        queueTail->next = job;
+    } else {
+        queueHead = job;
+    }
+    queueTail = job;
+    sem_post(queueLock);
+    sem_post(queueItems);
+}
+
+/**
+ * @brief  takes the oldest itinerary, waiting while there is none
+ * @retval the itinerary
+ */
+static RocJob* roc_queue_pop() {
+    sem_wait(queueItems);
+    sem_wait(queueLock);
+    RocJob* job = queueHead;
+    queueHead = job->next;
+    if (queueHead == NULL) {
+        queueTail = NULL;
+    }
+    sem_post(queueLock);
+    sem_post(queueSlots);
+    return job;
+}
+
+/**
+ * @brief  visits one control as roc2310 does, keeping its reply
+ * @param  fileDescriptor: connection to the control, closed here, -1 if 
+ * it was refused
+ * @param  airportId: airport to select, NULL for the port's default
+ * @param  planeId: plane name
+ * @param  infos: the reply is appended as ":INFO", unless it is ";"
+ * @retval false if the connection was refused or the control replied 
+ * ";" (the port was reused by a control not hosting airportId), 
+ * otherwise true
+ */
+static bool roc_daemon_visit(int fileDescriptor, const char* airportId,
+        const char* planeId, LineWriter* infos) {
+    if (fileDescriptor < 0) {
+        return false;
+    }
+    LineReader* streamRead = line_reader_create(fileDescriptor,
+            ROC_DAEMON_REPLY_SIZE);
+    LineWriter* streamWrite = line_writer_create(fileDescriptor);
+    send_message_plane(airportId, planeId, streamWrite);
+    StringView line;
+    bool hosted = true;
+    if (line_reader_next(streamRead, &line) == LINE_OK) {
+        hosted = !is_selection_refused(airportId, line.data, line.length);
+        if (hosted) {
+            line_writer_write(infos, ":", 1);
+            line_writer_write(infos, line.data, line.length);
+        }
+    } else {
+        line_writer_write(infos, ":", 1);
+    }
+    line_reader_free(streamRead);
+    line_writer_free(streamWrite);
+    close(fileDescriptor);
+    return hosted;
+}
+
+/**
+ * @brief  flies one itinerary: every destination is resolved first, then
+ * visited in order until one fails, as a roc2310 run would
+ * @note   an id whose cached port refuses the connection, or whose 
+ * control replies ";", is looked up again once, the control may have 
+ * restarted on another port
+ * @param  line: "planeID dest1 dest2 ...", split in place
+ * @param  infos: the reply of each control visited is appended as ":INFO"
+ * @retval the exit status roc2310 would give
+ */
+static int roc_daemon_fly(char* line, LineWriter* infos) {
+    char* rest;
+    const char* planeId = line != NULL ? strtok_r(line, " \t", &rest) : NULL;
+    if (planeId == NULL) {
+        return USAGE_STATUS;
+    }
+    int count = 0;
+    char** destinations = (char**)malloc(sizeof(char*)
+            * (strlen(rest) / 2 + 2));
+    while ((destinations[count] = strtok_r(NULL, " \t", &rest)) != NULL) {
+        count++;
+    }
+    long ports[count + 1];
+    bool byId[count + 1];
+    bool select[count + 1];
+    int status = RESOLVE_OK;
+    for (int i = 0; i < count && status == RESOLVE_OK; i++) {
+        status = resolver_lookup(resolver, destinations[i], &ports[i],
+                &byId[i], &select[i]);
+    }
+    for (int i = 0; i < count && status == RESOLVE_OK; i++) {
+        bool visited = roc_daemon_visit(resolver_connect(resolver, 
+                ports[i]), select[i] ? destinations[i] : NULL, planeId, 
+                infos);
+        if (!visited && byId[i]) {
+            resolver_forget(resolver, destinations[i]);
+            visited = resolver_lookup(resolver, destinations[i], &ports[i],
+                    &byId[i], &select[i]) == RESOLVE_OK 
+                    && roc_daemon_visit(resolver_connect(resolver, 
+                    ports[i]), select[i] ? destinations[i] : NULL, planeId,
+                    infos);
+        }
+        if (!visited) {
+            status = DEST_STATUS;
+        }
+    }
+    free(destinations);
+    return status;
+}
+
+/**
+ * @brief  flies queued itineraries forever
+ * @param  passArg: unused
+ * @retval never returns
+ */
+static void* roc_daemon_worker(void* passArg) {
+    while (true) {
+        RocJob* job = roc_queue_pop();
+        LineWriter* infos = line_writer_create_memory();
+        int status = roc_daemon_fly(job->line, infos);
+        size_t infoLength;
+        char* info = line_writer_take(infos, &infoLength);
+        line_writer_free(infos);
+        LineWriter* result = line_writer_create_memory();
+        line_writer_printf(result, "%lu:%d", job->number, status);
+        if (info != NULL) {
+            line_writer_write(result, info, infoLength);
+        }
+        line_writer_write(result, "\n", 1);
+        size_t resultLength;
+        char* resultLine = line_writer_take(result, &resultLength);
+        line_writer_free(result);
+        roc_stream_release(job->stream, resultLine, resultLength);
+        free(resultLine);
+        free(info);
+        free(job->line);
+        free(job);
+    }
+    return NULL;
+}
+
+/**
+ * @brief  queues every itinerary line of a stream, then drops the
+ * reader's reference
+ * @param  passArg: the stream
+ * @retval NULL
+ */
+static void* roc_daemon_read(void* passArg) {
+    RocStream* stream = (RocStream*)passArg;
+    StringView line;
+    LineStatus status;
+    unsigned long number = 0;
+    while (status = line_reader_next(stream->reader, &line),
+            status == LINE_OK || status == LINE_TOO_LONG) {
+        RocJob* job = (RocJob*)malloc(sizeof(RocJob));
+        job->stream = stream;
+        job->number = ++number;
+        job->line = status == LINE_OK ? strdup(line.data) : NULL;
+        __atomic_add_fetch(&stream->references, 1, __ATOMIC_RELAXED);
+        roc_queue_push(job);
+    }
+    roc_stream_release(stream, NULL, 0);
+    return NULL;
+}
+
+/**
+ * @brief  listens on an ephemeral port, printing it, and reads
+ * itineraries from every connection made to it
+ * @retval false if it could not listen, otherwise never returns
+ */
+static bool roc_daemon_listen() {
+    struct addrinfo* addressInfo = NULL;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo("localhost", 0, &hints, &addressInfo)) {
+        return false;
+    }
+    int localSocket = socket(AF_INET, SOCK_STREAM, 0);
+    int bindError = bind(localSocket, (struct sockaddr*)addressInfo->ai_addr,
+            sizeof(struct sockaddr));
+    freeaddrinfo(addressInfo);
+    struct sockaddr_in serverAddr;
+    socklen_t addrLength = sizeof(struct sockaddr_in);
+    if (bindError || getsockname(localSocket, (struct sockaddr*)&serverAddr,
+            &addrLength) || listen(localSocket, LISTEN)) {
+        return false;
+    }
+    printf("%u\n", ntohs(serverAddr.sin_port));
+    fflush(stdout);
+
+    int connectionFD;
+    while (connectionFD = accept(localSocket, 0, 0), connectionFD >= 0) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, roc_daemon_read,
+                roc_stream_create(connectionFD, connectionFD, NULL));
+        pthread_detach(tid);
+    }
+    return false;
+}
+
+/**
+ * @brief  runs roc2310 as a daemon flying one itinerary per line, with one
+ * mapper connection and resolution cache shared by all of them. Each
+ * result is "LINE:STATUS" followed by ":INFO" for every control visited,
+ * where LINE numbers the itinerary in its stream and STATUS is the exit
+ * status roc2310 would give. Results are written as itineraries finish.
+ * @param  mapperPort: port of the mapper, 0 for none ("-")
+ * @param  workers: itineraries flown at once
+ * @param  listenSocket: read from connections to a printed ephemeral port
+ * instead of stdin
+ * @retval true once stdin ended and every itinerary was flown, false if
+ * the daemon could not start
+ */
+bool roc_daemon_run(long mapperPort, int workers, bool listenSocket) {
+    sigset_t set; // a control closing early must not kill the daemon
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    resolver = resolver_create(mapperPort);
+    if (resolver == NULL) {
+        return false;
+    }
+    queueLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(queueLock, SEMA_SHARE_THREAD, 1);
+    queueItems = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(queueItems, SEMA_SHARE_THREAD, 0);
+    queueSlots = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(queueSlots, SEMA_SHARE_THREAD, workers * ROC_DAEMON_QUEUED);
+    for (int i = 0; i < workers; i++) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, roc_daemon_worker, NULL);
+        pthread_detach(tid);
+    }
+    if (listenSocket) {
+        return roc_daemon_listen();
+    }
+    sem_t finished;
+    sem_init(&finished, SEMA_SHARE_THREAD, 0);
+    roc_daemon_read(roc_stream_create(STDIN_FILENO, STDOUT_FILENO,
+            &finished));
+    sem_wait(&finished);
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef ROC_DAEMON_H_
+#define ROC_DAEMON_H_
+#include <stdbool.h>
+#include <semaphore.h>
+#include "lineStream.h"
+#include "resolver.h"
+
+#define ROC_DAEMON_WORKERS 16 // itineraries flown at once by default
+#define ROC_DAEMON_QUEUED 4 // itineraries waiting per worker before reading
+#define ROC_DAEMON_LINE_SIZE 65536 // longest itinerary line
+#define ROC_DAEMON_REPLY_SIZE 4096 // longest control reply kept
+
+/**
+ * a source of itineraries (stdin or one socket connection) and where
+ * their results go. Freed once it ended and every itinerary read from
+ * it was flown.
+ */
+typedef struct {
+    LineReader* reader;
+    LineWriter* writer;
+    sem_t* writeLock; // result lines are written whole
+    int references; // the reading thread and every queued itinerary
+    sem_t* finished; // posted when freed (stdin), NULL to close the socket
+} RocStream;
+
+/* one itinerary line waiting for a worker */
+typedef struct RocJob {
+    RocStream* stream;
+    unsigned long number; // line number in its stream, from 1
+    char* line;
+    struct RocJob* next;
+} RocJob;
+
+bool roc_daemon_run(long mapperPort, int workers, bool listenSocket);
+
+#endif
@@ -0,0 +1,257 @@
+#include <stdint.h>
+#include <string.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#define SCAN_UNSET ((size_t)-1)
+
+// the scanner in use, found on the first scan
+static int level = -1;
+
+/**
+ * @brief  finds the best scanner this CPU runs
+ * @retval the level
+ */
+static ScanLevel scan_supported() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SCAN_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SCAN_SSE2;
+    }
+#endif
+    return SCAN_SCALAR;
+}
+
+/**
+ * @brief  gives delimiters never seen the position of the '\0'
+ * @param  scan: the finished scan
+ * @param  length: where the '\0' is
+ * @retval None
+ */
+static void scan_finish(ScanResult* scan, size_t length) {
+    scan->length = length;
+    if (scan->colon == SCAN_UNSET) {
+        scan->colon = length;
+    }
+    if (scan->carriageReturn == SCAN_UNSET) {
+        scan->carriageReturn = length;
+    }
+    if (scan->newline == SCAN_UNSET) {
+        scan->newline = length;
+    }
+}
+
+/**
+ * @brief  checks the text one char at a time
+ * @param  text: '\0' terminated text
+ * @param  scan: filled with the delimiters
+ * @retval None
+ */
+static void scan_scalar(const char* text, ScanResult* scan) {
+    size_t i = 0;
+    for (; text[i] != '\0'; i++) {
+        if (text[i] == ':' && scan->colon == SCAN_UNSET) {
+            scan->colon = i;
+        } else if (text[i] == '\r' && scan->carriageReturn == SCAN_UNSET) {
+            scan->carriageReturn = i;
+        } else if (text[i] == '\n' && scan->newline == SCAN_UNSET) {
+            scan->newline = i;
+        }
+    }
+    scan_finish(scan, i);
+}
+
+#ifdef SCAN_X86
+/**
+ * @brief  records the delimiters found in one block of the text
+ * @param  scan: the scan so far
+ * @param  base: index of the block's first char (negative for the part
+ * before the text in the first, aligned block)
+ * @param  nul: bit i set if char i of the block is '\0'
+ * @param  colon: bit i set if char i of the block is ':'
+ * @param  carriageReturn: bit i set if char i of the block is '\r'
+ * @param  newline: bit i set if char i of the block is '\n'
+ * @retval true once the '\0' was found, otherwise false
+ */
+static inline bool scan_block(ScanResult* scan, ptrdiff_t base,
+        uint32_t nul, uint32_t colon, uint32_t carriageReturn,
+        uint32_t newline) {
+    if (nul != 0) {
+        uint32_t before = (nul & -nul) - 1; // chars before the '\0'
+        colon &= before;
+        carriageReturn &= before;
+        newline &= before;
+    }
+    if (colon != 0 && scan->colon == SCAN_UNSET) {
+        scan->colon = base + __builtin_ctz(colon);
+    }
+    if (carriageReturn != 0 && scan->carriageReturn == SCAN_UNSET) {
+        scan->carriageReturn = base + __builtin_ctz(carriageReturn);
+    }
+    if (newline != 0 && scan->newline == SCAN_UNSET) {
+        scan->newline = base + __builtin_ctz(newline);
+    }
+    if (nul != 0) {
+        scan_finish(scan, base + __builtin_ctz(nul));
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief  checks the text 16 chars at a time
+ * @note   loads are aligned so they never cross into an unmapped page
+ * past the '\0', chars before the text are masked out
+ * @param  text: '\0' terminated text
+ * @param  scan: filled with the delimiters
+ * @retval None
+ */
+static void scan_sse2(const char* text, ScanResult* scan) {
+    unsigned skip = (uintptr_t)text & 15;
+    const __m128i* block = (const __m128i*)(text - skip);
+    const __m128i nul = _mm_setzero_si128();
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint32_t keep = ~0u << skip;
+    for (ptrdiff_t base = -(ptrdiff_t)skip; ; base += 16, block++) {
+        __m128i chars = _mm_load_si128(block);
+        if (scan_block(scan, base,
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chars, nul)) & keep,
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chars, colon)) & keep,
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chars, carriageReturn))
+                & keep,
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chars, newline)) & keep)) {
+            return;
+        }
+        keep = ~0u;
+    }
+}
+
+/**
+ * @brief  checks the text 32 chars at a time, same as scan_sse2
+ * @param  text: '\0' terminated text
+ * @param  scan: filled with the delimiters
+ * @retval None
+ */
+__attribute__((target("avx2")))
+static void scan_avx2(const char* text, ScanResult* scan) {
+    unsigned skip = (uintptr_t)text & 31;
+    const __m256i* block = (const __m256i*)(text - skip);
+    const __m256i nul = _mm256_setzero_si256();
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i carriageReturn = _mm256_set1_epi8('\r');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    uint32_t keep = ~0u << skip;
+    for (ptrdiff_t base = -(ptrdiff_t)skip; ; base += 32, block++) {
+        __m256i chars = _mm256_load_si256(block);
+        if (scan_block(scan, base,
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, nul)) & keep,
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, colon))
+                & keep,
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars,
+                carriageReturn)) & keep,
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, newline))
+                & keep)) {
+            return;
+        }
+        keep = ~0u;
+    }
+}
+#endif
+
+/**
+ * @brief  finds the length and the first ':', '\r' and '\n' of a text in
+ * one pass, with the widest vectors the CPU has
+ * @param  text: '\0' terminated text
+ * @param  scan: filled with the positions
+ * @retval None
+ */
+void scan_text(const char* text, ScanResult* scan) {
+    scan->colon = SCAN_UNSET;
+    scan->carriageReturn = SCAN_UNSET;
+    scan->newline = SCAN_UNSET;
+    switch (scan_level()) {
+#ifdef SCAN_X86
+        case SCAN_AVX2:
+            scan_avx2(text, scan);
+            break;
+        case SCAN_SSE2:
+            scan_sse2(text, scan);
+            break;
+#endif
+        default:
+            scan_scalar(text, scan);
+    }
+}
+
+/**
+ * @brief  scans a received message and cuts it at its first '\r'
+ * @note   replaces the strcspn calls each parser used to make, positions
+ * past the cut are moved to the new length ("not found")
+ * @param  message: the message (changed in place)
+ * @param  scan: filled with the positions
+ * @retval None
+ */
+void scan_message(char* message, ScanResult* scan) {
+    scan_text(message, scan);
+    message[scan->carriageReturn] = '\0';
+    scan->length = scan->carriageReturn;
+    if (scan->colon > scan->length) {
+        scan->colon = scan->length;
+    }
+    if (scan->newline > scan->length) {
+        scan->newline = scan->length;
+    }
+}
+
+/**
+ * @brief  cuts a received message at its first '\r'
+ * @note   for parsers which read the message with strtol and the like, 
+ * and have no use for the other positions
+ * @param  message: the message (changed in place)
+ * @retval None
+ */
+void scan_trim(char* message) {
+    message[strcspn(message, "\r")] = '\0';
+}
+
+/**
+ * @brief  checks whether the first end chars of a scanned message are a
+ * valid name: not empty, no ':', '\r' or '\n'
+ * @param  scan: the scan of the message
+ * @param  end: length of the name
+ * @retval true if valid, otherwise false
+ */
+bool scan_is_name(const ScanResult* scan, size_t end) {
+    return end > 0 && scan->colon >= end && scan->carriageReturn >= end
+            && scan->newline >= end;
+}
+
+/**
+ * @brief  gets the scanner in use
+ * @retval the level, the best one supported unless scan_set_level was used
+ */
+ScanLevel scan_level() {
+    if (level < 0) {
+        level = scan_supported(); // same result for every racing thread
+    }
+    return (ScanLevel)level;
+}
+
+/**
+ * @brief  picks the scanner, e.g. to compare them in a benchmark
+ * @param  wanted: the level to use, lowered to what the CPU supports
+ * @retval None
+ */
+void scan_set_level(ScanLevel wanted) {
+    ScanLevel supported = scan_supported();
+    level = wanted < supported ? wanted : supported;
+}
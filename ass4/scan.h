@@ -0,0 +1,33 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+#include <stdbool.h>
+#include <stddef.h>
+
+/* which scanner scan_text uses */
+typedef enum {
+    SCAN_SCALAR = 0,
+    SCAN_SSE2 = 1,
+    SCAN_AVX2 = 2
+} ScanLevel;
+
+/* where the protocol delimiters are in a '\0' terminated text */
+typedef struct {
+    size_t length; // chars before the '\0'
+    size_t colon; // index of the first ':', length if there is none
+    size_t carriageReturn; // index of the first '\r', length if none
+    size_t newline; // index of the first '\n', length if none
+} ScanResult;
+
+void scan_text(const char* text, ScanResult* scan);
+
+void scan_message(char* message, ScanResult* scan);
+
+void scan_trim(char* message);
+
+bool scan_is_name(const ScanResult* scan, size_t end);
+
+ScanLevel scan_level();
+
+void scan_set_level(ScanLevel level);
+
+#endif
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "scan.h"
+
+#define BENCH_MESSAGES 200000 // lines in the pipelined corpus
+#define BENCH_ROUNDS 20 // passes over the corpus per scanner
+
+/* what a parser learns from one message */
+typedef struct {
+    size_t length;
+    size_t colon;
+    bool validName;
+} Parsed;
+
+/**
+ * @brief  parses one line the way the servers did before scan.c: cut at
+ * '\r' with strcspn, find the ':' with strcspn, check the name char by char
+ * @param  message: the line (changed in place)
+ * @param  parsed: the result
+ * @retval None
+ */
+static void parse_strcspn(char* message, Parsed* parsed) {
+    message[strcspn(message, "\r")] = '\0';
+    parsed->length = strlen(message);
+    parsed->colon = strcspn(message, ":");
+    size_t end = message[0] == '!' || message[0] == '?' ? parsed->colon
+            : parsed->length;
+    const char* name = message + (message[0] == '!' || message[0] == '?');
+    parsed->validName = name < message + end;
+    for (const char* c = name; c < message + end; c++) {
+        if (*c == ':' || *c == '\r' || *c == '\n') {
+            parsed->validName = false;
+        }
+    }
+}
+
+/**
+ * @brief  parses one line with scan_message
+ * @param  message: the line (changed in place)
+ * @param  parsed: the result
+ * @retval None
+ */
+static void parse_scan(char* message, Parsed* parsed) {
+    ScanResult scan;
+    scan_message(message, &scan);
+    parsed->length = scan.length;
+    parsed->colon = scan.colon;
+    size_t end = message[0] == '!' || message[0] == '?' ? scan.colon
+            : scan.length;
+    size_t start = message[0] == '!' || message[0] == '?';
+    parsed->validName = end > start && scan.colon >= end
+            && scan.carriageReturn >= end && scan.newline >= end;
+}
+
+/**
+ * @brief  builds a pipelined corpus like a busy control receives: add
+ * mapping, ask and visit lines, some with "\r\n" ends
+ * @param  length: set to the corpus size
+ * @retval the corpus, lines end with '\n'
+ */
+static char* build_corpus(size_t* length) {
+    size_t capacity = (size_t)BENCH_MESSAGES * 96;
+    char* corpus = malloc(capacity);
+    size_t used = 0;
+    srand(2310);
+    for (int i = 0; i < BENCH_MESSAGES; i++) {
+        const char* end = i % 7 == 0 ? "\r\n" : "\n";
+        int id = rand() % 10000;
+        switch (i % 3) {
+            case 0:
+                used += sprintf(corpus + used, "!Airport-%d-north-terminal"
+                        ":%d%s", id, 1024 + rand() % 60000, end);
+                break;
+            case 1:
+                used += sprintf(corpus + used, "?Airport-%d-north-terminal%s",
+                        id, end);
+                break;
+            default:
+                used += sprintf(corpus + used, "F%03d-%d%s", rand() % 1000,
+                        id, end);
+        }
+    }
+    *length = used;
+    return corpus;
+}
+
+/**
+ * @brief  splits the corpus into lines and parses each one
+ * @param  corpus: the corpus (a copy is parsed)
+ * @param  length: the corpus size
+ * @param  parse: the parser to run
+ * @param  results: filled with one result per line
+ * @retval nanoseconds per message
+ */
+static double run(const char* corpus, size_t length,
+        void (*parse)(char*, Parsed*), Parsed* results) {
+    char* copy = malloc(length + 1);
+    struct timespec start, end;
+    double total = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        memcpy(copy, corpus, length);
+        copy[length] = '\0';
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        char* line = copy;
+        int count = 0;
+        char* newline;
+        while ((newline = memchr(line, '\n', copy + length - line))
+                != NULL) {
+            *newline = '\0';
+            parse(line, &results[count++]);
+            line = newline + 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total += (end.tv_sec - start.tv_sec) * 1e9
+                + (end.tv_nsec - start.tv_nsec);
+    }
+    free(copy);
+    return total / BENCH_ROUNDS / BENCH_MESSAGES;
+}
+
+int main(int argc, char** argv) {
+    static const char* names[] = {"scalar", "sse2", "avx2"};
+    size_t length;
+    char* corpus = build_corpus(&length);
+    Parsed* expected = calloc(BENCH_MESSAGES, sizeof(Parsed));
+    Parsed* results = calloc(BENCH_MESSAGES, sizeof(Parsed));
+
+    printf("strcspn  %6.1f ns/message\n",
+            run(corpus, length, parse_strcspn, expected));
+    int status = 0;
+    for (int level = SCAN_SCALAR; level <= SCAN_AVX2; level++) {
+        scan_set_level((ScanLevel)level);
+        if (scan_level() != level) {
+            printf("%-8s unsupported\n", names[level]);
+            continue;
+        }
+        double time = run(corpus, length, parse_scan, results);
+        bool same = memcmp(expected, results,
+                sizeof(Parsed) * BENCH_MESSAGES) == 0;
+        printf("%-8s %6.1f ns/message%s\n", names[level], time,
+                same ? "" : " (MISMATCH)");
+        status |= !same;
+    }
+    free(corpus);
+    free(expected);
+    free(results);
+    return status;
+}
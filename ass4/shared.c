@@ -3,7 +3,13 @@
 #include <stdbool.h>
 #include <semaphore.h>
 #include <string.h>
+#include <ctype.h>
 #include "shared.h"
+#include "journal.h"
+#include "trace.h"
+#include "green.h"
+#include "scan.h"
+#include "latency.h"
 
 /** 
  * A non-zero value means the semaphore is shared between processes 
@@ -18,15 +24,19 @@
 Mapper* mapping_create() {
     Mapper* mapping = (Mapper*)malloc(sizeof(Mapper));
     mapping->maxNameSize = 0;
+    mapping->subscribers = NULL;
+    mapping->leases = lease_wheel_create();
+    mapping->registry = NULL;
+    mapping->ports = (PortAirport**)calloc(MAPPER_PORTS, 
+            sizeof(PortAirport*));
 
     // create and init semaphore
     mapping->semaphore = (sem_t*)malloc(sizeof(sem_t));
     sem_init(mapping->semaphore, SEMA_SHARE_THREAD, 1); 
 
-    // create and memset root trie node
-    mapping->mapperRootTrieNode = (TrieNode*)malloc(sizeof(TrieNode));
-    memset(mapping->mapperRootTrieNode->childNodes, 0,
-            sizeof(TrieNode*) * VALID_CHARS);    
+    // create root trie node
+    mapping->mapperRootTrieNode = trie_create();
+    mapping->trieChanges = 0;
 
     return mapping;
 }
@@ -38,19 +48,90 @@ Mapper* mapping_create() {
 Airport* airport_create() {
     Airport* airport = (Airport*)malloc(sizeof(Airport));
     airport->maxNameSize = 0;
+    airport->journal = NULL;
+    airport->history = visit_history_create();
+    airport->mapperPort = NULL;
+    airport->leaseSeconds = 0;
+    airport->group = NULL;
+    airport->sketch = NULL;
+    airport->exact = true;
 
     // create and init semaphore
     airport->semaphore = (sem_t*)malloc(sizeof(sem_t));
     sem_init(airport->semaphore, SEMA_SHARE_THREAD, 1);
     
-    // create and memset root trie node
-    airport->planeRootTrieNode = (TrieNode*)malloc(sizeof(TrieNode));
-    memset(airport->planeRootTrieNode->childNodes, 0,
-            sizeof(TrieNode*) * VALID_CHARS);    
+    // create root trie node
+    airport->planeRootTrieNode = trie_create();
+    airport->trieChanges = 0;
 
     return airport;
 }
 
+/**
+ * @brief  hosts another airport behind the port of the first one
+ * @note   all airports must be hosted before the port is listened on, 
+ * the group is only read after that
+ * @param  first: the airport served when a connection selects none
+ * @param  airport: the airport to add
+ * @retval true if added, false if its id is already hosted
+ */
+bool airport_host(Airport* first, Airport* airport) {
+    if (first->group == NULL) {
+        AirportGroup* group = (AirportGroup*)malloc(sizeof(AirportGroup));
+        group->names = trie_create();
+        group->count = 0;
+        group->capacity = 0;
+        group->airports = NULL;
+        first->group = group;
+        airport_host(first, first);
+    }
+    AirportGroup* group = first->group;
+    bool created;
+    TrieNode* node = trie_insert(group->names, airport->airportId, 
+            &created);
+    if (node->portNumber != 0) {
+        return false;
+    }
+    if (group->count == group->capacity) {
+        group->capacity = group->capacity * 2 + 1;
+        group->airports = (Airport**)realloc(group->airports, 
+                sizeof(Airport*) * group->capacity);
+    }
+    group->airports[group->count++] = airport;
+    node->portNumber = group->count;
+    airport->group = group;
+    return true;
+}
+
+/**
+ * @brief  walks the airports hosted with airport (itself included)
+ * @param  airport: any airport of the group
+ * @param  index: position of the wanted airport
+ * @retval the airport, NULL once index is past the last one
+ */
+Airport* airport_hosted(Airport* airport, int index) {
+    if (airport->group == NULL) {
+        return index == 0 ? airport : NULL;
+    }
+    return index < airport->group->count 
+            ? airport->group->airports[index] : NULL;
+}
+
+/**
+ * @brief  finds the airport a connection selected with =ID
+ * @param  airport: the airport the connection was made to
+ * @param  airportId: the id selected
+ * @retval the hosted airport, NULL if this port does not host it
+ */
+Airport* airport_select(Airport* airport, const char* airportId) {
+    if (airport->group == NULL) {
+        return strcmp(airport->airportId, airportId) ? NULL : airport;
+    }
+    TrieNode* node = trie_lookup(airport->group->names, airportId);
+    return node != NULL && node->portNumber != 0 
+            ? airport->group->airports[node->portNumber - 1] : NULL;
+}
+
 /**
  * @brief  finds the given airport within the trie tree
  * if the given name does not exist builds out the trie tree 
@@ -59,24 +140,14 @@ Airport* airport_create() {
  * @retval the target airports leaf trie node
  */
 TrieNode* mapping_find_trie(Mapper* mapping, const char* airportName) {
-    TrieNode* checkNode = mapping->mapperRootTrieNode;
-    int nameSize = 0;
-
-    while (airportName[0] != '\0') {
-        char next = airportName[0]; // next char in the name
-        nameSize++;
-        // the node for airport does not exist then construct it
-        if (checkNode->childNodes[(unsigned char)next] == NULL) {
-            TrieNode* newNode = (TrieNode*)malloc(sizeof(TrieNode));
-            newNode->namePart = next;
-            newNode->portNumber = 0;
-            memset(newNode->childNodes, 0, sizeof(TrieNode*) * VALID_CHARS);
-            checkNode->childNodes[(unsigned char)next] = newNode;
-        }
-        checkNode = checkNode->childNodes[(unsigned char)next];
-        airportName += 1; // move on
+    bool created;
+    TrieNode* checkNode = trie_insert(mapping->mapperRootTrieNode, 
+            airportName, &created);
+    if (created) {
+        mapping->trieChanges++; // lets the compactor spot a burst
     }
 
+    int nameSize = strlen(airportName);
     if (nameSize > mapping->maxNameSize) {
         mapping->maxNameSize = nameSize;
     }
@@ -93,25 +164,14 @@ TrieNode* mapping_find_trie(Mapper* mapping, const char* airportName) {
  * @retval the target planes leaf trie node
  */
 TrieNode* airport_find_trie(Airport* airport, const char* planeName) {
-    TrieNode* checkNode = airport->planeRootTrieNode;
-    int nameSize = 0;
-
-    while (planeName[0] != '\0') {
-        char next = planeName[0];
-        if (checkNode->childNodes[(unsigned char)next] == NULL) {
-            TrieNode* newNode = (TrieNode*)malloc(sizeof(TrieNode));
-            newNode->namePart = next;
-            newNode->portNumber = 0;
-            newNode->timeVisited = 0; // fpr later print
-            memset(newNode->childNodes, 0, sizeof(TrieNode*) * VALID_CHARS);
-            checkNode->childNodes[(unsigned char)next] = newNode;
-        }
-
-        checkNode = checkNode->childNodes[(unsigned char)next];
-        planeName += 1;
-        nameSize++;
+    bool created;
+    TrieNode* checkNode = trie_insert(airport->planeRootTrieNode, 
+            planeName, &created);
+    if (created) {
+        airport->trieChanges++;
     }
 
+    int nameSize = strlen(planeName);
     if (nameSize > airport->maxNameSize) {
         airport->maxNameSize = nameSize;
     }
@@ -121,16 +181,268 @@ TrieNode* airport_find_trie(Airport* airport, const char* planeName) {
 
 /**
  * @brief  record the visted of the plane name to airport
+ * @note   only the sketch is updated (without a lock) if the airport is 
+ * not exact
  * @param  airport: the airport to update
  * @param  planeName: the name of the plane update
  * @retval None
  */
 void airport_set_plane_id(Airport* airport, const char* planeName) {
-    sem_wait(airport->semaphore); // wait state
+    if (airport->sketch != NULL) {
+        sketch_record(airport->sketch, planeName); // lock free
+    }
+    if (!airport->exact) {
+        return; // only sketched, nothing kept per plane
+    }
+    latency_lock(airport->semaphore); // wait state
+    trace_lock_acquired();
     TrieNode* node = airport_find_trie(airport, planeName);
     node->portNumber = 1; // use for print recursively, no meaning
     node->timeVisited += 1; 
-    sem_post(airport->semaphore); // signal
+    if (node->name == NULL) {
+        node->name = strdup(planeName);
+    }
+    visit_history_record(airport->history, node->name);
+    if (airport->journal != NULL) {
+        journal_record(airport->journal, planeName); // memory only
+    }
+    green_sem_post(airport->semaphore); // signal
+}
+
+/**
+ * @brief  adds a number of visits of a plane without journaling them
+ * @note   used to rebuild the trie, and the sketch if one is kept, when 
+ * replaying the journal
+ * @param  airport: the airport to update
+ * @param  planeName: the name of the plane update
+ * @param  visits: number of visits to add
+ * @retval None
+ */
+void airport_add_visits(Airport* airport, const char* planeName, 
+        int visits) {
+    if (airport->sketch != NULL && visits > 0) {
+        sketch_record_many(airport->sketch, planeName, visits);
+    }
+    latency_lock(airport->semaphore);
+    trace_lock_acquired();
+    TrieNode* node = airport_find_trie(airport, planeName);
+    node->portNumber = 1;
+    node->timeVisited += visits;
+    green_sem_post(airport->semaphore);
+}
+
+/**
+ * @brief  tells everyone watching about a registration change, caller 
+ * must hold the semaphore
+ * @note   never waits on a slow subscriber
+ * @param  mapping: the mapping changed
+ * @param  airportName: the name of the airport changed
+ * @param  portNumber: its new port, 0 once its lease ran out
+ * @retval None
+ */
+static void mapping_notify(Mapper* mapping, const char* airportName, 
+        long portNumber) {
+    for (Subscriber* subscriber = mapping->subscribers; 
+            subscriber != NULL; subscriber = subscriber->next) {
+        subscriber_push(subscriber, airportName, portNumber);
+    }
+}
+
+/**
+ * @brief  copies the registration at node into the shared memory 
+ * registry, caller must hold the semaphore
+ * @param  mapping: the mapping changed
+ * @param  node: the node of the airport
+ * @param  airportName: the name of the airport
+ * @retval None
+ */
+static void mapping_publish(Mapper* mapping, TrieNode* node, 
+        const char* airportName) {
+    if (mapping->registry == NULL) {
+        return;
+    }
+    long deadline = node->lease != NULL 
+            ? __atomic_load_n(&node->lease->deadline, __ATOMIC_ACQUIRE) : 0;
+    registry_publish(mapping->registry, airportName, node->portNumber, 
+            deadline);
+}
+
+/**
+ * @brief  puts the registration at node under a new lease, caller must 
+ * hold the semaphore
+ * @param  mapping: the mapping to update
+ * @param  node: the node of the registered airport
+ * @param  airportName: the name of the airport
+ * @param  ttl: seconds until the lease runs out
+ * @retval None
+ */
+static void mapping_lease_node(Mapper* mapping, TrieNode* node, 
+        const char* airportName, long ttl) {
+    node->lease = lease_create(airportName, node->portNumber, ttl, node);
+    lease_wheel_add(mapping->leases, node->lease);
+}
+
+/**
+ * @brief  publishes how many airports share a port, so rocs know when 
+ * they have to select one with =ID, caller must hold the semaphore
+ * @note   ports with a single airport get no slot (or a count of 0)
+ * @param  mapping: the mapping changed
+ * @param  portNumber: the port whose reverse index changed
+ * @retval None
+ */
+static void mapping_publish_port(Mapper* mapping, long portNumber) {
+    if (mapping->registry == NULL || portNumber <= 0 
+            || portNumber >= MAPPER_PORTS) {
+        return;
+    }
+    long count = 0;
+    for (PortAirport* entry = mapping->ports[portNumber]; entry != NULL; 
+            entry = entry->next) {
+        count++;
+    }
+    char name[REGISTRY_NAME_SIZE];
+    registry_port_name(name, portNumber);
+    registry_publish(mapping->registry, name, count > 1 ? count : 0, 0);
+}
+
+/**
+ * @brief  adds a new registration to the reverse index of its port, 
+ * caller must hold the semaphore
+ * @note   ports past 65535 can be registered but are not indexed
+ * @param  mapping: the mapping changed
+ * @param  node: the node of the airport, holding its port
+ * @param  airportName: the name of the airport
+ * @retval None
+ */
+static void mapping_index_port(Mapper* mapping, TrieNode* node, 
+        const char* airportName) {
+    if (node->portNumber <= 0 || node->portNumber >= MAPPER_PORTS) {
+        return;
+    }
+    PortAirport* entry = (PortAirport*)malloc(sizeof(PortAirport));
+    entry->airportName = strdup(airportName);
+    entry->node = node;
+    entry->next = mapping->ports[node->portNumber];
+    mapping->ports[node->portNumber] = entry;
+    mapping_publish_port(mapping, node->portNumber);
+}
+
+/**
+ * @brief  removes a registration from the reverse index before its port 
+ * is cleared, caller must hold the semaphore
+ * @param  mapping: the mapping changed
+ * @param  node: the node of the airport, still holding its port
+ * @retval None
+ */
+static void mapping_unindex_port(Mapper* mapping, TrieNode* node) {
+    if (node->portNumber <= 0 || node->portNumber >= MAPPER_PORTS) {
+        return;
+    }
+    PortAirport** link = &mapping->ports[node->portNumber];
+    while (*link != NULL && (*link)->node != node) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        PortAirport* entry = *link;
+        *link = entry->next;
+        free(entry->airportName);
+        free(entry);
+        mapping_publish_port(mapping, node->portNumber);
+    }
+}
+
+/**
+ * @brief  removes a registration whose lease ran out, caller must hold 
+ * the semaphore
+ * @note   the lease itself stays in the wheel until the sweep frees it
+ * @param  mapping: the mapping to update
+ * @param  node: the node of the registered airport
+ * @retval None
+ */
+static void mapping_drop_lease(Mapper* mapping, TrieNode* node) {
+    Lease* lease = node->lease;
+    mapping_unindex_port(mapping, node);
+    node->portNumber = 0;
+    node->lease = NULL;
+    lease->node = NULL;
+    mapping_publish(mapping, node, lease->airportName);
+    mapping_notify(mapping, lease->airportName, 0);
+}
+
+/**
+ * @brief  stores the port of an airport, caller must hold the semaphore
+ * @note   an airport keeps the first port it was registered with until 
+ * its lease (if any) runs out
+ * @param  mapping: the mapping to update
+ * @param  airportName: the name of the airport update
+ * @param  portNumber: the portNumber the target airport should be set to
+ * @param  ttl: seconds the registration lasts unless renewed, 0 for ever
+ * @retval true if stored, false if the airport already holds a port
+ */
+static bool mapping_store_port_number(Mapper* mapping, 
+        const char* airportName, long portNumber, long ttl) {
+    TrieNode* node = mapping_find_trie(mapping, airportName);
+    if (node->lease != NULL && lease_expired(node->lease, lease_now())) {
+        mapping_drop_lease(mapping, node); // not swept yet, but free
+    }
+    if (node->portNumber == 0 && portNumber != 0) {
+        node->portNumber = portNumber;
+        mapping_index_port(mapping, node, airportName);
+        if (ttl > 0) {
+            mapping_lease_node(mapping, node, airportName, ttl);
+        }
+        mapping_publish(mapping, node, airportName);
+        mapping_notify(mapping, airportName, portNumber);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief  the recursive helper function for mapping_start_registry
+ * @param  mapping: the mapping being published
+ * @param  node: The trie node to inspect
+ * @param  nameStart: pointer to the start of the constructed trie string 
+ * @param  nameEnd: pointer to the last char of the constructed trie string
+ * @retval None
+ */
+static void mapping_publish_recursive(Mapper* mapping, TrieNode* node, 
+        char* nameStart, char* nameEnd) {
+    for (int i = 0; i < node->childCount; i++) {
+        TrieNode* branch = node->childNodes[i];
+        memcpy(nameEnd, branch->edge, branch->edgeLength);
+        nameEnd[branch->edgeLength] = '\0';
+        if (branch->portNumber != 0) {
+            mapping_publish(mapping, branch, nameStart);
+            mapping_publish_port(mapping, branch->portNumber);
+        }
+        mapping_publish_recursive(mapping, branch, nameStart, 
+                nameEnd + branch->edgeLength);
+    }
+}
+
+/**
+ * @brief  publishes the registrations into shared memory so rocs on this 
+ * host can resolve airports without connecting
+ * @note   the mapper keeps working without it if shared memory fails
+ * @param  mapping: the mapping to publish
+ * @param  port: the mapper's port, names the segment
+ * @param  slots: size of the segment, from registry_slot_count
+ * @retval None
+ */
+void mapping_start_registry(Mapper* mapping, uint16_t port, long slots) {
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    mapping->registry = registry_create(port, slots);
+    if (mapping->registry != NULL) {
+        char* name = (char*)malloc(sizeof(char) 
+                * (mapping->maxNameSize + 1));
+        name[0] = '\0';
+        mapping_publish_recursive(mapping, mapping->mapperRootTrieNode, 
+                name, name);
+        free(name);
+    }
+    green_sem_post(mapping->semaphore);
 }
 
 /**
@@ -138,16 +450,169 @@ void airport_set_plane_id(Airport* airport, const char* planeName) {
  * @param  mapping: the mapping to update
  * @param  airportName: the name of the airport update
  * @param  portNumber: the portNumber the target airport should be set to
+ * @param  ttl: seconds the registration lasts unless renewed, 0 for ever
  * @retval None
  */
 void mapping_set_port_number(Mapper* mapping, const char* airportName, 
-        long portNumber) {
-    sem_wait(mapping->semaphore);
-    TrieNode* node = mapping_find_trie(mapping, airportName);
-    if (node->portNumber == 0) {
-        node->portNumber = portNumber;
+        long portNumber, long ttl) {
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    mapping_store_port_number(mapping, airportName, portNumber, ttl);
+    green_sem_post(mapping->semaphore);
+}
+
+/**
+ * @brief  renews the lease of an airport registered with portNumber
+ * @note   registers the airport again if its lease already ran out (or 
+ * the mapper restarted), and puts a registration made without a ttl 
+ * under a lease. An airport registered with another port is left alone.
+ * @param  mapping: the mapping to update
+ * @param  airportName: the name of the airport to renew
+ * @param  portNumber: the port the airport is registered with
+ * @param  ttl: seconds until the lease runs out
+ * @retval None
+ */
+void mapping_renew_port_number(Mapper* mapping, const char* airportName, 
+        long portNumber, long ttl) {
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    TrieNode* node = trie_lookup(mapping->mapperRootTrieNode, airportName);
+    if (node != NULL && node->portNumber != 0 
+            && node->portNumber == portNumber) {
+        if (node->lease != NULL) {
+            lease_renew(node->lease, ttl);
+        } else {
+            mapping_lease_node(mapping, node, airportName, ttl);
+        }
+        mapping_publish(mapping, node, airportName);
+    } else {
+        mapping_store_port_number(mapping, airportName, portNumber, ttl);
+    }
+    green_sem_post(mapping->semaphore);
+}
+
+/**
+ * @brief  removes the registration of an airport, e.g. one whose lease 
+ * ran out on the mapper handing over
+ * @param  mapping: the mapping to update
+ * @param  airportName: the name of the airport to remove
+ * @retval None
+ */
+void mapping_remove_port_number(Mapper* mapping, const char* airportName) {
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    TrieNode* node = trie_lookup(mapping->mapperRootTrieNode, airportName);
+    if (node != NULL && node->lease != NULL) {
+        mapping_drop_lease(mapping, node);
+    } else if (node != NULL && node->portNumber != 0) {
+        mapping_unindex_port(mapping, node);
+        node->portNumber = 0;
+        mapping_publish(mapping, node, airportName);
+        mapping_notify(mapping, airportName, 0);
+    }
+    green_sem_post(mapping->semaphore);
+}
+
+/**
+ * @brief  drops every registration whose lease ran out
+ * @note   the wheel is turned under its own lock, the semaphore is only 
+ * held for LEASE_SWEEP_BATCH expiries at a time so lookups keep going
+ * @param  mapping: the mapping to sweep
+ * @retval None
+ */
+void mapping_expire_leases(Mapper* mapping) {
+    long now = lease_now();
+    bool due = lease_wheel_due(mapping->leases, now);
+    while (due) {
+        sem_wait(mapping->semaphore);
+        for (int i = 0; i < LEASE_SWEEP_BATCH; i++) {
+            Lease* lease = lease_wheel_take_due(mapping->leases);
+            if (lease == NULL) {
+                due = false;
+                break;
+            }
+            if (lease->node != NULL && !lease_expired(lease, now)) {
+                lease_wheel_add(mapping->leases, lease); // renewed since
+                continue;
+            }
+            if (lease->node != NULL) {
+                mapping_drop_lease(mapping, lease->node);
+            }
+            lease_free(lease);
+        }
+        green_sem_post(mapping->semaphore);
+    }
+}
+
+/**
+ * @brief  prints ID:PORT:TTL for each leased airport, TTL being the 
+ * seconds left
+ * @param  mapping: the mapping to check
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void mapping_print_leases(Mapper* mapping, LineWriter* streamWrite) {
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    lease_wheel_print(mapping->leases, streamWrite);
+    green_sem_post(mapping->semaphore);
+}
+
+/**
+ * @brief  sets the ports of many airports with a single lock acquisition
+ * @param  mapping: the mapping to update
+ * @param  airportNames: the names of the airports to update
+ * @param  portNumbers: the port of each airport (same order as names)
+ * @param  count: number of airports
+ * @retval number of airports stored, those already registered are not
+ */
+int mapping_set_port_numbers(Mapper* mapping, char* const* airportNames, 
+        const long* portNumbers, int count) {
+    int stored = 0;
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    for (int i = 0; i < count; i++) {
+        stored += mapping_store_port_number(mapping, airportNames[i], 
+                portNumbers[i], 0);
     }
-    sem_post(mapping->semaphore);
+    green_sem_post(mapping->semaphore);
+    return stored;
+}
+
+/**
+ * @brief  starts pushing registration changes to a new subscriber
+ * @param  mapping: the mapping to watch
+ * @param  prefix: only airports starting with this are pushed ("" for all)
+ * @retval the subscriber to wait on with subscriber_next
+ */
+Subscriber* mapping_subscribe(Mapper* mapping, const char* prefix) {
+    Subscriber* subscriber = subscriber_create(prefix);
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    subscriber->next = mapping->subscribers;
+    mapping->subscribers = subscriber;
+    green_sem_post(mapping->semaphore);
+    return subscriber;
+}
+
+/**
+ * @brief  stops and frees a subscriber
+ * @param  mapping: the mapping being watched
+ * @param  subscriber: the subscriber to remove
+ * @retval None
+ */
+void mapping_unsubscribe(Mapper* mapping, Subscriber* subscriber) {
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    Subscriber** link = &mapping->subscribers;
+    while (*link != NULL && *link != subscriber) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        *link = subscriber->next;
+    }
+    green_sem_post(mapping->semaphore);
+    subscriber_free(subscriber);
 }
 
 /**
@@ -157,88 +622,271 @@ void mapping_set_port_number(Mapper* mapping, const char* airportName,
  * @retval the portNumber of airport the desired airport in the local map
  */
 long mapping_get_port_number(Mapper* mapping, const char* airportName) {
-    sem_wait(mapping->semaphore);
-    TrieNode* node = mapping_find_trie(mapping, airportName);
-    long returnValue = node->portNumber;
-    sem_post(mapping->semaphore);
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    TrieNode* node = trie_lookup(mapping->mapperRootTrieNode, airportName);
+    long returnValue = node != NULL ? node->portNumber : 0;
+    if (node != NULL && node->lease != NULL 
+            && lease_expired(node->lease, lease_now())) {
+        returnValue = 0; // ran out, the sweep has not got to it yet
+    }
+    green_sem_post(mapping->semaphore);
     return returnValue;
 }
 
+/**
+ * @brief  gets the seconds left on the lease of an airport
+ * @param  mapping: the Mapper to find
+ * @param  airportName: the name of the airport search for
+ * @retval the seconds left (at least 1 while the sweep has not dropped 
+ * it), 0 if it is not leased
+ */
+long mapping_get_lease_left(Mapper* mapping, const char* airportName) {
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    TrieNode* node = trie_lookup(mapping->mapperRootTrieNode, airportName);
+    long left = 0;
+    if (node != NULL && node->lease != NULL) {
+        left = node->lease->deadline - lease_now();
+        left = left > 0 ? left : 1;
+    }
+    green_sem_post(mapping->semaphore);
+    return left;
+}
+
+/**
+ * @brief  prints the airports registered with a port, one per line, 
+ * straight from the reverse index without walking the trie
+ * @note   more than one airport shares a port when a control hosts many
+ * @param  mapping: the mapping to check
+ * @param  portNumber: the port
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void mapping_print_port_airports(Mapper* mapping, long portNumber, 
+        LineWriter* streamWrite) {
+    if (portNumber <= 0 || portNumber >= MAPPER_PORTS) {
+        return;
+    }
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    long now = lease_now();
+    for (PortAirport* entry = mapping->ports[portNumber]; entry != NULL; 
+            entry = entry->next) {
+        Lease* lease = entry->node->lease;
+        if (lease == NULL || !lease_expired(lease, now)) {
+            line_writer_printf(streamWrite, "%s\n", entry->airportName);
+        }
+    }
+    green_sem_post(mapping->semaphore);
+}
+
 /**
  * @brief  the recursive helper function for mapping_print_airport_port_Number
  * @param  node: The trie node to inspect
  * @param  nameStart: pointer to the start of the constructed trie string 
- * @param  nameEnd: pointer to the last char of the constructed trie string
- * @param  streamWrite: place to write
+ * @param  nameEnd: pointer to the last char of the constructed trie string,
+ * with room after the longest name for ":PORT"
+ * @param  encoder: place to write
  * @retval None
  */
 void mapping_print_name_recursive(TrieNode* node, char* nameStart, 
-        char* nameEnd, FILE* streamWrite) {
-    for (unsigned char i = 0; i < VALID_CHARS - 1; i++) {
+        char* nameEnd, Encoder* encoder) {
+    for (int i = 0; i < node->childCount; i++) {
+        TrieNode* branch = node->childNodes[i];
+        char* last = nameEnd + branch->edgeLength; // one past the name
+        memcpy(nameEnd, branch->edge, branch->edgeLength);
+        // don not print any unnessesary name
+        if (branch->portNumber != 0) {
+            int length = sprintf(last, ":%ld", branch->portNumber);
+            encoder_line(encoder, nameStart, last - nameStart + length, 0);
+        }
+        last[0] = '\0';
+        // recursive here 
+        mapping_print_name_recursive(branch, nameStart, 
+                nameEnd + branch->edgeLength, encoder);
+    }
+}
+
+// airports gathered by mapping_list_airports()
+typedef struct {
+    char** airportNames;
+    long* portNumbers;
+    int count;
+    int capacity;
+} AirportList;
+
+/**
+ * @brief  the recursive helper function for mapping_list_airports
+ * @param  node: The trie node to inspect
+ * @param  nameStart: pointer to the start of the constructed trie string 
+ * @param  nameEnd: pointer to the last char of the constructed trie string
+ * @param  now: current lease_now(), lapsed leases are left out
+ * @param  list: the airports found so far
+ * @retval None
+ */
+static void mapping_list_recursive(TrieNode* node, char* nameStart, 
+        char* nameEnd, long now, AirportList* list) {
+    for (int i = 0; i < node->childCount; i++) {
         TrieNode* branch = node->childNodes[i];
-        if (branch != NULL) {
-            nameEnd[0] = (char)i; 
-            nameEnd[1] = '\0';
-            // don not print any unnessesary name
-            if (branch->portNumber != 0) {
-                fprintf(streamWrite, "%s:%ld\n", nameStart, 
-                        branch->portNumber);
-                fflush(streamWrite);
+        memcpy(nameEnd, branch->edge, branch->edgeLength);
+        nameEnd[branch->edgeLength] = '\0';
+        if (branch->portNumber != 0 && (branch->lease == NULL 
+                || !lease_expired(branch->lease, now))) {
+            if (list->count == list->capacity) {
+                list->capacity = list->capacity * 2 + 16;
+                list->airportNames = (char**)realloc(list->airportNames, 
+                        sizeof(char*) * list->capacity);
+                list->portNumbers = (long*)realloc(list->portNumbers, 
+                        sizeof(long) * list->capacity);
             }
-            // recursive here 
-            mapping_print_name_recursive(branch, nameStart, 
-                    nameEnd + 1, streamWrite);
+            list->airportNames[list->count] = strdup(nameStart);
+            list->portNumbers[list->count++] = branch->portNumber;
         }
+        mapping_list_recursive(branch, nameStart, 
+                nameEnd + branch->edgeLength, now, list);
     }
 }
 
+/**
+ * @brief  copies out every registered airport in lexicographic order, so 
+ * they can be contacted without holding the semaphore
+ * @param  mapping: the mapping to check
+ * @param  airportNames: set to the names (each and the array malloc'd)
+ * @param  portNumbers: set to the port of each airport (malloc'd)
+ * @retval number of airports
+ */
+int mapping_list_airports(Mapper* mapping, char*** airportNames, 
+        long** portNumbers) {
+    AirportList list = {NULL, NULL, 0, 0};
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    char* name = (char*)malloc(sizeof(char) * (mapping->maxNameSize + 1));
+    name[0] = '\0';
+    mapping_list_recursive(mapping->mapperRootTrieNode, name, name, 
+            lease_now(), &list);
+    free(name);
+    green_sem_post(mapping->semaphore);
+    *airportNames = list.airportNames;
+    *portNumbers = list.portNumbers;
+    return list.count;
+}
+
 /**
  * @brief  prints each airport in lexicographic order along with its 
  * portNumber stored in the map delemited by a new line    
  * @note   airports with a portNumber of 0 are not printed
  * @param  mapping: the mapping to check
+ * @param  encoding: how to write the lines
  * @param  streamWrite: place to write
  * @retval None
  */
-void mapping_print_airport_port_numbers(Mapper* mapping, FILE* streamWrite) {
-    sem_wait(mapping->semaphore);
+void mapping_print_airport_port_numbers(Mapper* mapping, Encoding encoding,
+        LineWriter* streamWrite) {
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
 
     // create a temporary char* which will store the name of each airport 
-    // in the trie tree as it is traversed 
-    char* name = (char*)malloc(sizeof(char) * (mapping->maxNameSize + 1));
+    // in the trie tree as it is traversed, then ":PORT"
+    char* name = (char*)malloc(sizeof(char) * (mapping->maxNameSize + 24));
     name[0] = '\0';
 
+    Encoder* encoder = encoder_create(encoding, streamWrite);
     mapping_print_name_recursive(mapping->mapperRootTrieNode, 
-            name, name, streamWrite);
+            name, name, encoder);
+    encoder_free(encoder);
     
     free(name);
-    sem_post(mapping->semaphore);
+    green_sem_post(mapping->semaphore);
 }
 
 /**
- * @brief  the recursive helper function for airport_print_plane. 
+ * @brief  the recursive helper function for mapping_print_completions, 
+ * stops as soon as enough airports were printed
  * @param  node: The trie node to inspect
  * @param  nameStart: pointer to the start of the constructed trie string 
  * @param  nameEnd: pointer to the last char of the constructed trie string
+ * @param  remaining: how many more airports may be printed
  * @param  streamWrite: place to write
+ * @retval how many more airports may be printed after this subtree
+ */
+int mapping_complete_recursive(TrieNode* node, char* nameStart, 
+        char* nameEnd, int remaining, LineWriter* streamWrite) {
+    for (int i = 0; i < node->childCount && remaining > 0; i++) {
+        TrieNode* branch = node->childNodes[i];
+        memcpy(nameEnd, branch->edge, branch->edgeLength);
+        nameEnd[branch->edgeLength] = '\0';
+        if (branch->portNumber != 0) {
+            line_writer_printf(streamWrite, "%s:%ld\n", nameStart, 
+                    branch->portNumber);
+            remaining--;
+        }
+        remaining = mapping_complete_recursive(branch, nameStart, 
+                nameEnd + branch->edgeLength, remaining, streamWrite);
+    }
+    return remaining;
+}
+
+/**
+ * @brief  prints the first limit airports starting with prefix in 
+ * lexicographic order along with their portNumber
+ * @note   only the part of the trie under prefix is walked and the walk 
+ * stops after limit airports. No trie nodes are created.
+ * @param  mapping: the mapping to check
+ * @param  prefix: start of the airport names ("" for any)
+ * @param  limit: most airports to print
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void mapping_print_completions(Mapper* mapping, const char* prefix, 
+        int limit, LineWriter* streamWrite) {
+    size_t prefixLength = strlen(prefix);
+    latency_lock(mapping->semaphore);
+    trace_lock_acquired();
+    const char* edgeRest;
+    int edgeRestLength;
+    TrieNode* node = trie_find_prefix(mapping->mapperRootTrieNode, prefix, 
+            &edgeRest, &edgeRestLength);
+    if (node != NULL && limit > 0) {
+        // the node's name is the prefix plus the rest of its edge
+        char* name = (char*)malloc(sizeof(char) 
+                * (prefixLength + mapping->maxNameSize + 1));
+        memcpy(name, prefix, prefixLength);
+        memcpy(name + prefixLength, edgeRest, edgeRestLength);
+        size_t nameLength = prefixLength + edgeRestLength;
+        name[nameLength] = '\0';
+        if (node->portNumber != 0) {
+            line_writer_printf(streamWrite, "%s:%ld\n", name, 
+                    node->portNumber);
+            limit--;
+        }
+        mapping_complete_recursive(node, name, name + nameLength, limit, 
+                streamWrite);
+        free(name);
+    }
+    green_sem_post(mapping->semaphore);
+}
+
+/**
+ * @brief  the recursive helper function for airport_print_plane. 
+ * @param  node: The trie node to inspect
+ * @param  nameStart: pointer to the start of the constructed trie string 
+ * @param  nameEnd: pointer to the last char of the constructed trie string
+ * @param  encoder: place to write
  * @retval None
  */
 void airport_print_name_recursive(TrieNode* node, char* nameStart, 
-        char* nameEnd, FILE* streamWrite) {
-    for (unsigned char i = 0; i < VALID_CHARS - 1; i++) {
+        char* nameEnd, Encoder* encoder) {
+    for (int i = 0; i < node->childCount; i++) {
         TrieNode* branch = node->childNodes[i];
-        if (branch != NULL) {
-            nameEnd[0] = (char)i; 
-            nameEnd[1] = '\0';
-            if (branch->portNumber != 0) {
-                for (int i = 0; i < branch->timeVisited; i++) {
-                    fprintf(streamWrite, "%s\n", nameStart);
-                    fflush(streamWrite);
-                }
-            }
-            airport_print_name_recursive(branch, nameStart, 
-                    nameEnd + 1, streamWrite);
+        char* last = nameEnd + branch->edgeLength; // one past the name
+        memcpy(nameEnd, branch->edge, branch->edgeLength);
+        if (branch->portNumber != 0 && branch->timeVisited > 0) {
+            encoder_line(encoder, nameStart, last - nameStart, 
+                    branch->timeVisited);
         }
+        last[0] = '\0';
+        airport_print_name_recursive(branch, nameStart, last, encoder);
     }
 }
 
@@ -246,19 +894,221 @@ void airport_print_name_recursive(TrieNode* node, char* nameStart,
  * @brief  prints each plane visited the airport in lexicographic order  
  * delemited by a new line    
  * @param  airport: the airport to check
+ * @param  encoding: how to write the lines, rle and front once per plane
  * @param  streamWrite: place to write
  * @retval None
  */
-void airport_print_plane(Airport* airport, FILE* streamWrite) {
-    sem_wait(airport->semaphore);
+void airport_print_plane(Airport* airport, Encoding encoding, 
+        LineWriter* streamWrite) {
+    latency_lock(airport->semaphore);
+    trace_lock_acquired();
     char* name = (char*)malloc(sizeof(char) * (airport->maxNameSize + 1));
     name[0] = '\0';
 
+    Encoder* encoder = encoder_create(encoding, streamWrite);
     airport_print_name_recursive(airport->planeRootTrieNode, 
-            name, name, streamWrite);
+            name, name, encoder);
+    encoder_free(encoder);
     
     free(name); // cuz malloc
-    sem_post(airport->semaphore);
+    green_sem_post(airport->semaphore);
+}
+
+/**
+ * @brief  gets the current time on the airport visit clock
+ * @param  airport: the airport to check
+ * @retval whole seconds since the airport was created
+ */
+long airport_now(Airport* airport) {
+    return visit_history_now(airport->history);
+}
+
+/**
+ * @brief  qsort comparator for plane names
+ * @param  first: pointer to the first const char*
+ * @param  second: pointer to the second const char*
+ * @retval same as strcmp
+ */
+static int compare_names(const void* first, const void* second) {
+    return strcmp(*(const char* const*)first, *(const char* const*)second);
+}
+
+/**
+ * @brief  prints each visit made from second from to second to inclusive 
+ * in lexicographic order delemited by a new line
+ * @note   cost depends on the visits in the range, not the whole log. 
+ * Only the collection is done under the semaphore.
+ * @param  airport: the airport to check
+ * @param  from: first second (since the airport started)
+ * @param  to: last second (since the airport started)
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void airport_print_plane_range(Airport* airport, long from, long to, 
+        LineWriter* streamWrite) {
+    const char** names;
+    latency_lock(airport->semaphore);
+    trace_lock_acquired();
+    int count = visit_history_collect(airport->history, from, to, &names);
+    green_sem_post(airport->semaphore);
+
+    // names belong to visited nodes, which hold a port so trie_compact
+    // never frees them, safe unlocked
+    qsort(names, count, sizeof(const char*), compare_names);
+    for (int i = 0; i < count; i++) {
+        line_writer_printf(streamWrite, "%s\n", names[i]);
+    }
+    free(names);
+}
+
+/**
+ * @brief  prints the new cursor and the oldest visit still held as 
+ * #EPOCH:N:OLDEST, then each visit numbered after the given cursor in 
+ * the order they were made
+ * @note   a cursor of another epoch, or past the last visit (the control 
+ * restarted), is read as 0, so everything still held is sent again. A 
+ * client whose cursor is below OLDEST - 1 missed visits that aged out.
+ * @param  airport: the airport to check
+ * @param  epoch: the epoch of the cursor, 0 if it has none
+ * @param  after: the cursor from the client's last poll
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void airport_print_plane_after(Airport* airport, unsigned long epoch, 
+        unsigned long after, LineWriter* streamWrite) {
+    const char** names;
+    unsigned long oldest;
+    latency_lock(airport->semaphore);
+    trace_lock_acquired();
+    unsigned long cursor = airport->history->sequence;
+    if (after > cursor || (epoch != 0 && epoch != airport->history->epoch)) {
+        after = 0;
+    }
+    epoch = airport->history->epoch;
+    int count = visit_history_collect_after(airport->history, after, 
+            &names, &oldest);
+    green_sem_post(airport->semaphore);
+
+    // names belong to visited nodes, which hold a port so trie_compact
+    // never frees them, safe unlocked
+    line_writer_printf(streamWrite, "#%lu:%lu:%lu\n", epoch, cursor, 
+            oldest);
+    for (int i = 0; i < count; i++) {
+        line_writer_printf(streamWrite, "%s\n", names[i]);
+    }
+    free(names);
+}
+
+/**
+ * @brief  the recursive helper function for airport_for_each_plane
+ * @param  node: The trie node to inspect
+ * @param  nameStart: pointer to the start of the constructed trie string 
+ * @param  nameEnd: pointer to the last char of the constructed trie string
+ * @param  action: called for each visited plane
+ * @param  context: passed through to action
+ * @retval None
+ */
+void airport_each_name_recursive(TrieNode* node, char* nameStart, 
+        char* nameEnd, PlaneAction action, void* context) {
+    for (int i = 0; i < node->childCount; i++) {
+        TrieNode* branch = node->childNodes[i];
+        memcpy(nameEnd, branch->edge, branch->edgeLength);
+        nameEnd[branch->edgeLength] = '\0';
+        if (branch->portNumber != 0) {
+            action(nameStart, branch->timeVisited, context);
+        }
+        airport_each_name_recursive(branch, nameStart, 
+                nameEnd + branch->edgeLength, action, context);
+    }
+}
+
+/**
+ * @brief  calls action for each plane visited the airport in 
+ * lexicographic order, with its number of visits
+ * @note   caller must hold airport->semaphore
+ * @param  airport: the airport to walk
+ * @param  action: called with (name, visits, context)
+ * @param  context: passed through to action
+ * @retval None
+ */
+void airport_for_each_plane(Airport* airport, PlaneAction action, 
+        void* context) {
+    char* name = (char*)malloc(sizeof(char) * (airport->maxNameSize + 1));
+    name[0] = '\0';
+
+    airport_each_name_recursive(airport->planeRootTrieNode, 
+            name, name, action, context);
+    
+    free(name);
+}
+
+/**
+ * @brief  adds a plane to exact statistics, for airport_for_each_plane
+ * @param  planeName: the plane
+ * @param  visits: its visits
+ * @param  context: the ExactStats
+ * @retval None
+ */
+static void airport_stats_plane(const char* planeName, int visits, 
+        void* context) {
+    ExactStats* stats = (ExactStats*)context;
+    stats->visits += visits;
+    stats->unique++;
+    int slot = stats->count;
+    while (slot > 0 && stats->counts[slot - 1] < visits) {
+        slot--; // walked in name order, so ties stay in name order
+    }
+    if (slot == SKETCH_TOP_K) {
+        return;
+    }
+    if (stats->count == SKETCH_TOP_K) {
+        free(stats->names[--stats->count]);
+    }
+    memmove(stats->names + slot + 1, stats->names + slot, 
+            sizeof(char*) * (stats->count - slot));
+    memmove(stats->counts + slot + 1, stats->counts + slot, 
+            sizeof(long) * (stats->count - slot));
+    stats->names[slot] = strdup(planeName);
+    stats->counts[slot] = visits;
+    stats->count++;
+}
+
+/**
+ * @brief  prints "visits N", "unique N" and a PLANE:VISITS line for each 
+ * of the most visiting planes, highest first, from the sketch or exactly 
+ * from the trie (the caller ends the reply)
+ * @note   exact statistics walk the whole trie under the semaphore
+ * @param  airport: the airport to check
+ * @param  exact: true to count the trie, false to read the sketch
+ * @param  streamWrite: place to write
+ * @retval false if the airport does not keep what was asked for
+ */
+bool airport_print_stats(Airport* airport, bool exact, 
+        LineWriter* streamWrite) {
+    if (!exact) {
+        if (airport->sketch == NULL) {
+            return false;
+        }
+        sketch_print(airport->sketch, streamWrite);
+        return true;
+    } else if (!airport->exact) {
+        return false;
+    }
+    ExactStats stats;
+    memset(&stats, 0, sizeof(ExactStats));
+    latency_lock(airport->semaphore);
+    trace_lock_acquired();
+    airport_for_each_plane(airport, airport_stats_plane, &stats);
+    green_sem_post(airport->semaphore);
+    line_writer_printf(streamWrite, "visits %llu\nunique %llu\n", 
+            (unsigned long long)stats.visits, 
+            (unsigned long long)stats.unique);
+    for (int i = 0; i < stats.count; i++) {
+        line_writer_printf(streamWrite, "%s:%ld\n", stats.names[i], 
+                stats.counts[i]);
+        free(stats.names[i]);
+    }
+    return true;
 }
 
 /**
@@ -268,16 +1118,21 @@ void airport_print_plane(Airport* airport, FILE* streamWrite) {
  * @retval true if valid, otherwise false
  */
 bool is_valid_name(const char* name) {
-    if (name[0] == '\0') {
-        return false; // empty name
-    }
-    while (name[0] != '\0') {
-        char checkNamePart = name[0];
-        if (checkNamePart == '\n' || checkNamePart == '\r' 
-                || checkNamePart == ':') { 
-            return false;  // contains invalid namePart
-        }
-        name++;
+    ScanResult scan;
+    scan_text(name, &scan); // one vectorized pass over the name
+    return scan_is_name(&scan, scan.length);
+}
+
+/**
+ * @brief  parses a whole positive decimal number, e.g. a limit option
+ * @param  text: the text to parse
+ * @retval the number, or -1 if text is not a positive number
+ */
+long parse_positive_number(const char* text) {
+    char* numberError;
+    long number = strtol(text, &numberError, 10);
+    if (!isdigit(text[0]) || *numberError != '\0' || number <= 0) {
+        return -1;
     }
-    return true;
+    return number;
 }
\ No newline at end of file
@@ -4,18 +4,34 @@
 #include <stdint.h>
 #include <semaphore.h>
 #include <stdio.h>
+#include "lineStream.h"
+#include "subscription.h"
+#include "visitHistory.h"
+#include "trie.h"
+#include "lease.h"
+#include "registry.h"
+#include "encoding.h"
+#include "sketch.h"
 
-#define VALID_CHARS 256
 #define MAXMI_VALID_PORT 65536
+#define MAPPER_PORTS 65536 // the reverse index holds ports 1 to 65535
 
-/* a Node in the trie stored in Mapper and Airport */
-struct TrieNode {
-    long portNumber;
-    char namePart;
-    struct TrieNode* childNodes[VALID_CHARS];
-    int timeVisited; // use for roc2310 time count;
-};
-typedef struct TrieNode TrieNode;
+struct Journal;
+
+/* called for each plane when walking an airport */
+typedef void (*PlaneAction)(const char* planeName, int visits, 
+        void* context);
+
+/* exact statistics of an airport, gathered by walking its trie */
+typedef struct {
+    uint64_t visits;
+    uint64_t unique;
+    char* names[SKETCH_TOP_K]; // most visited first, ties by name
+    long counts[SKETCH_TOP_K];
+    int count;
+} ExactStats;
+
+struct AirportGroup;
 
 /* the airport */
 typedef struct {
@@ -23,34 +39,119 @@ typedef struct {
     const char* airportInfo;
     uint16_t port;
     TrieNode* planeRootTrieNode; // the plane have visited this airport
+    unsigned long trieChanges; // nodes created, read by the compactor
     sem_t* semaphore;
     int maxNameSize; // use for print name (malloc)
     int fileDescriptor; // for connect mapper
+    struct Journal* journal; // optional visit journal, NULL if none
+    VisitHistory* history; // recent visits by second
+    const char* mapperPort; // mapper to renew the registration with
+    long leaseSeconds; // ttl of the mapper registration, 0 for none
+    struct AirportGroup* group; // airports sharing its port, NULL if alone
+    VisitSketch* sketch; // approximate statistics, NULL unless enabled
+    bool exact; // planes kept in the trie, false when only sketched
 } Airport;
 
+/* airports hosted behind one control port, selected with =ID */
+struct AirportGroup {
+    TrieNode* names; // portNumber of an id is its index + 1 in airports
+    Airport** airports; // the first is served when none is selected
+    int count;
+    int capacity;
+};
+typedef struct AirportGroup AirportGroup;
+
+/* an airport in the reverse index, under the port it is registered with */
+typedef struct PortAirport {
+    char* airportName;
+    TrieNode* node; // its registration, never freed while it holds a port
+    struct PortAirport* next; // other airports on the same port
+} PortAirport;
+
 /* the local mapper connected airports */
 typedef struct {
     uint16_t port;
     TrieNode* mapperRootTrieNode; // trie can print content in lexi order
+    unsigned long trieChanges; // nodes created, read by the compactor
     sem_t* semaphore;
     int maxNameSize; // use for print name (malloc)
+    Subscriber* subscribers; // watching registrations, guarded by semaphore
+    LeaseWheel* leases; // registrations made with a ttl
+    Registry* registry; // shared memory copy for local rocs, or NULL
+    PortAirport** ports; // by port, MAPPER_PORTS heads, guarded by semaphore
 } Mapper;
 
 Mapper* mapping_create();
 
 Airport* airport_create();
 
+bool airport_host(Airport* first, Airport* airport);
+
+Airport* airport_hosted(Airport* airport, int index);
+
+Airport* airport_select(Airport* airport, const char* airportId);
+
 void airport_set_plane_id(Airport* airport, const char* planeName);
 
+void airport_add_visits(Airport* airport, const char* planeName, 
+        int visits);
+
+void airport_for_each_plane(Airport* airport, PlaneAction action, 
+        void* context);
+
+void mapping_start_registry(Mapper* mapping, uint16_t port, long slots);
+
 void mapping_set_port_number(Mapper* mapping, const char* airportName, 
-        long portNumber);
+        long portNumber, long ttl);
+
+void mapping_renew_port_number(Mapper* mapping, const char* airportName, 
+        long portNumber, long ttl);
+
+void mapping_remove_port_number(Mapper* mapping, const char* airportName);
+
+void mapping_expire_leases(Mapper* mapping);
+
+void mapping_print_leases(Mapper* mapping, LineWriter* streamWrite);
+
+int mapping_set_port_numbers(Mapper* mapping, char* const* airportNames, 
+        const long* portNumbers, int count);
+
+Subscriber* mapping_subscribe(Mapper* mapping, const char* prefix);
+
+void mapping_unsubscribe(Mapper* mapping, Subscriber* subscriber);
 
 long mapping_get_port_number(Mapper* mapping, const char* airportName);
 
-void mapping_print_airport_port_numbers(Mapper* mapping, FILE* streamWrite);
+long mapping_get_lease_left(Mapper* mapping, const char* airportName);
+
+void mapping_print_port_airports(Mapper* mapping, long portNumber, 
+        LineWriter* streamWrite);
+
+int mapping_list_airports(Mapper* mapping, char*** airportNames, 
+        long** portNumbers);
 
-void airport_print_plane(Airport* airport, FILE* streamWrite);
+void mapping_print_airport_port_numbers(Mapper* mapping, Encoding encoding,
+        LineWriter* streamWrite);
+
+void mapping_print_completions(Mapper* mapping, const char* prefix, 
+        int limit, LineWriter* streamWrite);
+
+void airport_print_plane(Airport* airport, Encoding encoding, 
+        LineWriter* streamWrite);
+
+long airport_now(Airport* airport);
+
+void airport_print_plane_range(Airport* airport, long from, long to, 
+        LineWriter* streamWrite);
+
+void airport_print_plane_after(Airport* airport, unsigned long epoch, 
+        unsigned long after, LineWriter* streamWrite);
+
+bool airport_print_stats(Airport* airport, bool exact, 
+        LineWriter* streamWrite);
 
 bool is_valid_name(const char* name);
 
+long parse_positive_number(const char* text);
+
 #endif
\ No newline at end of file
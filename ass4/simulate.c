@@ -0,0 +1,538 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "simulate.h"
+#include "connectionHandler.h"
+#include "trace.h"
+
+/**
+ * A non-zero value means the semaphore is shared between processes
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+#define NS_PER_US 1000
+#define NS_PER_MS 1000000.0
+#define NS_PER_SECOND 1000000000.0
+#define SIMULATE_INIT_SIZE 64
+#define DEST_STATUS 6 // a control refused or did not host the airport
+
+// shared by every thread
+static Resolver* resolver;
+
+// per plane results as they finish, guarded by outputLock
+static LineWriter* output;
+static sem_t* outputLock;
+
+// planes whose destination is looked up again, pushed with a compare and 
+// swap and taken all at once by the lookup thread
+static SimPlane* lookups = NULL;
+static sem_t* lookupsWaiting;
+
+/**
+ * @brief  adds a plane to a schedule
+ * @param  schedule: the schedule
+ * @param  planeId: plane name, kept
+ * @param  destinations: destinations in order, kept
+ * @param  count: number of destinations
+ * @retval None
+ */
+static void simulate_add(SimSchedule* schedule, char* planeId,
+        char** destinations, int count) {
+    if (schedule->count == schedule->capacity) {
+        schedule->capacity *= 2;
+        schedule->planes = (SimPlane*)realloc(schedule->planes,
+                sizeof(SimPlane) * schedule->capacity);
+    }
+    SimPlane* plane = &schedule->planes[schedule->count++];
+    memset(plane, 0, sizeof(SimPlane));
+    plane->planeId = planeId;
+    plane->destinations = destinations;
+    plane->count = count;
+    plane->ports = (long*)malloc(sizeof(long) * (count + 1));
+    plane->byId = (bool*)malloc(sizeof(bool) * (count + 1));
+    plane->select = (bool*)malloc(sizeof(bool) * (count + 1));
+    plane->fileDescriptor = -1;
+}
+
+/**
+ * @brief  creates an empty schedule
+ * @retval newly created schedule
+ */
+static SimSchedule* simulate_create() {
+    SimSchedule* schedule = (SimSchedule*)malloc(sizeof(SimSchedule));
+    schedule->count = 0;
+    schedule->capacity = SIMULATE_INIT_SIZE;
+    schedule->planes = (SimPlane*)malloc(sizeof(SimPlane)
+            * schedule->capacity);
+    return schedule;
+}
+
+/**
+ * @brief  generates planes SIM1 to SIMn, all flying the same destinations
+ * @param  planes: number of planes
+ * @param  destinations: destinations in order, shared by every plane
+ * @param  destinationCount: number of destinations
+ * @retval newly created schedule
+ */
+SimSchedule* simulate_generate(long planes, const char* const* destinations,
+        int destinationCount) {
+    SimSchedule* schedule = simulate_create();
+    for (long i = 1; i <= planes; i++) {
+        char planeId[32];
+        snprintf(planeId, sizeof(planeId), "SIM%ld", i);
+        simulate_add(schedule, strdup(planeId), (char**)destinations,
+                destinationCount);
+    }
+    return schedule;
+}
+
+/**
+ * @brief  loads a schedule of one "planeID dest1 dest2 ..." line per
+ * plane, blank lines are skipped
+ * @param  path: the schedule file
+ * @retval newly created schedule, NULL if the file can not be read
+ */
+SimSchedule* simulate_load(const char* path) {
+    int fileDescriptor = open(path, O_RDONLY);
+    if (fileDescriptor < 0) {
+        return NULL;
+    }
+    LineReader* reader = line_reader_create(fileDescriptor,
+            SIMULATE_LINE_SIZE);
+    SimSchedule* schedule = simulate_create();
+    StringView line;
+    LineStatus status;
+    while (status = line_reader_next(reader, &line),
+            status == LINE_OK || status == LINE_TOO_LONG) {
+        char* rest;
+        char* planeId = status == LINE_OK
+                ? strtok_r(line.data, " \t", &rest) : NULL;
+        if (planeId == NULL) {
+            continue;
+        }
+        int count = 0;
+        char** destinations = (char**)malloc(sizeof(char*)
+                * (strlen(rest) / 2 + 2));
+        char* destination;
+        while ((destination = strtok_r(NULL, " \t", &rest)) != NULL) {
+            destinations[count++] = strdup(destination);
+        }
+        simulate_add(schedule, strdup(planeId), destinations, count);
+    }
+    line_reader_free(reader);
+    close(fileDescriptor);
+    return schedule;
+}
+
+/**
+ * @brief  lands a plane (or gives up on it) and writes its result line
+ * @param  thread: the thread flying it
+ * @param  plane: the plane
+ * @param  status: the exit status roc2310 would give
+ * @retval None
+ */
+static void simulate_finish(SimThread* thread, SimPlane* plane, int status) {
+    if (plane->fileDescriptor >= 0) {
+        close(plane->fileDescriptor); // also leaves the epoll set
+        plane->fileDescriptor = -1;
+    }
+    plane->state = SIM_DONE;
+    plane->status = status;
+    plane->finish = trace_now();
+    thread->active--;
+    sem_wait(outputLock);
+    line_writer_printf(output, "%s:%d:%llu\n", plane->planeId, status,
+            (unsigned long long)(plane->finish - plane->start) / NS_PER_US);
+    sem_post(outputLock);
+}
+
+/**
+ * @brief  pushes a plane onto a list with a compare and swap
+ * @param  list: the list
+ * @param  plane: the plane
+ * @retval None
+ */
+static void simulate_push(SimPlane** list, SimPlane* plane) {
+    plane->nextLookup = __atomic_load_n(list, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(list, &plane->nextLookup, plane,
+            false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        // another plane was pushed first, nextLookup now points at it
+    }
+}
+
+/**
+ * @brief  forgets the cached port of each destination handed over and 
+ * looks it up again, then hands the plane back to its event loop
+ * @note   the lookups may ask the mapper, so no event loop does them
+ * @param  passArg: unused
+ * @retval never returns
+ */
+static void* simulate_lookup_thread(void* passArg) {
+    while (true) {
+        sem_wait(lookupsWaiting);
+        SimPlane* plane = __atomic_exchange_n(&lookups, NULL, 
+                __ATOMIC_ACQUIRE);
+        while (plane != NULL) { // empty if taken on an earlier wake up
+            SimPlane* next = plane->nextLookup;
+            int index = plane->next;
+            resolver_forget(resolver, plane->destinations[index]);
+            plane->found = resolver_lookup(resolver, 
+                    plane->destinations[index], &plane->ports[index], 
+                    &plane->byId[index], &plane->select[index]) 
+                    == RESOLVE_OK;
+            SimThread* thread = plane->thread;
+            simulate_push(&thread->lookedUp, plane);
+            uint64_t one = 1;
+            if (write(thread->wakeFD, &one, sizeof(uint64_t)) < 0) {
+                // counter is already non zero, the loop wakes up anyway
+            }
+            plane = next;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  hands the destination being visited to the lookup thread, once 
+ * per destination, as its control may have restarted on another port
+ * @note   the plane waits (SIM_LOOKUP) until it is handed back
+ * @param  plane: the plane
+ * @retval true if handed over, false if it is not an id or was already 
+ * looked up again
+ */
+static bool simulate_look_again(SimPlane* plane) {
+    if (!plane->byId[plane->next] || plane->retried) {
+        return false;
+    }
+    plane->retried = true;
+    plane->state = SIM_LOOKUP;
+    simulate_push(&lookups, plane);
+    sem_post(lookupsWaiting);
+    return true;
+}
+
+/**
+ * @brief  starts connecting to the plane's next destination
+ * @param  thread: the thread flying it
+ * @param  plane: the plane
+ * @retval None
+ */
+static void simulate_visit(SimThread* thread, SimPlane* plane) {
+    int fileDescriptor = resolver_connect_start(resolver,
+            plane->ports[plane->next]);
+    if (fileDescriptor < 0 && simulate_look_again(plane)) {
+        return; // visited again once it is handed back
+    }
+    struct epoll_event event;
+    event.events = EPOLLOUT;
+    event.data.ptr = plane;
+    plane->fileDescriptor = fileDescriptor;
+    if (fileDescriptor < 0 || epoll_ctl(thread->epollFD, EPOLL_CTL_ADD,
+            fileDescriptor, &event)) {
+        simulate_finish(thread, plane, DEST_STATUS);
+        return;
+    }
+    plane->state = SIM_CONNECTING;
+}
+
+/**
+ * @brief  sends the plane's name once its connect finished
+ * @param  thread: the thread flying it
+ * @param  plane: the plane
+ * @retval None
+ */
+static void simulate_connected(SimThread* thread, SimPlane* plane) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    int next = plane->next;
+    if (getsockopt(plane->fileDescriptor, SOL_SOCKET, SO_ERROR, &error,
+            &length) || error) {
+        close(plane->fileDescriptor);
+        plane->fileDescriptor = -1;
+        if (!simulate_look_again(plane)) {
+            simulate_finish(thread, plane, DEST_STATUS);
+        }
+        return;
+    }
+    // a request this small always fits in a new socket's buffer
+    LineWriter* streamWrite = line_writer_create(plane->fileDescriptor);
+    send_message_plane(plane->select[next] ? plane->destinations[next]
+            : NULL, plane->planeId, streamWrite);
+    bool sent = !streamWrite->failed;
+    line_writer_free(streamWrite);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = plane;
+    if (!sent || epoll_ctl(thread->epollFD, EPOLL_CTL_MOD,
+            plane->fileDescriptor, &event)) {
+        simulate_finish(thread, plane, DEST_STATUS);
+        return;
+    }
+    plane->state = SIM_REPLY;
+    plane->replyLength = 0;
+}
+
+/**
+ * @brief  reads the control's reply, moving on once its line ended
+ * @param  thread: the thread flying it
+ * @param  plane: the plane
+ * @retval None
+ */
+static void simulate_reply(SimThread* thread, SimPlane* plane) {
+    char buffer[SIMULATE_READ_SIZE];
+    bool ended = false;
+    while (!ended) {
+        ssize_t got = read(plane->fileDescriptor, buffer, sizeof(buffer));
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return; // rest of the line still to come
+        } else if (got < 0) {
+            simulate_finish(thread, plane, DEST_STATUS);
+            return;
+        }
+        char* newline = (char*)memchr(buffer, '\n', got);
+        ended = got == 0 || newline != NULL;
+        size_t lineBytes = newline != NULL ? newline - buffer : got;
+        if (plane->replyLength < sizeof(plane->replyStart)) {
+            size_t kept = sizeof(plane->replyStart) - plane->replyLength;
+            memcpy(plane->replyStart + plane->replyLength, buffer, 
+                    lineBytes < kept ? lineBytes : kept);
+        }
+        plane->replyLength += lineBytes;
+    }
+    close(plane->fileDescriptor);
+    plane->fileDescriptor = -1;
+    int next = plane->next;
+    if (is_selection_refused(plane->select[next] 
+            ? plane->destinations[next] : NULL, plane->replyStart, 
+            plane->replyLength)) {
+        if (!simulate_look_again(plane)) { // the port was reused
+            simulate_finish(thread, plane, DEST_STATUS);
+        }
+    } else if (++plane->next == plane->count) {
+        simulate_finish(thread, plane, RESOLVE_OK);
+    } else {
+        plane->retried = false;
+        simulate_visit(thread, plane);
+    }
+}
+
+/**
+ * @brief  visits again, or gives up on, the planes the lookup thread 
+ * handed back
+ * @param  thread: the thread
+ * @retval None
+ */
+static void simulate_looked_up(SimThread* thread) {
+    uint64_t wakeCount;
+    if (read(thread->wakeFD, &wakeCount, sizeof(uint64_t)) < 0) {
+        // already cleared by an earlier wake up
+    }
+    SimPlane* plane = __atomic_exchange_n(&thread->lookedUp, NULL, 
+            __ATOMIC_ACQUIRE);
+    while (plane != NULL) {
+        SimPlane* next = plane->nextLookup;
+        if (plane->found) {
+            simulate_visit(thread, plane);
+        } else {
+            simulate_finish(thread, plane, DEST_STATUS);
+        }
+        plane = next;
+    }
+}
+
+/**
+ * @brief  starts waiting planes until inFlight are active, a plane whose 
+ * destinations could not all be resolved fails as roc2310 would
+ * @param  thread: the thread
+ * @retval None
+ */
+static void simulate_fill(SimThread* thread) {
+    while (thread->active < thread->inFlight
+            && thread->started < thread->count) {
+        SimPlane* plane = thread->planes[thread->started++];
+        thread->active++;
+        plane->start = trace_now();
+        if (plane->status != RESOLVE_OK || plane->count == 0) {
+            simulate_finish(thread, plane, plane->status);
+        } else {
+            simulate_visit(thread, plane);
+        }
+    }
+}
+
+/**
+ * @brief  flies a thread's planes, moving each along as its socket
+ * becomes ready
+ * @param  passArg: pointer to the SimThread
+ * @retval NULL once every plane is done
+ */
+static void* simulate_thread(void* passArg) {
+    SimThread* thread = (SimThread*)passArg;
+    struct epoll_event events[SIMULATE_MAX_EVENTS];
+    simulate_fill(thread);
+    while (thread->active > 0) {
+        int count = epoll_wait(thread->epollFD, events, SIMULATE_MAX_EVENTS,
+                -1);
+        for (int i = 0; i < count; i++) {
+            SimPlane* plane = (SimPlane*)events[i].data.ptr;
+            if (plane == NULL) {
+                simulate_looked_up(thread);
+            } else if (plane->state == SIM_CONNECTING) {
+                simulate_connected(thread, plane);
+            } else if (plane->state == SIM_REPLY) {
+                simulate_reply(thread, plane);
+            }
+        }
+        simulate_fill(thread);
+    }
+    return NULL;
+}
+
+/**
+ * @brief  orders durations for qsort
+ * @param  first: a uint64_t
+ * @param  second: a uint64_t
+ * @retval negative, zero or positive as first is less, equal or greater
+ */
+static int simulate_compare(const void* first, const void* second) {
+    uint64_t a = *(const uint64_t*)first;
+    uint64_t b = *(const uint64_t*)second;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief  prints how long the simulation took and percentiles of the
+ * plane completion times to stderr
+ * @param  schedule: the finished schedule
+ * @param  elapsed: nanoseconds the whole simulation took
+ * @retval None
+ */
+static void simulate_report(SimSchedule* schedule, uint64_t elapsed) {
+    uint64_t* durations = (uint64_t*)malloc(sizeof(uint64_t)
+            * (schedule->count + 1));
+    long visits = 0;
+    int failed = 0;
+    for (int i = 0; i < schedule->count; i++) {
+        SimPlane* plane = &schedule->planes[i];
+        durations[i] = plane->finish - plane->start;
+        visits += plane->next;
+        failed += plane->status != RESOLVE_OK;
+    }
+    qsort(durations, schedule->count, sizeof(uint64_t), simulate_compare);
+    double seconds = elapsed / NS_PER_SECOND;
+    fprintf(stderr, "planes %d failed %d visits %ld in %.3fs "
+            "(%.0f planes/s, %.0f visits/s)\n", schedule->count, failed,
+            visits, seconds, schedule->count / seconds, visits / seconds);
+    if (schedule->count > 0) {
+        int last = schedule->count - 1;
+        fprintf(stderr, "completion p50=%.3fms p90=%.3fms p99=%.3fms "
+                "max=%.3fms\n", durations[last * 50 / 100] / NS_PER_MS,
+                durations[last * 90 / 100] / NS_PER_MS,
+                durations[last * 99 / 100] / NS_PER_MS,
+                durations[last] / NS_PER_MS);
+    }
+    free(durations);
+}
+
+/**
+ * @brief  flies every plane of a schedule from one process: planes are
+ * spread over a few threads, each an epoll loop over non-blocking
+ * sockets, with at most inFlight planes flying at once. A line
+ * "PLANE:STATUS:MICROSECONDS" is written to stdout as each plane finishes
+ * and a summary to stderr at the end.
+ * @param  schedule: the planes
+ * @param  mapperPort: port of the mapper, 0 for none ("-")
+ * @param  threads: event loops to run
+ * @param  inFlight: most planes flying at once
+ * @retval the largest exit status of a plane, -1 if it could not start
+ */
+int simulate_run(SimSchedule* schedule, long mapperPort, int threads,
+        int inFlight) {
+    sigset_t set; // a control closing early must not kill the simulation
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    resolver = resolver_create(mapperPort);
+    if (resolver == NULL) {
+        return -1;
+    }
+    output = line_writer_create(STDOUT_FILENO);
+    outputLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(outputLock, SEMA_SHARE_THREAD, 1);
+    lookupsWaiting = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(lookupsWaiting, SEMA_SHARE_THREAD, 0);
+    pthread_t lookupTid;
+    if (pthread_create(&lookupTid, NULL, simulate_lookup_thread, NULL)) {
+        return -1;
+    }
+    pthread_detach(lookupTid);
+
+    // resolved up front as roc2310 does, so no event loop waits on the 
+    // mapper, and the times measured are only the flights
+    for (int i = 0; i < schedule->count; i++) {
+        SimPlane* plane = &schedule->planes[i];
+        plane->status = RESOLVE_OK;
+        for (int j = 0; j < plane->count && plane->status == RESOLVE_OK; 
+                j++) {
+            plane->status = resolver_lookup(resolver, 
+                    plane->destinations[j], &plane->ports[j], 
+                    &plane->byId[j], &plane->select[j]);
+        }
+    }
+
+    SimThread* loops = (SimThread*)calloc(threads, sizeof(SimThread));
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    for (int i = 0; i < threads; i++) {
+        loops[i].epollFD = epoll_create1(0);
+        loops[i].wakeFD = eventfd(0, EFD_NONBLOCK);
+        if (loops[i].epollFD < 0 || loops[i].wakeFD < 0) {
+            return -1;
+        }
+        struct epoll_event wake;
+        wake.events = EPOLLIN;
+        wake.data.ptr = NULL; // the only event without a plane
+        if (epoll_ctl(loops[i].epollFD, EPOLL_CTL_ADD, loops[i].wakeFD, 
+                &wake)) {
+            return -1;
+        }
+        loops[i].planes = (SimPlane**)malloc(sizeof(SimPlane*)
+                * (schedule->count / threads + 1));
+        loops[i].inFlight = inFlight / threads + (i < inFlight % threads);
+        loops[i].inFlight = loops[i].inFlight > 0 ? loops[i].inFlight : 1;
+    }
+    for (int i = 0; i < schedule->count; i++) {
+        SimThread* loop = &loops[i % threads];
+        loop->planes[loop->count++] = &schedule->planes[i];
+        schedule->planes[i].thread = loop;
+    }
+    uint64_t start = trace_now();
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, simulate_thread, &loops[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        // wakeFD stays open, the lookup thread may still be writing to it
+        close(loops[i].epollFD);
+        free(loops[i].planes);
+    }
+    uint64_t elapsed = trace_now() - start;
+    line_writer_flush(output);
+    simulate_report(schedule, elapsed);
+    int worst = 0;
+    for (int i = 0; i < schedule->count; i++) {
+        worst = schedule->planes[i].status > worst
+                ? schedule->planes[i].status : worst;
+    }
+    free(loops);
+    free(tids);
+    return worst;
+}
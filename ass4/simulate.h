@@ -0,0 +1,72 @@
+#ifndef SIMULATE_H_
+#define SIMULATE_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "resolver.h"
+
+#define SIMULATE_THREADS 4 // event loops planes are spread over by default
+#define SIMULATE_IN_FLIGHT 16 // planes flying at once by default
+#define SIMULATE_MAX_EVENTS 64 // epoll events taken per wait
+#define SIMULATE_READ_SIZE 512 // reply bytes read per call
+#define SIMULATE_LINE_SIZE 65536 // longest schedule line
+
+/* what a plane is waiting for */
+typedef enum {
+    SIM_WAITING = 0, // not started
+    SIM_CONNECTING = 1, // its connect to a control to finish
+    SIM_REPLY = 2, // the control's reply
+    SIM_LOOKUP = 3, // the lookup thread to find its destination again
+    SIM_DONE = 4
+} SimState;
+
+/* one simulated plane, only touched by the thread flying it (or the 
+ * lookup thread while it is SIM_LOOKUP) */
+typedef struct SimPlane {
+    char* planeId;
+    char** destinations;
+    int count;
+    long* ports; // resolved before the event loops start
+    bool* byId; // resolved from an id, looked up again if refused
+    bool* select; // its port hosts several airports, =ID is sent
+    int next; // destination being visited
+    int fileDescriptor;
+    SimState state;
+    bool retried; // a refused id was looked up again at this destination
+    bool found; // the lookup thread found the destination again
+    struct SimThread* thread; // the event loop flying it
+    struct SimPlane* nextLookup; // next plane in a list of lookups
+    size_t replyLength; // bytes of the current reply before its '\n'
+    char replyStart[2]; // first bytes of the current reply
+    uint64_t start; // trace_now() it started
+    uint64_t finish; // trace_now() it landed or failed
+    int status; // resolve status until it flies, then roc2310's exit status
+} SimPlane;
+
+/* an event loop flying its share of the planes */
+typedef struct SimThread {
+    int epollFD;
+    int wakeFD; // eventfd, written once planes were looked up again
+    SimPlane* lookedUp; // planes handed back by the lookup thread
+    SimPlane** planes; // every threads-th plane of the schedule
+    int count;
+    int started; // planes taken off the front of planes
+    int active; // planes started but not done
+    int inFlight; // most planes active at once
+} SimThread;
+
+/* every plane of a simulation */
+typedef struct {
+    SimPlane* planes;
+    int count;
+    int capacity;
+} SimSchedule;
+
+SimSchedule* simulate_generate(long planes, const char* const* destinations,
+        int destinationCount);
+
+SimSchedule* simulate_load(const char* path);
+
+int simulate_run(SimSchedule* schedule, long mapperPort, int threads,
+        int inFlight);
+
+#endif
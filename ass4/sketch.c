@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <semaphore.h>
+#include "sketch.h"
+
+/**
+ * A non-zero value means the semaphore is shared between processes
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+#define SKETCH_MAX_RANK (64 - SKETCH_HLL_BITS + 1)
+
+/**
+ * @brief  creates empty statistics
+ * @retval newly created sketch
+ */
+VisitSketch* sketch_create() {
+    VisitSketch* sketch = (VisitSketch*)calloc(1, sizeof(VisitSketch));
+    sketch->topLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(sketch->topLock, SEMA_SHARE_THREAD, 1);
+    return sketch;
+}
+
+/**
+ * @brief  finishes a hash so every bit depends on every input bit
+ * (murmur3 fmix64)
+ * @param  hash: the hash to mix
+ * @retval the mixed hash
+ */
+static uint64_t sketch_mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    return hash ^ (hash >> 33);
+}
+
+/**
+ * @brief  hashes a plane name (FNV-1a 64, mixed)
+ * @param  name: the name
+ * @retval its hash
+ */
+static uint64_t sketch_hash(const char* name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* c = name; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    return sketch_mix(hash);
+}
+
+/**
+ * @brief  offers a plane to the top list, unless another visit is
+ * updating it (the plane is offered again on its next visit)
+ * @param  sketch: the sketch
+ * @param  planeName: the plane
+ * @param  estimate: its count-min estimate
+ * @retval None
+ */
+static void sketch_offer(VisitSketch* sketch, const char* planeName,
+        uint64_t estimate) {
+    if (strlen(planeName) >= SKETCH_NAME_SIZE
+            || sem_trywait(sketch->topLock)) {
+        return;
+    }
+    int slot = -1;
+    int lowest = 0;
+    for (int i = 0; i < sketch->topCount && slot < 0; i++) {
+        if (!strcmp(sketch->top[i].name, planeName)) {
+            slot = i;
+        } else if (sketch->top[i].count < sketch->top[lowest].count) {
+            lowest = i;
+        }
+    }
+    if (slot < 0 && sketch->topCount < SKETCH_TOP_K) {
+        slot = sketch->topCount++;
+    } else if (slot < 0 && estimate > sketch->top[lowest].count) {
+        slot = lowest; // evicts the lightest
+    }
+    if (slot >= 0) {
+        strcpy(sketch->top[slot].name, planeName);
+        sketch->top[slot].count = estimate;
+    }
+    uint64_t floor = sketch->top[0].count;
+    for (int i = 1; i < sketch->topCount; i++) {
+        floor = sketch->top[i].count < floor ? sketch->top[i].count : floor;
+    }
+    __atomic_store_n(&sketch->topFloor,
+            sketch->topCount < SKETCH_TOP_K ? 0 : floor, __ATOMIC_RELAXED);
+    sem_post(sketch->topLock);
+}
+
+/**
+ * @brief  counts a visit of a plane
+ * @param  sketch: the sketch
+ * @param  planeName: the plane
+ * @retval None
+ */
+void sketch_record(VisitSketch* sketch, const char* planeName) {
+    sketch_record_many(sketch, planeName, 1);
+}
+
+/**
+ * @brief  counts a number of visits of a plane at once, e.g. a plane's 
+ * line of a replayed journal
+ * @note   lock free: registers only grow (compare and swap) and counters
+ * are added to atomically. The top list lock is only tried, by planes
+ * whose estimate passes the list's floor.
+ * @param  sketch: the sketch
+ * @param  planeName: the plane
+ * @param  visits: number of visits
+ * @retval None
+ */
+void sketch_record_many(VisitSketch* sketch, const char* planeName, 
+        uint32_t visits) {
+    uint64_t hash = sketch_hash(planeName);
+    __atomic_add_fetch(&sketch->visits, visits, __ATOMIC_RELAXED);
+
+    // HyperLogLog: the top bits pick a register, which keeps the longest
+    // run of leading zeros seen in the rest
+    uint8_t* registers = &sketch->registers[hash >> (64 - SKETCH_HLL_BITS)];
+    uint64_t rest = hash << SKETCH_HLL_BITS;
+    uint8_t rank = rest == 0 ? SKETCH_MAX_RANK : __builtin_clzll(rest) + 1;
+    uint8_t seen = __atomic_load_n(registers, __ATOMIC_RELAXED);
+    while (rank > seen && !__atomic_compare_exchange_n(registers, &seen,
+            rank, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // seen was reloaded, try again while still larger
+    }
+
+    // count-min: one counter per row, the smallest overcounts least
+    uint64_t second = sketch_mix(hash ^ 0x9e3779b97f4a7c15ULL);
+    uint32_t first = (uint32_t)hash;
+    uint32_t step = (uint32_t)second | 1;
+    uint64_t estimate = UINT64_MAX;
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        uint32_t count = __atomic_add_fetch(&sketch->counters[row]
+                [(first + row * step) % SKETCH_WIDTH], visits, 
+                __ATOMIC_RELAXED);
+        estimate = count < estimate ? count : estimate;
+    }
+    if (estimate > __atomic_load_n(&sketch->topFloor, __ATOMIC_RELAXED)) {
+        sketch_offer(sketch, planeName, estimate);
+    }
+}
+
+/**
+ * @brief  estimates the number of different planes seen
+ * @param  sketch: the sketch
+ * @retval the HyperLogLog estimate, with the small range correction
+ */
+uint64_t sketch_unique(VisitSketch* sketch) {
+    double registers = SKETCH_HLL_REGISTERS;
+    double sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < SKETCH_HLL_REGISTERS; i++) {
+        uint8_t rank = __atomic_load_n(&sketch->registers[i],
+                __ATOMIC_RELAXED);
+        sum += ldexp(1.0, -rank);
+        zeros += rank == 0;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / registers);
+    double estimate = alpha * registers * registers / sum;
+    if (estimate <= 2.5 * registers && zeros > 0) {
+        estimate = registers * log(registers / zeros); // linear counting
+    }
+    return (uint64_t)(estimate + 0.5);
+}
+
+/**
+ * @brief  orders heavy hitters by count, highest first, then by name
+ * @param  first: a SketchHeavy
+ * @param  second: a SketchHeavy
+ * @retval negative if first goes first, otherwise positive or zero
+ */
+static int sketch_compare(const void* first, const void* second) {
+    const SketchHeavy* a = (const SketchHeavy*)first;
+    const SketchHeavy* b = (const SketchHeavy*)second;
+    if (a->count != b->count) {
+        return a->count > b->count ? -1 : 1;
+    }
+    return strcmp(a->name, b->name);
+}
+
+/**
+ * @brief  prints "visits N", "unique N" and a PLANE:VISITS line per heavy
+ * hitter, highest first (the caller ends the reply)
+ * @param  sketch: the sketch
+ * @param  streamWrite: place to write
+ * @retval None
+ */
+void sketch_print(VisitSketch* sketch, LineWriter* streamWrite) {
+    SketchHeavy top[SKETCH_TOP_K];
+    sem_wait(sketch->topLock);
+    int count = sketch->topCount;
+    memcpy(top, sketch->top, sizeof(SketchHeavy) * count);
+    sem_post(sketch->topLock);
+    qsort(top, count, sizeof(SketchHeavy), sketch_compare);
+    line_writer_printf(streamWrite, "visits %llu\nunique %llu\n",
+            (unsigned long long)__atomic_load_n(&sketch->visits,
+            __ATOMIC_RELAXED), (unsigned long long)sketch_unique(sketch));
+    for (int i = 0; i < count; i++) {
+        line_writer_printf(streamWrite, "%s:%llu\n", top[i].name,
+                (unsigned long long)top[i].count);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SKETCH_H_
+#define SKETCH_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <semaphore.h>
+#include "lineStream.h"
+
+#define SKETCH_HLL_BITS 14 // 2^14 registers, ~0.8% error on unique planes
+#define SKETCH_HLL_REGISTERS (1 << SKETCH_HLL_BITS)
+#define SKETCH_DEPTH 4 // count-min rows
+#define SKETCH_WIDTH 4096 // counters per row, overcount ~visits/2048
+#define SKETCH_TOP_K 10 // heavy hitters kept
+#define SKETCH_NAME_SIZE 64 // longest name kept in the top list plus '\0'
+
+/* a plane in the top list */
+typedef struct {
+    char name[SKETCH_NAME_SIZE];
+    uint64_t count; // its count-min estimate when it last visited
+} SketchHeavy;
+
+/**
+ * fixed size approximate visit statistics of an airport: a HyperLogLog
+ * of the planes, a count-min sketch of their visits and the planes with
+ * the highest estimates. Visits update the first two with atomics only.
+ */
+typedef struct {
+    uint64_t visits;
+    uint8_t registers[SKETCH_HLL_REGISTERS];
+    uint32_t counters[SKETCH_DEPTH][SKETCH_WIDTH];
+    uint64_t topFloor; // estimate a plane must pass to join a full list
+    SketchHeavy top[SKETCH_TOP_K]; // guarded by topLock
+    int topCount;
+    sem_t* topLock; // never waited for by a visit
+} VisitSketch;
+
+VisitSketch* sketch_create();
+
+void sketch_record(VisitSketch* sketch, const char* planeName);
+
+void sketch_record_many(VisitSketch* sketch, const char* planeName, 
+        uint32_t visits);
+
+uint64_t sketch_unique(VisitSketch* sketch);
+
+void sketch_print(VisitSketch* sketch, LineWriter* streamWrite);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "subscription.h"
+
+/** 
+ * A non-zero value means the semaphore is shared between processes 
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+
+/**
+ * @brief  creates a subscriber with an empty queue
+ * @param  prefix: only airports starting with this are pushed ("" for all)
+ * @retval newly created subscriber
+ */
+Subscriber* subscriber_create(const char* prefix) {
+    Subscriber* subscriber = (Subscriber*)malloc(sizeof(Subscriber));
+    subscriber->prefix = strdup(prefix);
+    subscriber->prefixLength = strlen(prefix);
+    subscriber->head = 0;
+    subscriber->count = 0;
+    subscriber->dropped = false;
+    subscriber->next = NULL;
+
+    subscriber->lock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(subscriber->lock, SEMA_SHARE_THREAD, 1);
+    subscriber->available = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(subscriber->available, SEMA_SHARE_THREAD, 0);
+    return subscriber;
+}
+
+/**
+ * @brief  queues a registration change if it matches the prefix
+ * @note   never blocks on the subscriber: if its queue is full it is 
+ * marked dropped and gets no further deltas
+ * @param  subscriber: the subscriber to notify
+ * @param  airportName: airport that was registered
+ * @param  portNumber: its new port
+ * @retval None
+ */
+void subscriber_push(Subscriber* subscriber, const char* airportName, 
+        long portNumber) {
+    if (strncmp(airportName, subscriber->prefix, 
+            subscriber->prefixLength)) {
+        return;
+    }
+
+    sem_wait(subscriber->lock);
+    if (subscriber->dropped) {
+        sem_post(subscriber->lock);
+        return;
+    }
+    if (subscriber->count == SUBSCRIBER_QUEUE_SIZE) {
+        subscriber->dropped = true; // too slow, cut it off
+    } else {
+        int tail = (subscriber->head + subscriber->count) 
+                % SUBSCRIBER_QUEUE_SIZE;
+        subscriber->queue[tail].airportName = strdup(airportName);
+        subscriber->queue[tail].portNumber = portNumber;
+        subscriber->count++;
+    }
+    sem_post(subscriber->lock);
+    sem_post(subscriber->available);
+}
+
+/**
+ * @brief  waits for the next delta queued for the subscriber
+ * @note   the caller owns (and must free) delta->airportName
+ * @param  subscriber: the subscriber to wait on
+ * @param  delta: filled with the next delta on SUBSCRIBER_DELTA
+ * @retval SUBSCRIBER_DELTA, SUBSCRIBER_IDLE or SUBSCRIBER_DROPPED
+ */
+SubscriberStatus subscriber_next(Subscriber* subscriber, Delta* delta) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += SUBSCRIBER_CHECK_SECONDS;
+    while (sem_timedwait(subscriber->available, &deadline)) {
+        if (errno == ETIMEDOUT) {
+            return SUBSCRIBER_IDLE;
+        }
+    }
+
+    sem_wait(subscriber->lock);
+    SubscriberStatus status = SUBSCRIBER_DROPPED;
+    if (!subscriber->dropped && subscriber->count > 0) {
+        *delta = subscriber->queue[subscriber->head];
+        subscriber->head = (subscriber->head + 1) % SUBSCRIBER_QUEUE_SIZE;
+        subscriber->count--;
+        status = SUBSCRIBER_DELTA;
+    }
+    sem_post(subscriber->lock);
+    return status;
+}
+
+/**
+ * @brief  frees the subscriber and anything still queued
+ * @note   must already be removed from the mapper
+ * @param  subscriber: the subscriber to free
+ * @retval None
+ */
+void subscriber_free(Subscriber* subscriber) {
+    for (int i = 0; i < subscriber->count; i++) {
+        int index = (subscriber->head + i) % SUBSCRIBER_QUEUE_SIZE;
+        free(subscriber->queue[index].airportName);
+    }
+    sem_destroy(subscriber->lock);
+    sem_destroy(subscriber->available);
+    free(subscriber->lock);
+    free(subscriber->available);
+    free(subscriber->prefix);
+    free(subscriber);
+}
@@ -0,0 +1,46 @@
+#ifndef SUBSCRIPTION_H_
+#define SUBSCRIPTION_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <semaphore.h>
+
+#define SUBSCRIBER_QUEUE_SIZE 256 // a subscriber this far behind is dropped
+#define SUBSCRIBER_CHECK_SECONDS 1 // how often an idle subscriber wakes up
+
+/* one registration change waiting to be pushed to a subscriber */
+typedef struct {
+    char* airportName;
+    long portNumber;
+} Delta;
+
+/* result of subscriber_next */
+typedef enum {
+    SUBSCRIBER_DELTA = 0,
+    SUBSCRIBER_IDLE = 1, // nothing arrived within SUBSCRIBER_CHECK_SECONDS
+    SUBSCRIBER_DROPPED = 2 // queue overflowed, subscriber is cut off
+} SubscriberStatus;
+
+/* a connection watching registrations, kept in a list on the mapper */
+struct Subscriber {
+    char* prefix; // only airports starting with prefix are pushed
+    size_t prefixLength;
+    Delta queue[SUBSCRIBER_QUEUE_SIZE]; // ring buffer
+    int head;
+    int count;
+    bool dropped;
+    sem_t* lock; // guards the ring buffer
+    sem_t* available; // counts deltas (plus one wake up once dropped)
+    struct Subscriber* next;
+};
+typedef struct Subscriber Subscriber;
+
+Subscriber* subscriber_create(const char* prefix);
+
+void subscriber_push(Subscriber* subscriber, const char* airportName, 
+        long portNumber);
+
+SubscriberStatus subscriber_next(Subscriber* subscriber, Delta* delta);
+
+void subscriber_free(Subscriber* subscriber);
+
+#endif
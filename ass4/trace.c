@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "trace.h"
+#include "latency.h"
+
+/**
+ * A non-zero value means the semaphore is shared between processes
+ * and a value of zero means it is shared between threads.
+ */
+#define SEMA_SHARE_THREAD 0
+#define NS_PER_SECOND 1000000000ULL
+#define TRACE_PATH_SIZE 256
+
+// guards the lists below, taken once per thread, never per request
+static sem_t* ringLock = NULL;
+static TraceRing* allRings = NULL;
+static TraceRing* freeRings = NULL;
+static int ringCount = 0;
+
+// hands a thread's ring back when the thread exits
+static pthread_key_t ringKey;
+
+// the ring this thread writes to, NULL until its first request
+static __thread TraceRing* threadRing = NULL;
+
+// the request this thread is working on
+static __thread TraceRecord current;
+static __thread bool tracing = false;
+
+// where SIGUSR1 dumps go
+static char dumpFile[TRACE_PATH_SIZE];
+
+/**
+ * @brief  current time for trace records
+ * @retval CLOCK_MONOTONIC in nanoseconds
+ */
+uint64_t trace_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+}
+
+/**
+ * @brief  puts the ring of an exiting thread on the free list, its 
+ * records are kept for the next thread
+ * @param  passArg: the ring
+ * @retval None
+ */
+static void trace_release_ring(void* passArg) {
+    TraceRing* ring = (TraceRing*)passArg;
+    sem_wait(ringLock);
+    ring->nextFree = freeRings;
+    freeRings = ring;
+    sem_post(ringLock);
+}
+
+/**
+ * @brief  gives this thread a ring, reusing one of an exited thread
+ * @retval the ring, NULL if trace_start was not called
+ */
+static TraceRing* trace_thread_ring() {
+    if (ringLock == NULL) {
+        return NULL;
+    }
+    sem_wait(ringLock);
+    TraceRing* ring = freeRings;
+    if (ring != NULL) {
+        freeRings = ring->nextFree;
+    } else {
+        ring = (TraceRing*)calloc(1, sizeof(TraceRing));
+        ring->number = ringCount++;
+        ring->next = allRings;
+        __atomic_store_n(&allRings, ring, __ATOMIC_RELEASE);
+    }
+    sem_post(ringLock);
+    pthread_setspecific(ringKey, ring);
+    threadRing = ring;
+    return ring;
+}
+
+/**
+ * @brief  sets the connection the following requests on this thread 
+ * belong to
+ * @param  fileDescriptor: the connection
+ * @param  acceptTime: when the connection was accepted
+ * @retval None
+ */
+void trace_connection(int fileDescriptor, uint64_t acceptTime) {
+    current.fileDescriptor = fileDescriptor;
+    current.acceptTime = acceptTime;
+}
+
+/**
+ * @brief  starts tracing a request on this thread
+ * @param  opcode: first char of the command
+ * @param  bytesIn: size of the request line
+ * @retval None
+ */
+void trace_begin(char opcode, size_t bytesIn) {
+    current.opcode = opcode;
+    current.parseTime = trace_now();
+    current.lockTime = 0;
+    current.bytesIn = bytesIn;
+    tracing = true;
+}
+
+/**
+ * @brief  notes that the request got its semaphore
+ * @note   called by the shared data functions, does nothing outside a 
+ * traced request
+ * @retval None
+ */
+void trace_lock_acquired() {
+    if (tracing) {
+        current.lockTime = trace_now();
+    }
+}
+
+/**
+ * @brief  finishes the request and puts its record into this thread's 
+ * own ring without taking any lock
+ * @param  bytesOut: size of the reply
+ * @retval None
+ */
+void trace_end(size_t bytesOut) {
+    if (!tracing) {
+        return;
+    }
+    tracing = false;
+    current.respondTime = trace_now();
+    current.bytesOut = bytesOut;
+    latency_record(latency_kind(current.opcode), 
+            current.respondTime - current.parseTime);
+    TraceRing* ring = threadRing;
+    if (ring == NULL && (ring = trace_thread_ring()) == NULL) {
+        return;
+    }
+
+    // the only writer: mark the slot busy, fill it, then publish it
+    unsigned long slot = ring->head++;
+    TraceRecord* record = &ring->records[slot % TRACE_RING_SIZE];
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    current.sequence = 0;
+    *record = current;
+    __atomic_store_n(&record->sequence, slot + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief  swaps the request this thread is working on with state, so 
+ * green threads sharing an OS thread each keep their own record
+ * @param  state: the saved request to put back (gets the current one)
+ * @retval None
+ */
+void trace_swap(TraceState* state) {
+    TraceState saved = {current, tracing};
+    current = state->record;
+    tracing = state->tracing;
+    *state = saved;
+}
+
+/**
+ * @brief  prints an elapsed time since start, or - if it never happened
+ * @param  file: where to print
+ * @param  start: the start time
+ * @param  end: the later time, 0 if none
+ * @retval None
+ */
+static void trace_print_elapsed(FILE* file, uint64_t start, uint64_t end) {
+    if (end == 0) {
+        fprintf(file, " -");
+    } else {
+        fprintf(file, " %llu", (unsigned long long)(end - start));
+    }
+}
+
+/**
+ * @brief  writes every complete record in every ring to the dump file, 
+ * records being written at the time are skipped
+ * @retval None
+ */
+static void trace_dump() {
+    FILE* file = fopen(dumpFile, "w");
+    if (file == NULL) {
+        return;
+    }
+    fprintf(file, "# ring opcode fd accept_ns parse_ns lock_ns respond_ns "
+            "bytes_in bytes_out (parse/lock/respond are ns after accept)\n");
+    for (TraceRing* ring = __atomic_load_n(&allRings, __ATOMIC_ACQUIRE); 
+            ring != NULL; ring = ring->next) {
+        for (int j = 0; j < TRACE_RING_SIZE; j++) {
+            TraceRecord* slot = &ring->records[j];
+            unsigned long before = __atomic_load_n(&slot->sequence, 
+                    __ATOMIC_ACQUIRE);
+            TraceRecord record = *slot;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            unsigned long after = __atomic_load_n(&slot->sequence, 
+                    __ATOMIC_ACQUIRE);
+            if (before == 0 || before != after) {
+                continue; // empty or being overwritten
+            }
+            fprintf(file, "%d %c %d %llu", ring->number, record.opcode, 
+                    record.fileDescriptor, 
+                    (unsigned long long)record.acceptTime);
+            trace_print_elapsed(file, record.acceptTime, record.parseTime);
+            trace_print_elapsed(file, record.acceptTime, record.lockTime);
+            trace_print_elapsed(file, record.acceptTime, 
+                    record.respondTime);
+            fprintf(file, " %u %u\n", record.bytesIn, record.bytesOut);
+        }
+    }
+    fclose(file);
+}
+
+/**
+ * @brief  waits for SIGUSR1 and dumps the rings each time it arrives
+ * @param  passArg: unused
+ * @retval never returns
+ */
+static void* trace_signal_thread(void* passArg) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    int signal;
+    while (true) {
+        if (sigwait(&set, &signal) == 0) {
+            trace_dump();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  starts the thread dumping the trace rings on SIGUSR1
+ * @note   SIGUSR1 must already be blocked in the calling thread so every 
+ * later thread inherits the mask
+ * @param  dumpPath: file to dump to, NULL for programName.PID.trace
+ * @param  programName: used for the default file name
+ * @retval None
+ */
+void trace_start(const char* dumpPath, const char* programName) {
+    if (dumpPath != NULL) {
+        snprintf(dumpFile, TRACE_PATH_SIZE, "%s", dumpPath);
+    } else {
+        snprintf(dumpFile, TRACE_PATH_SIZE, "%s.%d.trace", programName, 
+                (int)getpid());
+    }
+    ringLock = (sem_t*)malloc(sizeof(sem_t));
+    sem_init(ringLock, SEMA_SHARE_THREAD, 1);
+    pthread_key_create(&ringKey, trace_release_ring);
+    pthread_t tid;
+    pthread_create(&tid, NULL, trace_signal_thread, NULL);
+    pthread_detach(tid);
+}
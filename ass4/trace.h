@@ -0,0 +1,51 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_RING_SIZE 1024 // records kept per ring (oldest overwritten)
+
+/* what happened to one request, times are CLOCK_MONOTONIC nanoseconds */
+typedef struct {
+    unsigned long sequence; // slot number + 1 once complete, 0 while written
+    char opcode; // first char of the command, 'l' log, 'v' visit
+    int fileDescriptor;
+    uint64_t acceptTime; // connection accepted
+    uint64_t parseTime; // request line read
+    uint64_t lockTime; // semaphore acquired, 0 if never taken
+    uint64_t respondTime; // reply flushed
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+} TraceRecord;
+
+/* ring of the latest records of one thread, which alone writes it */
+typedef struct TraceRing {
+    unsigned long head; // next slot to write
+    int number; // order it was made in, shown in the dump
+    TraceRecord records[TRACE_RING_SIZE];
+    struct TraceRing* next; // every ring made, walked by the dump
+    struct TraceRing* nextFree; // rings of exited threads, reused
+} TraceRing;
+
+/* a thread's request in progress, kept aside while a green thread sleeps */
+typedef struct {
+    TraceRecord record;
+    bool tracing;
+} TraceState;
+
+void trace_start(const char* dumpPath, const char* programName);
+
+uint64_t trace_now();
+
+void trace_connection(int fileDescriptor, uint64_t acceptTime);
+
+void trace_begin(char opcode, size_t bytesIn);
+
+void trace_lock_acquired();
+
+void trace_end(size_t bytesOut);
+
+void trace_swap(TraceState* state);
+
+#endif
@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "trie.h"
+#include "green.h"
+
+// one trie watched by trie_compactor_thread()
+struct TrieCompactor {
+    TrieNode* root;
+    sem_t* semaphore; // the lock guarding the trie
+    unsigned long* changes; // bumped by the owner on every new node
+    unsigned long seen; // changes at the last check
+    unsigned long compacted; // changes at the last compaction
+    struct TrieCompactor* next;
+};
+typedef struct TrieCompactor TrieCompactor;
+
+// every watched trie, one thread checks them all (a control hosting many 
+// airports has many tries). Only ever pushed to, with a compare and swap.
+static TrieCompactor* compactors = NULL;
+
+/**
+ * @brief  creates a node with the given edge and no children
+ * @param  edge: chars on the edge from the parent
+ * @param  edgeLength: number of chars
+ * @retval newly created node
+ */
+static TrieNode* trie_node_create(const char* edge, int edgeLength) {
+    TrieNode* node = (TrieNode*)malloc(sizeof(TrieNode));
+    node->portNumber = 0;
+    node->timeVisited = 0;
+    node->name = NULL;
+    node->lease = NULL;
+    node->edge = (char*)malloc(sizeof(char) * (edgeLength + 1));
+    memcpy(node->edge, edge, edgeLength);
+    node->edgeLength = edgeLength;
+    node->childCount = 0;
+    node->childCapacity = 0;
+    node->childNodes = NULL;
+    return node;
+}
+
+/**
+ * @brief  creates an empty trie
+ * @retval the root node (with an empty edge)
+ */
+TrieNode* trie_create() {
+    return trie_node_create("", 0);
+}
+
+/**
+ * @brief  binary search for the child whose edge starts with first
+ * @param  node: the node to search
+ * @param  first: first char of the wanted edge
+ * @param  found: set to true if such a child exists
+ * @retval index of the child, or where it would be inserted
+ */
+static int trie_child_index(TrieNode* node, unsigned char first, 
+        bool* found) {
+    int low = 0;
+    int high = node->childCount;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        unsigned char check = node->childNodes[middle]->edge[0];
+        if (check == first) {
+            *found = true;
+            return middle;
+        } else if (check < first) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *found = false;
+    return low;
+}
+
+/**
+ * @brief  puts a child into the sorted child array at index
+ * @param  node: the parent
+ * @param  index: position from trie_child_index
+ * @param  child: the new child
+ * @retval None
+ */
+static void trie_add_child(TrieNode* node, int index, TrieNode* child) {
+    if (node->childCount == node->childCapacity) {
+        node->childCapacity = node->childCapacity ? node->childCapacity * 2 
+                : 1;
+        node->childNodes = (TrieNode**)realloc(node->childNodes, 
+                sizeof(TrieNode*) * node->childCapacity);
+    }
+    memmove(node->childNodes + index + 1, node->childNodes + index, 
+            sizeof(TrieNode*) * (node->childCount - index));
+    node->childNodes[index] = child;
+    node->childCount++;
+}
+
+/**
+ * @brief  finds the node for name, building out the trie if it does not 
+ * exist (splitting an edge where name leaves it)
+ * @note   caller must hold the lock guarding the trie
+ * @param  root: the trie root
+ * @param  name: the name to find
+ * @param  created: set to true if any node was created, may be NULL
+ * @retval the node name ends at
+ */
+TrieNode* trie_insert(TrieNode* root, const char* name, bool* created) {
+    TrieNode* node = root;
+    if (created != NULL) {
+        *created = false;
+    }
+    while (name[0] != '\0') {
+        bool found;
+        int index = trie_child_index(node, (unsigned char)name[0], &found);
+        if (!found) {
+            TrieNode* leaf = trie_node_create(name, strlen(name));
+            trie_add_child(node, index, leaf);
+            if (created != NULL) {
+                *created = true;
+            }
+            return leaf;
+        }
+
+        TrieNode* child = node->childNodes[index];
+        int common = 1; // first char is known to match
+        while (common < child->edgeLength && name[common] == 
+                child->edge[common]) {
+            common++;
+        }
+        if (common < child->edgeLength) {
+            // name leaves the edge part way, split it at that point
+            TrieNode* middle = trie_node_create(child->edge, common);
+            memmove(child->edge, child->edge + common, 
+                    child->edgeLength - common);
+            child->edgeLength -= common;
+            trie_add_child(middle, 0, child);
+            node->childNodes[index] = middle;
+            if (created != NULL) {
+                *created = true;
+            }
+            child = middle;
+        }
+        node = child;
+        name += common;
+    }
+    return node;
+}
+
+/**
+ * @brief  finds the node for name without changing the trie
+ * @note   caller must hold the lock guarding the trie
+ * @param  root: the trie root
+ * @param  name: the name to find
+ * @retval the node name ends at, NULL if there is none
+ */
+TrieNode* trie_lookup(TrieNode* root, const char* name) {
+    TrieNode* node = root;
+    while (name[0] != '\0') {
+        bool found;
+        int index = trie_child_index(node, (unsigned char)name[0], &found);
+        if (!found) {
+            return NULL;
+        }
+        node = node->childNodes[index];
+        for (int i = 1; i < node->edgeLength; i++) {
+            if (name[i] != node->edge[i]) { // also stops at name's '\0'
+                return NULL;
+            }
+        }
+        name += node->edgeLength;
+    }
+    return node;
+}
+
+/**
+ * @brief  finds the highest node whose name starts with prefix
+ * @note   prefix may end inside the node's edge, the rest of that edge 
+ * is given back so the caller can rebuild the node's full name
+ * @param  root: the trie root
+ * @param  prefix: start of the names wanted
+ * @param  edgeRest: set to the chars of the edge after the prefix
+ * @param  edgeRestLength: set to the number of those chars
+ * @retval the node, NULL if no name starts with prefix
+ */
+TrieNode* trie_find_prefix(TrieNode* root, const char* prefix, 
+        const char** edgeRest, int* edgeRestLength) {
+    TrieNode* node = root;
+    *edgeRest = "";
+    *edgeRestLength = 0;
+    while (prefix[0] != '\0') {
+        bool found;
+        int index = trie_child_index(node, (unsigned char)prefix[0], 
+                &found);
+        if (!found) {
+            return NULL;
+        }
+        node = node->childNodes[index];
+        int matched = 1;
+        while (matched < node->edgeLength && prefix[matched] != '\0') {
+            if (prefix[matched] != node->edge[matched]) {
+                return NULL;
+            }
+            matched++;
+        }
+        if (prefix[matched] == '\0') {
+            *edgeRest = node->edge + matched;
+            *edgeRestLength = node->edgeLength - matched;
+            return node;
+        }
+        prefix += matched;
+    }
+    return node;
+}
+
+/**
+ * @brief  the recursive helper function for trie_compact
+ * @param  node: the node whose children are compacted
+ * @retval None
+ */
+static void trie_compact_recursive(TrieNode* node) {
+    int kept = 0;
+    for (int i = 0; i < node->childCount; i++) {
+        TrieNode* child = node->childNodes[i];
+        // an empty node with one child is only a joint, merge the edges
+        while (child->portNumber == 0 && child->childCount == 1) {
+            TrieNode* grandChild = child->childNodes[0];
+            int length = child->edgeLength + grandChild->edgeLength;
+            char* edge = (char*)malloc(sizeof(char) * (length + 1));
+            memcpy(edge, child->edge, child->edgeLength);
+            memcpy(edge + child->edgeLength, grandChild->edge, 
+                    grandChild->edgeLength);
+            free(grandChild->edge);
+            grandChild->edge = edge;
+            grandChild->edgeLength = length;
+            free(child->edge);
+            free(child->childNodes);
+            free(child);
+            child = grandChild;
+        }
+        if (child->portNumber == 0 && child->childCount == 0 
+                && child->name == NULL) {
+            free(child->edge); // nothing ends here any more
+            free(child->childNodes);
+            free(child);
+            continue;
+        }
+        trie_compact_recursive(child);
+        node->childNodes[kept++] = child;
+    }
+    node->childCount = kept;
+
+    // re-pack the child array to its exact size
+    if (node->childCapacity > node->childCount) {
+        node->childCapacity = node->childCount;
+        if (node->childCount == 0) {
+            free(node->childNodes);
+            node->childNodes = NULL;
+        } else {
+            node->childNodes = (TrieNode**)realloc(node->childNodes, 
+                    sizeof(TrieNode*) * node->childCount);
+        }
+    }
+}
+
+/**
+ * @brief  merges single child chains left by split or emptied nodes, 
+ * drops empty leaves and shrinks child arrays to their exact size
+ * @note   caller must hold the lock guarding the trie. Nodes holding a 
+ * port or a visit are never freed, so pointers to them stay valid.
+ * @param  root: the trie root
+ * @retval None
+ */
+void trie_compact(TrieNode* root) {
+    trie_compact_recursive(root);
+}
+
+/**
+ * @brief  background thread, compacts each trie once a burst of inserts 
+ * is over (changes seen but none during the last TRIE_COMPACT_SECONDS)
+ * @param  passArg: unused
+ * @retval never returns
+ */
+static void* trie_compactor_thread(void* passArg) {
+    while (true) {
+        sleep(TRIE_COMPACT_SECONDS);
+        for (TrieCompactor* compactor = __atomic_load_n(&compactors, 
+                __ATOMIC_ACQUIRE); compactor != NULL; 
+                compactor = compactor->next) {
+            sem_wait(compactor->semaphore);
+            unsigned long changes = *compactor->changes;
+            if (changes != compactor->compacted 
+                    && changes == compactor->seen) {
+                trie_compact(compactor->root);
+                compactor->compacted = changes;
+            }
+            green_sem_post(compactor->semaphore);
+            compactor->seen = changes;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  has the compactor thread (started on the first call) compact 
+ * the trie after bursts
+ * @param  root: the trie root
+ * @param  semaphore: the lock guarding the trie
+ * @param  changes: counter the owner bumps (under semaphore) on changes
+ * @retval None
+ */
+void trie_start_compactor(TrieNode* root, sem_t* semaphore, 
+        unsigned long* changes) {
+    TrieCompactor* compactor = (TrieCompactor*)malloc(sizeof(TrieCompactor));
+    compactor->root = root;
+    compactor->semaphore = semaphore;
+    compactor->changes = changes;
+    compactor->seen = 0;
+    compactor->compacted = 0;
+    compactor->next = __atomic_load_n(&compactors, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&compactors, &compactor->next, 
+            compactor, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        // another trie was added first, next now points at it
+    }
+    if (compactor->next == NULL) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, trie_compactor_thread, NULL);
+        pthread_detach(tid);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef TRIE_H_
+#define TRIE_H_
+#include <stdbool.h>
+#include <semaphore.h>
+
+#define TRIE_COMPACT_SECONDS 1 // compactor checks this often for a quiet trie
+
+struct Lease;
+
+/**
+ * a Node in the path compressed trie stored in Mapper and Airport.
+ * Chains of single children are collapsed into one edge holding all of 
+ * their chars, so shared prefixes like "QFA" cost one node.
+ */
+struct TrieNode {
+    long portNumber; // 0 if no airport/plane ends at this node
+    int timeVisited; // use for roc2310 time count;
+    char* name; // full plane name once visited, kept for the visit history
+    struct Lease* lease; // mapper only, NULL unless the port is leased
+    char* edge; // chars on the edge from the parent (not '\0' terminated)
+    int edgeLength;
+    int childCount;
+    int childCapacity;
+    struct TrieNode** childNodes; // sorted by the first char of the edge
+};
+typedef struct TrieNode TrieNode;
+
+TrieNode* trie_create();
+
+TrieNode* trie_insert(TrieNode* root, const char* name, bool* created);
+
+TrieNode* trie_lookup(TrieNode* root, const char* name);
+
+TrieNode* trie_find_prefix(TrieNode* root, const char* prefix, 
+        const char** edgeRest, int* edgeRestLength);
+
+void trie_compact(TrieNode* root);
+
+void trie_start_compactor(TrieNode* root, sem_t* semaphore, 
+        unsigned long* changes);
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+/**
+ * @brief  maps one of the rings shared with the kernel
+ * @param  ringFD: the io_uring
+ * @param  size: bytes to map
+ * @param  offset: IORING_OFF_SQ_RING, IORING_OFF_CQ_RING or
+ * IORING_OFF_SQES
+ * @retval the mapping, NULL on error
+ */
+static void* uring_map(int ringFD, size_t size, off_t offset) {
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ringFD, offset);
+    return mapping == MAP_FAILED ? NULL : mapping;
+}
+
+/**
+ * @brief  maps and registers the provided receive buffers
+ * @note   needs IORING_REGISTER_PBUF_RING (Linux 5.19)
+ * @param  ring: the ring to give the buffers to
+ * @retval true if the kernel took them, otherwise false
+ */
+static bool uring_provide_buffers(Uring* ring) {
+    ring->bufferRingSize = sizeof(struct io_uring_buf) * URING_BUFFER_COUNT;
+    void* mapping = mmap(NULL, ring->bufferRingSize,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    ring->bufferRing = (struct io_uring_buf_ring*)mapping;
+    ring->buffers = (char*)malloc(URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(struct io_uring_buf_reg));
+    registration.ring_addr = (unsigned long)ring->bufferRing;
+    registration.ring_entries = URING_BUFFER_COUNT;
+    registration.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring->ringFD,
+            IORING_REGISTER_PBUF_RING, &registration, 1)) {
+        return false;
+    }
+    ring->bufferTail = 0;
+    for (unsigned i = 0; i < URING_BUFFER_COUNT; i++) {
+        uring_buffer_return(ring, i);
+    }
+    return true;
+}
+
+/**
+ * @brief  sets up an io_uring with URING_ENTRIES entries and the
+ * provided receive buffers
+ * @retval newly created ring, NULL if io_uring (or a feature the
+ * servers need) is not available
+ */
+Uring* uring_create() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(struct io_uring_params));
+    int ringFD = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ringFD < 0) {
+        return NULL; // ENOSYS on old kernels, EPERM when disabled
+    }
+    Uring* ring = (Uring*)calloc(1, sizeof(Uring));
+    ring->ringFD = ringFD;
+    ring->sqRingSize = params.sq_off.array
+            + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes
+            + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqRing = uring_map(ringFD, ring->sqRingSize, IORING_OFF_SQ_RING);
+    ring->cqRing = uring_map(ringFD, ring->cqRingSize, IORING_OFF_CQ_RING);
+    ring->sqes = (struct io_uring_sqe*)uring_map(ringFD, ring->sqesSize,
+            IORING_OFF_SQES);
+    if (ring->sqRing == NULL || ring->cqRing == NULL || ring->sqes == NULL
+            || !(params.features & IORING_FEAT_FAST_POLL)
+            || !uring_provide_buffers(ring)) {
+        uring_free(ring);
+        return NULL;
+    }
+
+    char* sq = (char*)ring->sqRing;
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    char* cq = (char*)ring->cqRing;
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return ring;
+}
+
+/**
+ * @brief  unmaps and closes the ring
+ * @param  ring: the ring to free
+ * @retval None
+ */
+void uring_free(Uring* ring) {
+    if (ring->sqRing != NULL) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if (ring->cqRing != NULL) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    close(ring->ringFD);
+    if (ring->bufferRing != NULL) {
+        munmap(ring->bufferRing, ring->bufferRingSize);
+    }
+    free(ring->buffers);
+    free(ring);
+}
+
+/**
+ * @brief  gets a cleared submission entry, submitting the queued ones
+ * first if the queue is full
+ * @param  ring: the ring to submit to
+ * @retval the entry to fill in, it is submitted by the next
+ * uring_submit_and_wait
+ */
+struct io_uring_sqe* uring_get_sqe(Uring* ring) {
+    unsigned tail = *ring->sqTail;
+    while (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE)
+            > ring->sqMask) {
+        uring_submit_and_wait(ring, 0);
+    }
+    unsigned index = tail & ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->sqQueued++;
+    return sqe;
+}
+
+/**
+ * @brief  submits the queued entries and waits for completions, all in
+ * one io_uring_enter
+ * @param  ring: the ring
+ * @param  waitFor: completions to wait for (0 to only submit)
+ * @retval true on success, false if the ring failed
+ */
+bool uring_submit_and_wait(Uring* ring, unsigned waitFor) {
+    unsigned submit = ring->sqQueued;
+    int submitted;
+    do {
+        submitted = syscall(__NR_io_uring_enter, ring->ringFD, submit,
+                waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted < 0) {
+        return errno == EBUSY; // completions to reap first, not an error
+    }
+    ring->sqQueued -= submitted;
+    return true;
+}
+
+/**
+ * @brief  gets the oldest completion without waiting
+ * @param  ring: the ring
+ * @retval the completion, NULL if none is waiting
+ */
+struct io_uring_cqe* uring_peek_cqe(Uring* ring) {
+    unsigned head = *ring->cqHead;
+    if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cqMask];
+}
+
+/**
+ * @brief  gives the completion from uring_peek_cqe back to the kernel
+ * @param  ring: the ring
+ * @retval None
+ */
+void uring_cqe_seen(Uring* ring) {
+    __atomic_store_n(ring->cqHead, *ring->cqHead + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief  gets the data of a provided buffer the kernel filled
+ * @param  ring: the ring
+ * @param  bufferId: id from the upper bits of the completion flags
+ * @retval the buffer
+ */
+char* uring_buffer(Uring* ring, unsigned short bufferId) {
+    return ring->buffers + (size_t)bufferId * URING_BUFFER_SIZE;
+}
+
+/**
+ * @brief  hands a provided buffer back to the kernel for the next receive
+ * @param  ring: the ring
+ * @param  bufferId: the buffer to give back
+ * @retval None
+ */
+void uring_buffer_return(Uring* ring, unsigned short bufferId) {
+    struct io_uring_buf* buffer = &ring->bufferRing->bufs[ring->bufferTail
+            & (URING_BUFFER_COUNT - 1)];
+    buffer->addr = (unsigned long)uring_buffer(ring, bufferId);
+    buffer->len = URING_BUFFER_SIZE;
+    buffer->bid = bufferId;
+    ring->bufferTail++;
+    __atomic_store_n(&ring->bufferRing->tail, ring->bufferTail,
+            __ATOMIC_RELEASE);
+}
@@ -0,0 +1,55 @@
+#ifndef URING_H_
+#define URING_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 256 // submission queue size
+#define URING_BUFFER_COUNT 256 // provided receive buffers (power of 2)
+#define URING_BUFFER_SIZE 4096 // bytes per provided receive buffer
+#define URING_BUFFER_GROUP 0 // group id the receive buffers are given as
+
+/**
+ * an io_uring set up with raw syscalls (no liburing), plus one ring of
+ * provided buffers the kernel picks receive buffers from
+ */
+typedef struct {
+    int ringFD;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+    unsigned sqQueued; // sqes filled in but not yet submitted
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+    void* sqRing; // mappings, kept to unmap them
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+    struct io_uring_buf_ring* bufferRing;
+    size_t bufferRingSize;
+    char* buffers; // URING_BUFFER_COUNT * URING_BUFFER_SIZE bytes
+    unsigned short bufferTail; // next free entry of bufferRing
+} Uring;
+
+Uring* uring_create();
+
+void uring_free(Uring* ring);
+
+struct io_uring_sqe* uring_get_sqe(Uring* ring);
+
+bool uring_submit_and_wait(Uring* ring, unsigned waitFor);
+
+struct io_uring_cqe* uring_peek_cqe(Uring* ring);
+
+void uring_cqe_seen(Uring* ring);
+
+char* uring_buffer(Uring* ring, unsigned short bufferId);
+
+void uring_buffer_return(Uring* ring, unsigned short bufferId);
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include "visitHistory.h"
+
+#define BUCKET_INIT_SIZE 4
+
+/**
+ * @brief  creates an empty history starting now
+ * @retval newly created history
+ */
+VisitHistory* visit_history_create() {
+    VisitHistory* history = (VisitHistory*)malloc(sizeof(VisitHistory));
+    clock_gettime(CLOCK_MONOTONIC, &history->start);
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    history->epoch = (unsigned long)wall.tv_sec * 1000000 
+            + wall.tv_nsec / 1000;
+    history->sequence = 0;
+    for (int i = 0; i < VISIT_HISTORY_SECONDS; i++) {
+        history->buckets[i].second = -1;
+        history->buckets[i].firstSequence = 0;
+        history->buckets[i].names = NULL;
+        history->buckets[i].count = 0;
+        history->buckets[i].capacity = 0;
+    }
+    return history;
+}
+
+/**
+ * @brief  gets the current time on the history clock
+ * @param  history: the history to check
+ * @retval whole seconds since the history was created
+ */
+long visit_history_now(VisitHistory* history) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec - history->start.tv_sec 
+            - (now.tv_nsec < history->start.tv_nsec ? 1 : 0);
+}
+
+/**
+ * @brief  records a visit at the current second, numbered one past the 
+ * last visit
+ * @note   caller must hold the airport semaphore, planeName must live as 
+ * long as the history (it is the name kept in the trie)
+ * @param  history: the history to update
+ * @param  planeName: the plane which visited
+ * @retval None
+ */
+void visit_history_record(VisitHistory* history, const char* planeName) {
+    long second = visit_history_now(history);
+    VisitBucket* bucket = &history->buckets[second % VISIT_HISTORY_SECONDS];
+    if (bucket->second != second) {
+        bucket->second = second; // an hour old, reuse its memory
+        bucket->count = 0;
+        bucket->firstSequence = history->sequence + 1;
+    }
+    if (bucket->count == bucket->capacity) {
+        bucket->capacity = bucket->capacity ? bucket->capacity * 2 
+                : BUCKET_INIT_SIZE;
+        bucket->names = (const char**)realloc(bucket->names, 
+                sizeof(const char*) * bucket->capacity);
+    }
+    bucket->names[bucket->count++] = planeName;
+    history->sequence++;
+}
+
+/**
+ * @brief  gathers the visits made from second from to second to inclusive
+ * @note   only the buckets inside the range are touched, visits older 
+ * than VISIT_HISTORY_SECONDS are gone. Caller must hold the airport 
+ * semaphore and free *names.
+ * @param  history: the history to search
+ * @param  from: first second of the range
+ * @param  to: last second of the range
+ * @param  names: set to a new array of plane names (one per visit)
+ * @retval number of names
+ */
+int visit_history_collect(VisitHistory* history, long from, long to, 
+        const char*** names) {
+    long now = visit_history_now(history);
+    if (to > now) {
+        to = now;
+    }
+    if (from < now - VISIT_HISTORY_SECONDS + 1) {
+        from = now - VISIT_HISTORY_SECONDS + 1;
+    }
+    if (from < 0) {
+        from = 0;
+    }
+
+    int count = 0;
+    for (long second = from; second <= to; second++) {
+        VisitBucket* bucket = 
+                &history->buckets[second % VISIT_HISTORY_SECONDS];
+        if (bucket->second == second) {
+            count += bucket->count;
+        }
+    }
+    *names = (const char**)malloc(sizeof(const char*) * (count + 1));
+    int index = 0;
+    for (long second = from; second <= to; second++) {
+        VisitBucket* bucket = 
+                &history->buckets[second % VISIT_HISTORY_SECONDS];
+        if (bucket->second == second) {
+            for (int i = 0; i < bucket->count; i++) {
+                (*names)[index++] = bucket->names[i];
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief  gathers, in the order they were made, the visits numbered after 
+ * a cursor
+ * @note   buckets are in sequence order, so only the visits past the 
+ * cursor are copied. Visits older than VISIT_HISTORY_SECONDS are gone. 
+ * Caller must hold the airport semaphore and free *names.
+ * @param  history: the history to search
+ * @param  after: sequence number of the last visit already seen
+ * @param  names: set to a new array of plane names (one per visit)
+ * @param  oldest: set to the number of the oldest visit still held, 
+ * history->sequence + 1 if none is
+ * @retval number of names, the last one is numbered history->sequence
+ */
+int visit_history_collect_after(VisitHistory* history, 
+        unsigned long after, const char*** names, unsigned long* oldest) {
+    long now = visit_history_now(history);
+    long from = now - VISIT_HISTORY_SECONDS + 1;
+    if (from < 0) {
+        from = 0;
+    }
+    int count = 0;
+    *oldest = history->sequence + 1;
+    for (int pass = 0; pass < 2; pass++) { // count, then copy
+        int index = 0;
+        for (long second = from; second <= now; second++) {
+            VisitBucket* bucket = 
+                    &history->buckets[second % VISIT_HISTORY_SECONDS];
+            if (pass == 0 && bucket->second == second && bucket->count > 0
+                    && bucket->firstSequence < *oldest) {
+                *oldest = bucket->firstSequence;
+            }
+            if (bucket->second != second 
+                    || bucket->firstSequence + bucket->count <= after + 1) {
+                continue; // unused, or seen before the cursor
+            }
+            int first = bucket->firstSequence > after 
+                    ? 0 : (int)(after + 1 - bucket->firstSequence);
+            for (int i = first; i < bucket->count; i++) {
+                if (pass == 1) {
+                    (*names)[index] = bucket->names[i];
+                }
+                index++;
+            }
+        }
+        if (pass == 0) {
+            count = index;
+            *names = (const char**)malloc(sizeof(const char*) 
+                    * (count + 1));
+        }
+    }
+    return count;
+}
@@ -0,0 +1,36 @@
+#ifndef VISIT_HISTORY_H_
+#define VISIT_HISTORY_H_
+#include <time.h>
+
+#define VISIT_HISTORY_SECONDS 3600 // one bucket per second, an hour back
+
+/* the visits made during one second */
+typedef struct {
+    long second; // seconds since the airport started, -1 if never used
+    unsigned long firstSequence; // sequence number of names[0]
+    const char** names; // plane names, owned by the airport trie
+    int count;
+    int capacity;
+} VisitBucket;
+
+/* ring of per second buckets, the oldest second is reused first */
+typedef struct {
+    struct timespec start; // CLOCK_MONOTONIC at creation
+    unsigned long epoch; // CLOCK_REALTIME in microseconds at creation
+    unsigned long sequence; // visits recorded, numbered from 1
+    VisitBucket buckets[VISIT_HISTORY_SECONDS];
+} VisitHistory;
+
+VisitHistory* visit_history_create();
+
+long visit_history_now(VisitHistory* history);
+
+void visit_history_record(VisitHistory* history, const char* planeName);
+
+int visit_history_collect(VisitHistory* history, long from, long to, 
+        const char*** names);
+
+int visit_history_collect_after(VisitHistory* history, 
+        unsigned long after, const char*** names, unsigned long* oldest);
+
+#endif